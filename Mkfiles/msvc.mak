@@ -74,11 +74,12 @@ LIBOBJ_NW = stdlib\snprintf.$(O) stdlib\vsnprintf.$(O) stdlib\strlcpy.$(O) \
 	nasmlib\alloc.$(O) nasmlib\asprintf.$(O) nasmlib\errfile.$(O) \
 	nasmlib\crc32.$(O) nasmlib\crc64.$(O) nasmlib\md5c.$(O) \
 	nasmlib\string.$(O) nasmlib\nctype.$(O) \
-	nasmlib\file.$(O) nasmlib\mmap.$(O) nasmlib\ilog2.$(O) \
-	nasmlib\realpath.$(O) nasmlib\path.$(O) \
-	nasmlib\filename.$(O) nasmlib\rlimit.$(O) \
+	nasmlib\file.$(O) nasmlib\filecache.$(O) nasmlib\mmap.$(O) \
+	nasmlib\ilog2.$(O) nasmlib\realpath.$(O) nasmlib\path.$(O) \
+	nasmlib\filename.$(O) nasmlib\rlimit.$(O) nasmlib\profile.$(O) \
+	nasmlib\workers.$(O) nasmlib\server.$(O) \
 	nasmlib\zerobuf.$(O) nasmlib\readnum.$(O) nasmlib\bsi.$(O) \
-	nasmlib\rbtree.$(O) nasmlib\hashtbl.$(O) \
+	nasmlib\rbtree.$(O) nasmlib\hashtbl.$(O) nasmlib\atom.$(O) \
 	nasmlib\raa.$(O) nasmlib\saa.$(O) \
 	nasmlib\strlist.$(O) \
 	nasmlib\perfhash.$(O) nasmlib\badenum.$(O) \
@@ -101,6 +102,7 @@ LIBOBJ_NW = stdlib\snprintf.$(O) stdlib\vsnprintf.$(O) stdlib\strlcpy.$(O) \
 	asm\segalloc.$(O) \
 	asm\rdstrnum.$(O) \
 	asm\srcfile.$(O) \
+	asm\relax.$(O) asm\objcache.$(O) \
 	macros\macros.$(O) \
 	\
 	output\outform.$(O) output\outlib.$(O) output\legacy.$(O) \
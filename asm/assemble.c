@@ -187,6 +187,9 @@
 #include "disp8.h"
 #include "listing.h"
 #include "dbginfo.h"
+#include "relax.h"
+#include "profile.h"
+#include "hashtbl.h"
 
 enum match_result {
     /*
@@ -230,9 +233,42 @@ typedef struct {
 #define GEN_MODRM(mod, reg, rm)                     \
         (((mod) << 6) | (((reg) & 7) << 3) | ((rm) & 7))
 
+/*
+ * Span-dependent jump information for the relaxation engine, set by
+ * jmp_match().
+ */
+static struct {
+    bool seen;                  /* jmp_match() had to look at the target */
+    bool noshort;               /* Never accept the short form */
+    int64_t shortsize;          /* Size of the short form */
+} sdi;
+
+/*
+ * Output of the first iteration of a TIMES-repeated instruction, if
+ * it is plain data which can simply be replicated.
+ */
+static struct {
+    bool active;                /* Capturing output */
+    bool fixed;                 /* Nothing depends on the position */
+    uint8_t *buf;
+    size_t len, size;
+} rep;
+
+/*
+ * Raw bytes of the instruction being encoded, passed to the listing
+ * and output backends as one piece.  Anything else written in the
+ * middle of the instruction, such as a relocation, flushes them first.
+ */
+static struct {
+    bool active;                /* Collecting output */
+    size_t len;
+    uint8_t buf[64];
+} encbuf;
+
 static int64_t calcsize(int32_t, int64_t, int, insn *,
                         const struct itemplate *);
 static int emit_prefix(struct out_data *data, const int bits, insn *ins);
+static void out_flush(const struct out_data *data);
 static void gencode(struct out_data *data, insn *ins);
 static enum match_result find_match(const struct itemplate **tempp,
                                     insn *instruction,
@@ -364,6 +400,8 @@ static void out(struct out_data *data)
     uint64_t zeropad = 0;
     int64_t addrval;
     int32_t fixseg;             /* Segment for which to produce fixed data */
+    bool reladdr = data->type == OUT_RELADDR;
+    uint64_t ptime;
 
     if (!data->size)
         return;                 /* Nothing to do */
@@ -413,6 +451,19 @@ static void out(struct out_data *data)
         break;
     }
 
+    if (encbuf.active) {
+        if (data->type == OUT_RAWDATA && !reladdr && data->data &&
+            data->segment != NO_SEG &&
+            encbuf.len + data->size <= sizeof encbuf.buf) {
+            memcpy(encbuf.buf + encbuf.len, data->data, data->size);
+            encbuf.len    += data->size;
+            data->offset  += data->size;
+            data->insoffs += data->size;
+            return;
+        }
+        out_flush(data);
+    }
+
     /*
      * If the source location or output segment has changed,
      * let the debug backend know. Some backends really don't
@@ -447,6 +498,22 @@ static void out(struct out_data *data)
         zeropad = data->size - amax;
         data->size = amax;
     }
+
+    if (unlikely(rep.active)) {
+        /* A relative address converted to raw data is still relative */
+        if (data->type != OUT_RAWDATA || reladdr || zeropad ||
+            data->segment == NO_SEG) {
+            rep.fixed = false;
+        } else if (rep.fixed) {
+            if (rep.len + data->size > rep.size) {
+                rep.size = (rep.len + data->size) << 1;
+                rep.buf = nasm_realloc(rep.buf, rep.size);
+            }
+            memcpy(rep.buf + rep.len, data->data, data->size);
+            rep.len += data->size;
+        }
+    }
+
     lfmt->output(data);
 
     if (likely(data->segment != NO_SEG)) {
@@ -456,7 +523,9 @@ static void out(struct out_data *data)
         if (debug_current_macro)
             debug_macro_out(data);
 
+        ptime = profile_start();
         ofmt->output(data);
+        profile_stop(PROF_OUTPUT, ptime);
     } else {
         /* Outputting to ABSOLUTE section - only reserve is permitted */
         if (data->type != OUT_RESERVE)
@@ -471,13 +540,38 @@ static void out(struct out_data *data)
         data->type     = OUT_ZERODATA;
         data->size     = zeropad;
         lfmt->output(data);
+        ptime = profile_start();
         ofmt->output(data);
+        profile_stop(PROF_OUTPUT, ptime);
         data->offset  += zeropad;
         data->insoffs += zeropad;
         data->size    += zeropad;  /* Restore original size value */
     }
 }
 
+/*
+ * Pass the bytes collected in encbuf on; data is the state after them.
+ */
+static void out_flush(const struct out_data *data)
+{
+    struct out_data bdata;
+
+    if (!encbuf.len)
+        return;
+
+    bdata         = *data;
+    bdata.type    = OUT_RAWDATA;
+    bdata.data    = encbuf.buf;
+    bdata.size    = encbuf.len;
+    bdata.offset  = data->offset - encbuf.len;
+    bdata.insoffs = data->insoffs - encbuf.len;
+
+    encbuf.active = false;
+    encbuf.len    = 0;
+    out(&bdata);
+    encbuf.active = true;
+}
+
 static inline void out_rawdata(struct out_data *data, const void *rawdata,
                                size_t size)
 {
@@ -564,6 +658,68 @@ static void out_reladdr(struct out_data *data, const struct operand *opx,
     out(data);
 }
 
+/* Upper bound on the size of a replicated TIMES block */
+#define TIMES_MAX_BUF (ZERO_BUF_SIZE * 4)
+
+static void rep_start(const insn *ins)
+{
+    rep.active = ins->times > 1;
+    rep.fixed  = true;
+    rep.len    = 0;
+}
+
+/*
+ * If the output of the first iteration of a TIMES-repeated
+ * instruction was captured, emit the remaining iterations as
+ * replicated blocks of data, and tell the upper layer not to iterate.
+ */
+static void rep_finish(struct out_data *data, insn *ins, bool ok)
+{
+    uint8_t *block;
+    size_t per, n;
+    int64_t left;
+
+    if (!rep.active)
+        return;
+
+    rep.active = false;
+    if (!ok || !rep.fixed || !rep.len)
+        return;
+
+    per = rep.len < TIMES_MAX_BUF ? TIMES_MAX_BUF / rep.len : 1;
+    left = ins->times - 1;
+    if ((int64_t)per > left)
+        per = left;
+
+    block = nasm_malloc(per * rep.len);
+    for (n = 0; n < per; n++)
+        memcpy(block + n * rep.len, rep.buf, rep.len);
+
+    lfmt->uplevel(LIST_TIMES, ins->times);
+    while (left > 0) {
+        n = left < (int64_t)per ? (size_t)left : per;
+        data->insoffs = 0;
+        data->inslen  = n * rep.len;
+        out_rawdata(data, block, n * rep.len);
+        left -= n;
+    }
+    lfmt->downlevel(LIST_TIMES);
+
+    nasm_free(block);
+    ins->times = 1;             /* Tell the upper layer not to iterate */
+}
+
+/*
+ * The size of a TIMES-repeated instruction which does not depend on
+ * its position is the same for every iteration.
+ */
+static inline int64_t merge_times(insn *ins, int64_t isize)
+{
+    isize *= ins->times;
+    ins->times = 1;             /* Tell the upper layer not to iterate */
+    return isize;
+}
+
 static bool jmp_match(int32_t segment, int64_t offset, int bits,
                       insn * ins, const struct itemplate *temp)
 {
@@ -578,8 +734,12 @@ static bool jmp_match(int32_t segment, int64_t offset, int bits,
         return false;
     if (optimizing.level < 0 && c == 0371)
         return false;
+    if (sdi.noshort)
+        return false;
 
     isize = calcsize(segment, offset, bits, ins, temp);
+    sdi.seen = true;
+    sdi.shortsize = isize;
 
     if (ins->oprs[0].opflags & OPFLAG_UNKNOWN)
         /* Be optimistic in pass 1 */
@@ -633,6 +793,97 @@ static inline size_t pad_bytes(size_t len, size_t align)
     return partial ? align - partial : 0;
 }
 
+static void out_number(struct out_data *data, int elem, int64_t offset,
+                       int32_t segment, int32_t wrt, bool relative)
+{
+    data->insoffs = 0;
+    data->inslen = data->size = elem;
+    data->tsegment = segment;
+    data->toffset  = offset;
+    data->twrt = wrt;
+    data->relbase = 0;
+    if (segment != NO_SEG && (segment & 1)) {
+        data->type  = OUT_SEGMENT;
+        data->flags = OUT_UNSIGNED;
+    } else {
+        data->type = relative ? OUT_RELADDR : OUT_ADDRESS;
+        data->flags = OUT_WRAP;
+    }
+    out(data);
+}
+
+/*
+ * Emit a run of plain integers as raw data, converted a block at a
+ * time.  This is what out() would make of them one by one, unless the
+ * backend wants to see the addresses.
+ */
+static void out_numbers(struct out_data *data, const extop *e)
+{
+    uint8_t buf[4096];
+    const int64_t *v    = e->val.nums.vals;
+    const int64_t *vend = v + e->val.nums.n;
+    const int elem      = e->elem;
+    const size_t per    = sizeof buf / elem;
+
+    if ((ofmt->flags & OFMT_KEEP_ADDR) || data->segment == NO_SEG) {
+        while (v < vend)
+            out_number(data, elem, *v++, NO_SEG, NO_SEG, false);
+        return;
+    }
+
+    while (v < vend) {
+        size_t i, n = vend - v;
+        uint8_t *p = buf;
+
+        if (n > per)
+            n = per;
+
+        /*
+         * A value which overflows is emitted on its own, so that its
+         * warning stays next to its line in the listing.
+         */
+        if (elem < 8) {
+            for (i = 0; i < n; i++) {
+                if (overflow_general(v[i], elem))
+                    break;
+            }
+            if (!i) {
+                out_number(data, elem, *v++, NO_SEG, NO_SEG, false);
+                continue;
+            }
+            n = i;
+        }
+
+        switch (elem) {
+        case 1:
+            for (i = 0; i < n; i++)
+                WRITECHAR(p, v[i]);
+            break;
+        case 2:
+            for (i = 0; i < n; i++)
+                WRITESHORT(p, v[i]);
+            break;
+        case 4:
+            for (i = 0; i < n; i++)
+                WRITELONG(p, v[i]);
+            break;
+        case 8:
+            for (i = 0; i < n; i++)
+                WRITEDLONG(p, v[i]);
+            break;
+        default:
+            for (i = 0; i < n; i++)
+                WRITEADDR(p, v[i], elem);
+            break;
+        }
+
+        data->insoffs = 0;
+        data->inslen = n * elem;
+        out_rawdata(data, buf, n * elem);
+        v += n;
+    }
+}
+
 static void out_eops(struct out_data *data, const extop *e)
 {
     while (e) {
@@ -652,27 +903,18 @@ static void out_eops(struct out_data *data, const extop *e)
                 nasm_nonfatal("integer supplied as %d-bit data",
                               e->elem << 3);
             } else {
-                while (dup--) {
-                    data->insoffs = 0;
-                    data->inslen = data->size = e->elem;
-                    data->tsegment = e->val.num.segment;
-                    data->toffset  = e->val.num.offset;
-                    data->twrt = e->val.num.wrt;
-                    data->relbase = 0;
-                    if (e->val.num.segment != NO_SEG &&
-                        (e->val.num.segment & 1)) {
-                        data->type  = OUT_SEGMENT;
-                        data->flags = OUT_UNSIGNED;
-                    } else {
-                        data->type = e->val.num.relative
-                            ? OUT_RELADDR : OUT_ADDRESS;
-                        data->flags = OUT_WRAP;
-                    }
-                    out(data);
-                }
+                while (dup--)
+                    out_number(data, e->elem, e->val.num.offset,
+                               e->val.num.segment, e->val.num.wrt,
+                               e->val.num.relative);
             }
             break;
 
+        case EOT_DB_NUMBERS:
+            while (dup--)
+                out_numbers(data, e);
+            break;
+
         case EOT_DB_FLOAT:
         case EOT_DB_STRING:
         case EOT_DB_STRING_FREE:
@@ -706,11 +948,38 @@ static void out_eops(struct out_data *data, const extop *e)
 /* This is totally just a wild guess what is reasonable... */
 #define INCBIN_MAX_BUF (ZERO_BUF_SIZE * 16)
 
+/*
+ * Sizes of the files included with INCBIN, which are needed in every
+ * pass.  Each file is looked up once per session.
+ */
+static struct hash_table incbin_sizes;
+
+static off_t incbin_size(const char *fname)
+{
+    struct hash_insert hi;
+    off_t **lpp, *lp;
+
+    lpp = (off_t **)hash_find(&incbin_sizes, fname, &hi);
+    if (lpp)
+        return **lpp;
+
+    nasm_new(lp);
+    *lp = nasm_file_size_by_path(fname);
+    hash_add(&hi, nasm_strdup(fname), lp);
+    return *lp;
+}
+
+void assemble_cleanup(void)
+{
+    hash_free_all(&incbin_sizes, true);
+}
+
 int64_t assemble(int32_t segment, int64_t start, int bits, insn *instruction)
 {
     struct out_data data;
     const struct itemplate *temp;
     enum match_result m;
+    uint64_t errors, ptime;
 
     if (instruction->opcode == I_none)
         return 0;
@@ -722,7 +991,10 @@ int64_t assemble(int32_t segment, int64_t start, int bits, insn *instruction)
     data.bits = bits;
 
     if (opcode_is_db(instruction->opcode)) {
+        errors = nasm_error_count;
+        rep_start(instruction);
         out_eops(&data, instruction->eops);
+        rep_finish(&data, instruction, errors == nasm_error_count);
     } else if (instruction->opcode == I_INCBIN) {
         const char *fname = instruction->eops->val.string.data;
         FILE *fp;
@@ -744,7 +1016,7 @@ int64_t assemble(int32_t segment, int64_t start, int bits, insn *instruction)
             goto done;
         }
 
-        len = nasm_file_size(fp);
+        len = incbin_size(fname);
 
         if (len == (off_t)-1) {
             nasm_nonfatal("`incbin': unable to get length of file `%s'",
@@ -770,6 +1042,23 @@ int64_t assemble(int32_t segment, int64_t start, int bits, insn *instruction)
         if (!len)
             goto end_incbin;
 
+        /* Let the backend copy large files when it writes the output */
+        if ((ofmt->flags & OFMT_FILEDATA) && len >= (off_t)INCBIN_MAX_BUF) {
+            struct out_filedata fdata;
+
+            fdata.path   = fname;
+            fdata.offset = base;
+            while (t--) {
+                data.insoffs = 0;
+                data.inslen  = 0;
+                data.type    = OUT_FILEDATA;
+                data.data    = &fdata;
+                data.size    = len;
+                out(&data);
+            }
+            goto end_incbin;
+        }
+
         /* Try to map file data */
         map = nasm_map_file(fp, base, len);
         if (!map) {
@@ -843,7 +1132,10 @@ int64_t assemble(int32_t segment, int64_t start, int bits, insn *instruction)
         /* Check to see if we need an address-size prefix */
         add_asp(instruction, bits);
 
+        errors = nasm_error_count;
+        ptime = profile_start();
         m = find_match(&temp, instruction, data.segment, data.offset, bits);
+        profile_stop(PROF_MATCH, ptime);
 
         if (m == MOK_GOOD) {
             /* Matches! */
@@ -900,13 +1192,20 @@ int64_t assemble(int32_t segment, int64_t start, int bits, insn *instruction)
             data.bits = bits;
             data.insoffs = 0;
 
+            ptime = profile_start();
             data.inslen = calcsize(data.segment, data.offset,
                                    bits, instruction, temp);
+            profile_stop(PROF_MATCH, ptime);
             nasm_assert(data.inslen >= 0);
             data.inslen = merge_resb(instruction, data.inslen);
 
+            rep_start(instruction);
+            encbuf.active = true;
             gencode(&data, instruction);
+            out_flush(&data);
+            encbuf.active = false;
             nasm_assert(data.insoffs == data.inslen);
+            rep_finish(&data, instruction, errors == nasm_error_count);
         } else {
             /* No match */
             switch (m) {
@@ -1110,6 +1409,18 @@ static int64_t len_extops(const extop *e)
             isize += e->dup * e->elem;
             break;
 
+        case EOT_DB_NUMBERS:
+        {
+            size_t i;
+
+            if (e->elem < 8) {
+                for (i = 0; i < e->val.nums.n; i++)
+                    warn_overflow_const(e->val.nums.vals[i], e->elem);
+            }
+            isize += e->dup * e->val.nums.n * e->elem;
+            break;
+        }
+
         case EOT_DB_RESERVE:
             isize += e->dup * e->elem;
             break;
@@ -1121,6 +1432,48 @@ static int64_t len_extops(const extop *e)
     return isize;
 }
 
+/*
+ * Tell the relaxation engine about a jump which could use either its
+ * short or its long form, depending on the distance to the target.
+ */
+static void record_jump(int32_t segment, int64_t offset, int bits,
+                        insn *instruction, const struct itemplate *temp,
+                        int64_t isize)
+{
+    const operand *op = &instruction->oprs[0];
+    int64_t longsize = isize;
+
+    if (segment == NO_SEG || (op->opflags & OPFLAG_UNKNOWN) ||
+        has_prefix(instruction, PPS_REP, P_BND)) {
+        relax_unsolvable();
+        return;
+    }
+
+    if ((temp->code[0] & ~1) == 0370) {
+        /* The short form was chosen; find the size of the long form */
+        const struct itemplate *ltemp;
+        errhold eh;
+        enum match_result m;
+        insn tmp = *instruction;
+
+        eh = nasm_error_hold_push();
+        sdi.noshort = true;
+        m = find_match(&ltemp, &tmp, segment, offset, bits);
+        sdi.noshort = false;
+        if (m == MOK_GOOD)
+            longsize = calcsize(segment, offset, bits, &tmp, ltemp);
+        nasm_error_hold_pop(eh, false);
+
+        if (m != MOK_GOOD) {
+            relax_unsolvable();
+            return;
+        }
+    }
+
+    relax_jump(segment, offset, isize, sdi.shortsize, longsize,
+               op->segment, op->offset);
+}
+
 int64_t insn_size(int32_t segment, int64_t offset, int bits, insn *instruction)
 {
     const struct itemplate *temp;
@@ -1133,15 +1486,19 @@ int64_t insn_size(int32_t segment, int64_t offset, int bits, insn *instruction)
         define_equ(instruction);
         return 0;
     } else if (opcode_is_db(instruction->opcode)) {
+        uint64_t errors = nasm_error_count;
+
         isize = len_extops(instruction->eops);
         debug_set_db_type(instruction);
+        if (errors == nasm_error_count)
+            isize = merge_times(instruction, isize);
         return isize;
     } else if (instruction->opcode == I_INCBIN) {
         const extop *e = instruction->eops;
         const char *fname = e->val.string.data;
         off_t len;
 
-        len = nasm_file_size_by_path(fname);
+        len = incbin_size(fname);
         if (len == (off_t)-1) {
             nasm_nonfatal("`incbin': unable to get length of file `%s'",
                           fname);
@@ -1168,17 +1525,30 @@ int64_t insn_size(int32_t segment, int64_t offset, int bits, insn *instruction)
     } else {
         /* Normal instruction, or RESx */
 
+        uint64_t errors = nasm_error_count;
+        uint64_t ptime;
+
         /* Check to see if we need an address-size prefix */
         add_asp(instruction, bits);
 
+        ptime = profile_start();
+        sdi.seen = false;
         m = find_match(&temp, instruction, segment, offset, bits);
-        if (m != MOK_GOOD)
+        if (m != MOK_GOOD) {
+            profile_stop(PROF_MATCH, ptime);
             return -1;              /* No match */
+        }
 
         isize = calcsize(segment, offset, bits, instruction, temp);
+        profile_stop(PROF_MATCH, ptime);
         debug_set_type(instruction);
         isize = merge_resb(instruction, isize);
 
+        if (sdi.seen)
+            record_jump(segment, offset, bits, instruction, temp, isize);
+        else if (errors == nasm_error_count)
+            isize = merge_times(instruction, isize);
+
         return isize;
     }
 }
@@ -1231,8 +1601,8 @@ static void bad_hle_warn(const insn * ins, uint8_t hleok)
 #define case3(x) case (x): case (x)+1: case (x)+2
 #define case4(x) case3(x): case (x)+3
 
-static int64_t calcsize(int32_t segment, int64_t offset, int bits,
-                        insn * ins, const struct itemplate *temp)
+static int64_t do_calcsize(int32_t segment, int64_t offset, int bits,
+                           insn * ins, const struct itemplate *temp)
 {
     const uint8_t *codes = temp->code;
     int64_t length = 0;
@@ -1748,6 +2118,206 @@ static int64_t calcsize(int32_t segment, int64_t offset, int bits,
     return length;
 }
 
+/*
+ * Cache of the sizes computed by do_calcsize(), together with the
+ * encoding state it leaves in the instruction for gencode().  The
+ * key covers the template and everything about the operands that
+ * do_calcsize() looks at, except that displacements only enter it
+ * by the size class of their encoding, and immediates not at all.
+ */
+#define ENCODE_CACHE_BITS   10
+#define ENCODE_CACHE_SIZE   (1 << ENCODE_CACHE_BITS)
+#define ENCODE_KEY_WORDS    (4*MAX_OPERANDS + 2 + (MAXPREFIX+3)/4 + \
+                             (sizeof(iflag_t)+7)/8)
+
+struct encode_key {
+    uint64_t w[ENCODE_KEY_WORDS];
+};
+
+struct encode_state {
+    int64_t length;
+    int prefixes[MAXPREFIX];
+    int rex;
+    int vexreg;
+    int vex_cm;
+    int vex_wlp;
+    uint8_t evex_p[3];
+    enum ttypes evex_tuple;
+    struct {
+        opflags_t type;
+        int eaflags;
+        enum reg_enum indexreg;
+        int scale;
+        int hintbase;
+        enum eval_hint hinttype;
+    } oprs[MAX_OPERANDS];
+};
+
+static struct encode_cache_entry {
+    struct encode_key key;
+    struct encode_state state;
+} encode_cache[ENCODE_CACHE_SIZE];
+
+/*
+ * Size class of a displacement: which of the zero, 8-bit and
+ * (for EVEX) compressed disp8*N encodings it admits.
+ */
+static unsigned int disp_class(const operand *op, bool evex)
+{
+    int32_t o = op->offset;
+    int16_t o16 = op->offset;
+    unsigned int class;
+    int tz, fit;
+
+    class = (o == 0) | ((o16 == 0) << 1) |
+        ((o >= -128 && o <= 127) << 2) |
+        ((o16 >= -128 && o16 <= 127) << 3);
+
+    if (evex) {
+        /* disp8*N works for N = 2^n with fit <= n <= tz */
+        for (tz = 0; tz < 7 && !(o & (1 << tz)); tz++)
+            ;
+        for (fit = 0; fit < 7; fit++)
+            if (o >= -128 * (1 << fit) && o <= 127 * (1 << fit))
+                break;
+        class |= (tz << 4) | (fit << 8);
+    }
+
+    return class;
+}
+
+static uint64_t encode_key(struct encode_key *key, const insn *ins,
+                           const struct itemplate *temp, int bits)
+{
+    uint64_t *w = key->w;
+    uint64_t hash = 0;
+    bool evex = itemp_has(temp, IF_EVEX);
+    int i;
+
+    memset(key, 0, sizeof *key);
+    for (i = 0; i < ins->operands; i++) {
+        const operand *op = &ins->oprs[i];
+
+        w[0] = op->type;
+        w[1] = op->decoflags | ((uint64_t)(uint32_t)op->eaflags << 32);
+        w[2] = (uint16_t)op->basereg |
+            ((uint64_t)(uint16_t)op->indexreg << 16) |
+            ((uint64_t)(uint16_t)op->hintbase << 32) |
+            ((uint64_t)(uint8_t)op->scale << 48) |
+            ((uint64_t)(uint8_t)op->hinttype << 56);
+        w[3] = (uint8_t)op->disp_size |
+            ((uint64_t)(uint8_t)op->opflags << 8) |
+            ((uint64_t)(op->segment == NO_SEG) << 16) |
+            ((uint64_t)disp_class(op, evex) << 32);
+        w += 4;
+    }
+
+    w = &key->w[4*MAX_OPERANDS];
+    w[0] = (uintptr_t)temp;
+    w[1] = (uint8_t)bits |
+        ((uint64_t)(uint8_t)ins->addr_size << 8) |
+        ((uint64_t)(uint8_t)ins->operands << 16) |
+        ((uint64_t)(uint8_t)ins->evex_brerop << 24) |
+        ((uint64_t)(uint16_t)ins->evex_rm << 32) |
+        ((uint64_t)!!globalbnd << 48) |
+        ((uint64_t)!!globalrel << 49);
+    for (i = 0; i < MAXPREFIX; i++)
+        w[2 + i/4] |= (uint64_t)(uint16_t)ins->prefixes[i] << ((i & 3) << 4);
+    memcpy(&w[2 + (MAXPREFIX+3)/4], &cpu, sizeof cpu);
+
+    for (i = 0; i < (int)ENCODE_KEY_WORDS; i++) {
+        hash = (hash ^ key->w[i]) * UINT64_C(0x9e3779b97f4a7c15);
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+static void encode_save(struct encode_state *st, const insn *ins,
+                        int64_t length)
+{
+    int i;
+
+    st->length = length;
+    memcpy(st->prefixes, ins->prefixes, sizeof st->prefixes);
+    st->rex = ins->rex;
+    st->vexreg = ins->vexreg;
+    st->vex_cm = ins->vex_cm;
+    st->vex_wlp = ins->vex_wlp;
+    memcpy(st->evex_p, ins->evex_p, sizeof st->evex_p);
+    st->evex_tuple = ins->evex_tuple;
+    for (i = 0; i < ins->operands; i++) {
+        const operand *op = &ins->oprs[i];
+
+        st->oprs[i].type     = op->type;
+        st->oprs[i].eaflags  = op->eaflags;
+        st->oprs[i].indexreg = op->indexreg;
+        st->oprs[i].scale    = op->scale;
+        st->oprs[i].hintbase = op->hintbase;
+        st->oprs[i].hinttype = op->hinttype;
+    }
+}
+
+static int64_t encode_restore(const struct encode_state *st, insn *ins)
+{
+    int i;
+
+    memcpy(ins->prefixes, st->prefixes, sizeof ins->prefixes);
+    ins->rex = st->rex;
+    ins->vexreg = st->vexreg;
+    ins->vex_cm = st->vex_cm;
+    ins->vex_wlp = st->vex_wlp;
+    memcpy(ins->evex_p, st->evex_p, sizeof ins->evex_p);
+    ins->evex_tuple = st->evex_tuple;
+    for (i = 0; i < ins->operands; i++) {
+        operand *op = &ins->oprs[i];
+
+        op->type     = st->oprs[i].type;
+        op->eaflags  = st->oprs[i].eaflags;
+        op->indexreg = st->oprs[i].indexreg;
+        op->scale    = st->oprs[i].scale;
+        op->hintbase = st->oprs[i].hintbase;
+        op->hinttype = st->oprs[i].hinttype;
+    }
+
+    return st->length;
+}
+
+/*
+ * Compute the size of an instruction, using the encoding cache when
+ * possible.  Results are only cached if no diagnostics were issued,
+ * so that warnings held back until the final pass are not lost.
+ */
+static int64_t calcsize(int32_t segment, int64_t offset, int bits,
+                        insn *ins, const struct itemplate *temp)
+{
+    struct encode_cache_entry *ece;
+    struct encode_key key;
+    uint64_t errors;
+    int64_t length;
+
+    /* The size of RESx depends on the value of its operand */
+    if (resb_bytes(ins->opcode))
+        return do_calcsize(segment, offset, bits, ins, temp);
+
+    ece = &encode_cache[encode_key(&key, ins, temp, bits) &
+                        (ENCODE_CACHE_SIZE - 1)];
+    if (!memcmp(&ece->key, &key, sizeof key)) {
+        profile_count(PROF_ENCODE_HITS);
+        return encode_restore(&ece->state, ins);
+    }
+
+    profile_count(PROF_ENCODE_MISSES);
+    errors = nasm_error_count;
+    length = do_calcsize(segment, offset, bits, ins, temp);
+    if (length >= 0 && errors == nasm_error_count) {
+        ece->key = key;
+        encode_save(&ece->state, ins, length);
+    }
+
+    return length;
+}
+
 static inline void emit_rex(struct out_data *data, insn *ins)
 {
     if (data->bits == 64) {
@@ -2380,19 +2950,173 @@ static int op_evexflags(const operand * o, int mask, uint8_t byte)
     return evexflags(val, o->decoflags, mask, byte);
 }
 
-static enum match_result find_match(const struct itemplate **tempp,
-                                    insn *instruction,
-                                    int32_t segment, int64_t offset, int bits)
+/*
+ * Cache of the templates chosen for previously seen operand
+ * signatures.  The key covers everything matches() looks at, so an
+ * entry stays valid for the rest of the run.
+ */
+#define MATCH_CACHE_BITS    10
+#define MATCH_CACHE_SIZE    (1 << MATCH_CACHE_BITS)
+#define MATCH_KEY_WORDS     (2*MAX_OPERANDS + 2 + (sizeof(iflag_t)+7)/8)
+
+struct match_key {
+    uint64_t w[MATCH_KEY_WORDS];
+};
+
+static struct match_cache_entry {
+    struct match_key key;
+    const struct itemplate *temp;
+} match_cache[MATCH_CACHE_SIZE];
+
+static uint64_t match_key(struct match_key *key, const insn *instruction,
+                          int bits)
+{
+    uint64_t *w = key->w;
+    uint64_t hash = 0;
+    int i;
+
+    memset(key, 0, sizeof *key);
+    for (i = 0; i < instruction->operands; i++) {
+        w[i] = instruction->oprs[i].type;
+        w[MAX_OPERANDS+i] = instruction->oprs[i].decoflags;
+    }
+    w[2*MAX_OPERANDS] = (uint32_t)instruction->opcode |
+        ((uint64_t)(uint8_t)bits << 32) |
+        ((uint64_t)(uint8_t)instruction->operands << 40) |
+        ((uint64_t)(uint8_t)instruction->evex_brerop << 48);
+    w[2*MAX_OPERANDS+1] = (uint32_t)optimizing.level |
+        ((uint64_t)(uint16_t)instruction->prefixes[PPS_REX] << 32) |
+        ((uint64_t)(uint16_t)instruction->prefixes[PPS_REP] << 48);
+    memcpy(&w[2*MAX_OPERANDS+2], &cpu, sizeof cpu);
+
+    for (i = 0; i < (int)MATCH_KEY_WORDS; i++) {
+        hash = (hash ^ w[i]) * UINT64_C(0x9e3779b97f4a7c15);
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+/*
+ * The ITM_* flags of a template, as precomputed by insns.pl.  Define
+ * DEBUG_MATCH to derive them from the instruction flags at runtime
+ * instead, and check them against the generated ones.
+ */
+#ifdef DEBUG_MATCH
+static uint32_t template_mflags(const struct itemplate *itemp)
+{
+    static const unsigned int mflag_bits[][2] = {
+        { IF_SM, ITM_SM }, { IF_SM2, ITM_SM2 }, { IF_SX, ITM_SX },
+        { IF_OPT, ITM_OPT }, { IF_VEX, ITM_VEX }, { IF_EVEX, ITM_EVEX },
+        { IF_LONG, ITM_LONG }, { IF_NOLONG, ITM_NOLONG },
+        { IF_NOHLE, ITM_NOHLE }, { IF_BND, ITM_BND }
+    };
+    uint32_t mflags;
+    size_t i;
+
+    switch (itemp_smask(itemp)) {
+    case IF_GENBIT(IF_SB):
+        mflags = ITM_SB;
+        break;
+    case IF_GENBIT(IF_SW):
+        mflags = ITM_SW;
+        break;
+    case IF_GENBIT(IF_SD):
+        mflags = ITM_SD;
+        break;
+    case IF_GENBIT(IF_SQ):
+        mflags = ITM_SQ;
+        break;
+    case IF_GENBIT(IF_SO):
+        mflags = ITM_SO;
+        break;
+    case IF_GENBIT(IF_SY):
+        mflags = ITM_SY;
+        break;
+    case IF_GENBIT(IF_SZ):
+        mflags = ITM_SZ;
+        break;
+    case IF_GENBIT(IF_ANYSIZE):
+        mflags = ITM_ANYSIZE;
+        break;
+    case IF_GENBIT(IF_SIZE):
+        mflags = ITM_SIZE;
+        break;
+    default:
+        mflags = 0;
+        break;
+    }
+
+    if (itemp_armask(itemp))
+        mflags |= ITM_AR(itemp_arg(itemp));
+
+    for (i = 0; i < ARRAY_SIZE(mflag_bits); i++)
+        if (itemp_has(itemp, mflag_bits[i][0]))
+            mflags |= mflag_bits[i][1];
+
+    if ((itemp->code[0] & ~1) == 0370)
+        mflags |= ITM_JUMP;
+
+    nasm_assert(mflags == itemp->mflags);
+    return mflags;
+}
+#else
+static inline uint32_t template_mflags(const struct itemplate *itemp)
+{
+    return itemp->mflags;
+}
+#endif
+
+/*
+ * Quick check whether a template can possibly match the operands,
+ * based on the operand class and explicit size bits only.  A
+ * template rejected here would fail in matches() as well.
+ */
+static bool template_viable(const struct itemplate *temp,
+                            const opflags_t *type, const decoflags_t *deco)
 {
+    int i;
+
+    for (i = 0; i < temp->operands; i++) {
+        opflags_t tsize = temp->opd[i] & SIZE_MASK;
+        opflags_t isize = type[i] & SIZE_MASK;
+
+        if (temp->opd[i] & ~type[i] & ~(SIZE_MASK|REGSET_MASK))
+            return false;
+
+        if (tsize && isize && tsize != isize && !(deco[i] & BRDCAST_MASK))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Walk the templates for this opcode and operand count.  If "filter"
+ * is set, only the templates passing template_viable() are tried;
+ * this never changes which template matches, but it can change the
+ * error reported if there is no match.
+ */
+static enum match_result scan_templates(const struct itemplate **tempp,
+                                        insn *instruction,
+                                        int32_t segment, int64_t offset,
+                                        int bits, bool filter,
+                                        bool *cacheable)
+{
+    const struct itemplate * const *list;
     const struct itemplate *temp;
     enum match_result m, merr;
     opflags_t xsizeflags[MAX_OPERANDS];
+    opflags_t otype[MAX_OPERANDS];
+    decoflags_t odeco[MAX_OPERANDS];
     bool opsizemissing = false;
     int8_t broadcast = instruction->evex_brerop;
     int i;
 
     /* broadcasting uses a different data element size */
     for (i = 0; i < instruction->operands; i++) {
+        otype[i] = instruction->oprs[i].type;
+        odeco[i] = instruction->oprs[i].decoflags;
         if (i == broadcast)
             xsizeflags[i] = instruction->oprs[i].decoflags & BRSIZE_MASK;
         else
@@ -2400,16 +3124,26 @@ static enum match_result find_match(const struct itemplate **tempp,
     }
 
     merr = MERR_INVALOP;
+    temp = NULL;
 
-    for (temp = nasm_instructions[instruction->opcode];
-         temp->opcode != I_none; temp++) {
+    /*
+     * Templates with a different operand count always fail with
+     * MERR_INVALOP, so skipping them changes nothing.
+     */
+    list = nasm_insn_index[instruction->opcode][instruction->operands];
+
+    for (; (temp = *list); list++) {
+        if (filter && !template_viable(temp, otype, odeco))
+            continue;
         m = matches(temp, instruction, bits);
         if (m == MOK_JUMP) {
+            *cacheable = false;
             if (jmp_match(segment, offset, bits, instruction, temp))
                 m = MOK_GOOD;
             else
                 m = MERR_INVALOP;
-        } else if (m == MERR_OPSIZEMISSING && !itemp_has(temp, IF_SX)) {
+        } else if (m == MERR_OPSIZEMISSING &&
+                   !(template_mflags(temp) & ITM_SX)) {
             /*
              * Missing operand size and a candidate for fuzzy matching...
              */
@@ -2452,9 +3186,15 @@ static enum match_result find_match(const struct itemplate **tempp,
         }
     }
 
+    /* The sizes of the operands have been changed */
+    *cacheable = false;
+
     /* Try matching again... */
-    for (temp = nasm_instructions[instruction->opcode];
-         temp->opcode != I_none; temp++) {
+    list = nasm_insn_index[instruction->opcode][instruction->operands];
+
+    for (; (temp = *list); list++) {
+        if (filter && !template_viable(temp, otype, odeco))
+            continue;
         m = matches(temp, instruction, bits);
         if (m == MOK_JUMP) {
             if (jmp_match(segment, offset, bits, instruction, temp))
@@ -2469,10 +3209,51 @@ static enum match_result find_match(const struct itemplate **tempp,
     }
 
 done:
+    if (filter && merr != MOK_GOOD) {
+        /* Put back the operand sizes for a rescan */
+        for (i = 0; i < instruction->operands; i++) {
+            instruction->oprs[i].type = otype[i];
+            instruction->oprs[i].decoflags = odeco[i];
+        }
+    }
     *tempp = temp;
     return merr;
 }
 
+static enum match_result find_match(const struct itemplate **tempp,
+                                    insn *instruction,
+                                    int32_t segment, int64_t offset, int bits)
+{
+    struct match_cache_entry *mce;
+    struct match_key key;
+    enum match_result m;
+    bool cacheable = true;
+
+    mce = &match_cache[match_key(&key, instruction, bits) &
+                       (MATCH_CACHE_SIZE - 1)];
+    if (mce->temp && !memcmp(&mce->key, &key, sizeof key)) {
+        *tempp = mce->temp;
+        return MOK_GOOD;
+    }
+
+    m = scan_templates(tempp, instruction, segment, offset, bits,
+                       true, &cacheable);
+    if (m == MOK_GOOD) {
+        if (cacheable) {
+            mce->key  = key;
+            mce->temp = *tempp;
+        }
+        return m;
+    }
+
+    /*
+     * No match; rescan all the templates so the error reported is
+     * the same as it would be without the filter.
+     */
+    return scan_templates(tempp, instruction, segment, offset, bits,
+                          false, &cacheable);
+}
+
 static uint8_t get_broadcast_num(opflags_t opflags, opflags_t brsize)
 {
     unsigned int opsize = (opflags & SIZE_MASK) >> SIZE_SHIFT;
@@ -2495,6 +3276,7 @@ static enum match_result matches(const struct itemplate *itemp,
                                  insn *instruction, int bits)
 {
     opflags_t size[MAX_OPERANDS], asize;
+    uint32_t mflags = template_mflags(itemp);
     bool opsizemissing = false;
     int i, oprs;
 
@@ -2513,7 +3295,7 @@ static enum match_result matches(const struct itemplate *itemp,
     /*
      * Is it legal?
      */
-    if (!(optimizing.level > 0) && itemp_has(itemp, IF_OPT))
+    if (!(optimizing.level > 0) && (mflags & ITM_OPT))
 	return MERR_INVALOP;
 
     /*
@@ -2521,18 +3303,17 @@ static enum match_result matches(const struct itemplate *itemp,
      */
     switch (instruction->prefixes[PPS_REX]) {
     case P_EVEX:
-        if (!itemp_has(itemp, IF_EVEX))
+        if (!(mflags & ITM_EVEX))
             return MERR_ENCMISMATCH;
         break;
     case P_VEX:
     case P_VEX3:
     case P_VEX2:
-        if (!itemp_has(itemp, IF_VEX))
+        if (!(mflags & ITM_VEX))
             return MERR_ENCMISMATCH;
         break;
     case P_REX:
-        if (itemp_has(itemp, IF_VEX) || itemp_has(itemp, IF_EVEX) ||
-            bits != 64)
+        if ((mflags & (ITM_VEX|ITM_EVEX)) || bits != 64)
             return MERR_ENCMISMATCH;
         break;
     default:
@@ -2549,32 +3330,32 @@ static enum match_result matches(const struct itemplate *itemp,
     /*
      * Process size flags
      */
-    switch (itemp_smask(itemp)) {
-    case IF_GENBIT(IF_SB):
+    switch (mflags & ITM_SIZE_MASK) {
+    case ITM_SB:
         asize = BITS8;
         break;
-    case IF_GENBIT(IF_SW):
+    case ITM_SW:
         asize = BITS16;
         break;
-    case IF_GENBIT(IF_SD):
+    case ITM_SD:
         asize = BITS32;
         break;
-    case IF_GENBIT(IF_SQ):
+    case ITM_SQ:
         asize = BITS64;
         break;
-    case IF_GENBIT(IF_SO):
+    case ITM_SO:
         asize = BITS128;
         break;
-    case IF_GENBIT(IF_SY):
+    case ITM_SY:
         asize = BITS256;
         break;
-    case IF_GENBIT(IF_SZ):
+    case ITM_SZ:
         asize = BITS512;
         break;
-    case IF_GENBIT(IF_ANYSIZE):
+    case ITM_ANYSIZE:
         asize = SIZE_MASK;
         break;
-    case IF_GENBIT(IF_SIZE):
+    case ITM_SIZE:
         switch (bits) {
         case 16:
             asize = BITS16;
@@ -2595,9 +3376,9 @@ static enum match_result matches(const struct itemplate *itemp,
         break;
     }
 
-    if (itemp_armask(itemp)) {
+    if (mflags & ITM_AR_MASK) {
         /* S- flags only apply to a specific operand */
-        i = itemp_arg(itemp);
+        i = ((mflags & ITM_AR_MASK) >> ITM_AR_SHIFT) - 1;
         memset(size, 0, sizeof size);
         size[i] = asize;
     } else {
@@ -2707,8 +3488,8 @@ static enum match_result matches(const struct itemplate *itemp,
     /*
      * Check operand sizes
      */
-    if (itemp_has(itemp, IF_SM) || itemp_has(itemp, IF_SM2)) {
-        oprs = (itemp_has(itemp, IF_SM2) ? 2 : itemp->operands);
+    if (mflags & (ITM_SM|ITM_SM2)) {
+        oprs = ((mflags & ITM_SM2) ? 2 : itemp->operands);
         for (i = 0; i < oprs; i++) {
             asize = itemp->opd[i] & SIZE_MASK;
             if (asize) {
@@ -2736,13 +3517,13 @@ static enum match_result matches(const struct itemplate *itemp,
     /*
      * Verify the appropriate long mode flag.
      */
-    if (itemp_has(itemp, (bits == 64 ? IF_NOLONG : IF_LONG)))
+    if (mflags & (bits == 64 ? ITM_NOLONG : ITM_LONG))
         return MERR_BADMODE;
 
     /*
      * If we have a HLE prefix, look for the NOHLE flag
      */
-    if (itemp_has(itemp, IF_NOHLE) &&
+    if ((mflags & ITM_NOHLE) &&
         (has_prefix(instruction, PPS_REP, P_XACQUIRE) ||
          has_prefix(instruction, PPS_REP, P_XRELEASE)))
         return MERR_BADHLE;
@@ -2750,18 +3531,18 @@ static enum match_result matches(const struct itemplate *itemp,
     /*
      * Check if special handling needed for Jumps
      */
-    if ((itemp->code[0] & ~1) == 0370)
+    if (mflags & ITM_JUMP)
         return MOK_JUMP;
 
     /*
      * Check if BND prefix is allowed.
      * Other 0xF2 (REPNE/REPNZ) prefix is prohibited.
      */
-    if (!itemp_has(itemp, IF_BND) &&
+    if (!(mflags & ITM_BND) &&
         (has_prefix(instruction, PPS_REP, P_BND) ||
          has_prefix(instruction, PPS_REP, P_NOBND)))
         return MERR_BADBND;
-    else if (itemp_has(itemp, IF_BND) &&
+    else if ((mflags & ITM_BND) &&
              (has_prefix(instruction, PPS_REP, P_REPNE) ||
               has_prefix(instruction, PPS_REP, P_REPNZ)))
         return MERR_BADREPNE;
@@ -47,6 +47,7 @@ extern struct location absolute;
 
 int64_t insn_size(int32_t segment, int64_t offset, int bits, insn *instruction);
 int64_t assemble(int32_t segment, int64_t offset, int bits, insn *instruction);
+void assemble_cleanup(void);
 
 bool process_directives(char *);
 void process_pragma(char *);
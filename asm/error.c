@@ -143,6 +143,13 @@ void pop_warnings(void)
 /* Call after the command line is parsed, but before the first pass */
 void init_warnings(void)
 {
+	/* Drop anything left over from a previous run */
+	while (warning_stack) {
+		struct warning_stack *ws = warning_stack;
+		warning_stack = ws->next;
+		nasm_free(ws);
+	}
+
 	push_warnings();
 	warning_state_init = warning_stack;
 }
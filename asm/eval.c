@@ -71,6 +71,8 @@ static int *opflags;
 static struct eval_hints *hint;
 static int64_t deadman;
 
+uint64_t eval_context_refs;
+
 
 /*
  * Unimportant cleanup is done to avoid confusing people who are trying
@@ -81,6 +83,8 @@ void eval_cleanup(void)
     while (ntempexprs)
         nasm_free(tempexprs[--ntempexprs]);
     nasm_free(tempexprs);
+    tempexprs = NULL;
+    tempexprs_size = 0;
 }
 
 /*
@@ -900,6 +904,7 @@ static expr *expr6(void)
         return e;
 
     case TOKEN_FLOATIZE:
+        eval_context_refs++;
         return eval_floatize(tokval->t_integer);
 
     case TOKEN_STRFUNC:
@@ -945,6 +950,8 @@ static expr *expr6(void)
         case TOKEN_INSN:
         case TOKEN_HERE:
         case TOKEN_BASE:
+            eval_context_refs++;
+
             /*
              * If !location.known, this indicates that no
              * symbol, Here or Base references are valid because we
@@ -46,4 +46,11 @@ expr *evaluate(scanner sc, void *scprivate, struct tokenval *tv,
 
 void eval_cleanup(void);
 
+/*
+ * Incremented each time evaluate() uses a value which does not come
+ * from the expression text itself: a symbol, $, $$ or a floating-point
+ * conversion (which depends on the current FLOAT settings.)
+ */
+extern uint64_t eval_context_refs;
+
 #endif
@@ -43,6 +43,8 @@
 #include "error.h"
 #include "hashtbl.h"
 #include "labels.h"
+#include "profile.h"
+#include "relax.h"
 
 /*
  * A dot-local label is one that begins with exactly one period. Things
@@ -230,6 +232,7 @@ static union label *find_label(const char *label, bool create, bool *created)
     struct hash_insert ip;
 
     nasm_assert(label != NULL);
+    profile_count(PROF_LABEL_LOOKUPS);
 
     if (islocal(label))
         label = label_str = nasm_strcat(prevlabel, label);
@@ -552,6 +555,9 @@ void define_label(const char *label, int32_t segment,
                    "label `%s' %s during code generation",
                    lptr->defn.label, created ? "defined" : "changed");
     }
+    relax_label(lptr, segment, offset, lastdef && lastdef != lpass,
+                lptr->defn.segment, lptr->defn.offset);
+
     lptr->defn.segment = segment;
     lptr->defn.offset  = offset;
     lptr->defn.size    = size;
@@ -564,6 +570,14 @@ void define_label(const char *label, int32_t segment,
         out_symdef(lptr);
 }
 
+/*
+ * Move a label to the offset predicted by the relaxation engine.
+ */
+void set_label_offset(union label *lptr, int64_t offset)
+{
+    lptr->defn.offset = offset;
+}
+
 /*
  * Define a special backend label
  */
@@ -577,6 +591,14 @@ void backend_label(const char *label, int32_t segment, int64_t offset)
 
 int init_labels(void)
 {
+    size_t i;
+
+    /* The mangling strings of a previous run were freed with it */
+    for (i = 0; i < ARRAY_SIZE(mangle_strings); i++) {
+        mangle_strings[i] = "";
+        mangle_string_set[i] = false;
+    }
+
     ldata = lfree = nasm_malloc(LBLK_SIZE);
     init_block(lfree);
 
@@ -598,6 +620,9 @@ void cleanup_labels(void)
 {
     union label *lptr, *lhold;
 
+    if (!initialized)
+        return;
+
     initialized = false;
 
     hash_free(&ltab);
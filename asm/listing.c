@@ -259,6 +259,9 @@ static void list_output(const struct out_data *data)
     case OUT_RELADDR:
 	list_address(offset, "()", data->toffset, size);
 	break;
+    case OUT_FILEDATA:
+        list_size(offset, "bin", size);
+        break;
     case OUT_RESERVE:
     {
         if (size > 8) {
@@ -37,6 +37,7 @@
 
 #include "compiler.h"
 
+#include <setjmp.h>
 
 #include "nasm.h"
 #include "nasmlib.h"
@@ -52,6 +53,10 @@
 #include "eval.h"
 #include "assemble.h"
 #include "labels.h"
+#include "relax.h"
+#include "profile.h"
+#include "objcache.h"
+#include "filecache.h"
 #include "outform.h"
 #include "listing.h"
 #include "iflag.h"
@@ -89,6 +94,8 @@ static const struct error_format errfmt_msvc = { "(", ")", " : " };
 static const struct error_format *errfmt = &errfmt_gnu;
 static struct strlist *warn_list;
 static struct nasm_errhold *errhold_stack;
+uint64_t nasm_error_count;
+static uint64_t messages_printed;
 
 unsigned int debug_nasm;        /* Debugging messages? */
 
@@ -117,6 +124,17 @@ const char *inname;
 const char *outname;
 static const char *listname;
 static const char *errname;
+static const char *profname;
+static const char *snapname;
+
+/* Input files and their output files, if more than one input is given */
+struct input_file {
+    const char *inname;
+    const char *outname;
+};
+static struct input_file *inputs;
+static size_t ninputs;
+static unsigned int njobs = 1;  /* Number of parallel workers (-j) */
 
 static int64_t globallineno;    /* for forward-reference tracking */
 
@@ -157,11 +175,22 @@ static bool depend_emit_phony = false;
 static bool depend_missing_ok = false;
 static const char *depend_target = NULL;
 static const char *depend_file = NULL;
+static const char *depend_file_opt; /* The option which gave depend_file */
 struct strlist *depend_list;
 
 static bool want_usage;
 static bool terminate_after_phase;
 bool user_nolist = false;
+static bool stopoptions = false;
+
+static bool server_mode;        /* Running jobs for clients (--server) */
+
+/*
+ * Where a job run by the server goes when it ends early; the exit
+ * status is left in job_status.
+ */
+static jmp_buf *job_exit;
+static int job_status;
 
 static char *quote_for_pmake(const char *str);
 static char *quote_for_wmake(const char *str);
@@ -515,81 +544,16 @@ static void timestamp(void)
     }
 }
 
-int main(int argc, char **argv)
+/*
+ * Preprocess and/or assemble the current input file, inname
+ */
+static void process_input(void)
 {
-    /* Do these as early as possible */
-    error_file = stderr;
-    _progname = argv[0];
-    if (!_progname || !_progname[0])
-        _progname = "nasm";
-
-    timestamp();
-
-    iflag_set_default_cpu(&cpu);
-    iflag_set_default_cpu(&cmd_cpu);
-
-    set_default_limits();
-
-    include_path = strlist_alloc(true);
+    struct strlist *misses;
+    bool use_cache;
 
-    _pass_type = PASS_INIT;
-    _passn = 0;
-
-    want_usage = terminate_after_phase = false;
-
-    nasm_ctype_init();
-    src_init();
-
-    /*
-     * We must call init_labels() before the command line parsing,
-     * because we may be setting prefixes/suffixes from the command
-     * line.
-     */
-    init_labels();
-
-    offsets = raa_init();
-    forwrefs = saa_init((int32_t)sizeof(struct forwrefinfo));
-
-    operating_mode = OP_NORMAL;
-
-    parse_cmdline(argc, argv, 1);
-    if (terminate_after_phase) {
-        if (want_usage)
-            usage();
-        return 1;
-    }
-
-    /* At this point we have ofmt and the name of the desired debug format */
-    if (!using_debug_info) {
-        /* No debug info, redirect to the null backend (empty stubs) */
-        dfmt = &null_debug_form;
-    } else if (!debug_format) {
-        /* Default debug format for this backend */
-        dfmt = ofmt->default_dfmt;
-    } else {
-        dfmt = dfmt_find(ofmt, debug_format);
-        if (!dfmt) {
-            nasm_fatalf(ERR_USAGE, "unrecognized debug format `%s' for output format `%s'",
-                       debug_format, ofmt->shortname);
-        }
-    }
-
-    /* Have we enabled TASM mode? */
-    if (tasm_compatible_mode) {
-        ppopt |= PP_TASM;
-        nasm_ctype_tasm_mode();
-    }
-    preproc_init(include_path);
-
-    parse_cmdline(argc, argv, 2);
-    if (terminate_after_phase) {
-        if (want_usage)
-            usage();
-        return 1;
-    }
-
-    /* Save away the default state of warnings */
-    init_warnings();
+    if (ppopt & PP_RESIDENT)
+        file_cache_new_session();
 
     /* Dependency filename if we are also doing other things */
     if (!depend_file && (operating_mode & ~OP_DEPEND)) {
@@ -612,7 +576,19 @@ int main(int argc, char **argv)
         }
     }
 
-    depend_list = (operating_mode & OP_DEPEND) ? strlist_alloc(true) : NULL;
+    /*
+     * The object cache needs the list of files read, even if no
+     * dependencies are to be generated.
+     */
+    use_cache = objcache_enabled() && (operating_mode & OP_NORMAL) &&
+        !listname;
+    depend_list = ((operating_mode & OP_DEPEND) || use_cache) ?
+        strlist_alloc(true) : NULL;
+    misses = use_cache ? strlist_alloc(true) : NULL;
+    pp_search_misses(misses);
+
+    /* A listing would miss everything a snapshot stands in for */
+    pp_snapshot((operating_mode & OP_NORMAL) && !listname ? snapname : NULL);
 
     if (!depend_target)
         depend_target = quote_for_make(outname);
@@ -706,7 +682,11 @@ int main(int argc, char **argv)
             ofile = NULL;
     }
 
-    if (operating_mode & OP_NORMAL) {
+    if (use_cache && objcache_fetch(inname, outname, depend_list)) {
+        /* The output file has been copied from the cache */
+    } else if (operating_mode & OP_NORMAL) {
+        uint64_t messages = messages_printed;
+
         ofile = nasm_open_write(outname, (ofmt->flags & OFMT_TEXT) ? NF_TEXT : NF_BINARY);
         if (!ofile)
             nasm_fatal("unable to open output file `%s'", outname);
@@ -717,7 +697,9 @@ int main(int argc, char **argv)
         assemble_file(inname, depend_list);
 
         if (!terminate_after_phase) {
+            uint64_t ptime = profile_start();
             ofmt->cleanup();
+            profile_stop(PROF_OUTPUT, ptime);
             cleanup_labels();
             fflush(ofile);
             if (ferror(ofile))
@@ -730,16 +712,99 @@ int main(int argc, char **argv)
                 remove(outname);
             ofile = NULL;
         }
+
+        /* Don't cache anything which would not be silent next time */
+        if (use_cache && !terminate_after_phase &&
+            messages == messages_printed)
+            objcache_store(inname, outname, depend_list, misses);
     }
 
     pp_cleanup_session();
+    if (!(ppopt & PP_RESIDENT))
+        file_cache_free();  /* Kept for the next job of a server */
+    strlist_free(&misses);
 
-    if (depend_list && !terminate_after_phase)
+    if (!(operating_mode & OP_DEPEND))
+        strlist_free(&depend_list);
+    else if (depend_list && !terminate_after_phase)
         emit_dependencies(depend_list);
+}
 
-    if (want_usage)
-        usage();
+/*
+ * Worker for assembling one of several input files.  Messages for a
+ * file given with -Z are collected in err as well, so they can be
+ * copied out in order.
+ */
+static int assemble_input(size_t i, FILE *err)
+{
+    /* Worker processes must never return to the server loop */
+    job_exit = NULL;
+
+    if (error_file != stdout && error_file != stderr)
+        error_file = err;
+
+    inname  = inputs[i].inname;
+    outname = inputs[i].outname;
+    process_input();
+
+    return terminate_after_phase;
+}
+
+static void assemble_inputs(void)
+{
+    if (!nasm_run_workers(ninputs, njobs, assemble_input, error_file))
+        terminate_after_phase = true;
+}
 
+/*
+ * Reset everything the command line can change to its default, for
+ * the jobs run by a server.
+ */
+static void reset_options(void)
+{
+    error_file = stderr;
+    errfmt = &errfmt_gnu;
+    debug_nasm = 0;
+    using_debug_info = opt_verbose_info = false;
+    debug_format = NULL;
+    abort_on_panic = ABORT_ON_PANIC;
+    keep_all = false;
+    tasm_compatible_mode = false;
+    globalrel = globalbnd = 0;
+    inname = outname = NULL;
+    listname = errname = profname = snapname = NULL;
+    inputs = NULL;
+    ninputs = 0;
+    njobs = 1;
+    globallineno = 0;
+    ofmt = &OF_DEFAULT;
+    ofmt_alias = NULL;
+    dfmt = NULL;
+    optimizing.level = MAX_OPTIMIZE;
+    optimizing.flag = OPTIM_ALL_ENABLED;
+    cmd_sb = 16;
+    ppopt = server_mode ? PP_RESIDENT : 0;
+    depend_emit_phony = depend_missing_ok = false;
+    depend_target = depend_file = NULL;
+    depend_list = NULL;
+    user_nolist = false;
+    quote_for_make = quote_for_pmake;
+    stopoptions = false;
+    list_options = 0;
+    reproducible = false;
+    objcache_init(NULL);
+    profile_reset();
+    seg_alloc_reset();
+}
+
+/*
+ * Free what a job has allocated for itself.
+ */
+static void free_job_state(void)
+{
+    size_t i;
+
+    cleanup_labels();
     raa_free(offsets);
     saa_free(forwrefs);
     eval_cleanup();
@@ -747,9 +812,175 @@ int main(int argc, char **argv)
     src_free();
     strlist_free(&include_path);
 
+    for (i = 0; i < ninputs; i++) {
+        nasm_free((char *)inputs[i].inname);
+        nasm_free((char *)inputs[i].outname);
+    }
+    nasm_free(inputs);
+    inputs = NULL;
+    ninputs = 0;
+
+    if (error_file != stdout && error_file != stderr) {
+        fclose(error_file);
+        error_file = stderr;
+    }
+}
+
+/*
+ * Run NASM once with the given command line.
+ */
+static int nasm_job(int argc, char **argv)
+{
+    uint64_t start_time = 0;
+
+    reset_options();
+    timestamp();
+
+    iflag_set_default_cpu(&cpu);
+    iflag_set_default_cpu(&cmd_cpu);
+
+    set_default_limits();
+
+    include_path = strlist_alloc(true);
+
+    _pass_type = PASS_INIT;
+    _passn = 0;
+
+    want_usage = terminate_after_phase = false;
+
+    /*
+     * We must call init_labels() before the command line parsing,
+     * because we may be setting prefixes/suffixes from the command
+     * line.
+     */
+    init_labels();
+
+    offsets = raa_init();
+    forwrefs = saa_init((int32_t)sizeof(struct forwrefinfo));
+
+    operating_mode = OP_NORMAL;
+
+    parse_cmdline(argc, argv, 1);
+    if (terminate_after_phase)
+        goto done;
+
+    profiling = !!profname;
+    start_time = profile_start();
+
+    /* At this point we have ofmt and the name of the desired debug format */
+    if (!using_debug_info) {
+        /* No debug info, redirect to the null backend (empty stubs) */
+        dfmt = &null_debug_form;
+    } else if (!debug_format) {
+        /* Default debug format for this backend */
+        dfmt = ofmt->default_dfmt;
+    } else {
+        dfmt = dfmt_find(ofmt, debug_format);
+        if (!dfmt) {
+            nasm_fatalf(ERR_USAGE, "unrecognized debug format `%s' for output format `%s'",
+                       debug_format, ofmt->shortname);
+        }
+    }
+
+    /* Have we enabled TASM mode? */
+    if (tasm_compatible_mode) {
+        ppopt |= PP_TASM;
+        nasm_ctype_tasm_mode();
+    }
+    preproc_init(include_path);
+
+    parse_cmdline(argc, argv, 2);
+    if (terminate_after_phase)
+        goto done;
+
+    /* Save away the default state of warnings */
+    init_warnings();
+
+    if (ninputs > 1)
+        assemble_inputs();
+    else
+        process_input();
+
+    if (profname)
+        profile_write(profname, inname, start_time);
+
+done:
+    if (want_usage)
+        usage();
+
+    free_job_state();
+
     return terminate_after_phase;
 }
 
+static no_return nasm_exit(int status)
+{
+    if (job_exit) {
+        job_status = status;
+        longjmp(*job_exit, 1);
+    }
+    exit(status);
+}
+
+/*
+ * Run a job for the server.  A job which ends early, or with errors,
+ * may leave state behind which nothing cleans up, so the server
+ * starts over after such a job.
+ */
+static int serve_job(int argc, char **argv, bool *restart)
+{
+    const char *progname = _progname;
+    jmp_buf env;
+
+    _progname = argv[0];
+    if (setjmp(env)) {
+        *restart = true;
+    } else {
+        job_exit = &env;
+        job_status = nasm_job(argc, argv);
+        *restart = job_status != 0;
+    }
+
+    job_exit = NULL;
+    _progname = progname;
+    return job_status;
+}
+
+int main(int argc, char **argv)
+{
+    /* Do these as early as possible */
+    error_file = stderr;
+    _progname = argv[0];
+    if (!_progname || !_progname[0])
+        _progname = "nasm";
+
+    nasm_ctype_init();
+    src_init();
+
+    /*
+     * --server and --client have to come first, and take over the
+     * whole command line.
+     */
+    if (argc > 1 && !strcmp(argv[1], "--server")) {
+        if (argc != 3)
+            nasm_fatalf(ERR_USAGE, "usage: %s --server socket", _progname);
+        server_mode = true;
+        nasm_serve(argv[2], serve_job);
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "--client")) {
+        const char *path;
+
+        if (argc < 3)
+            nasm_fatalf(ERR_USAGE, "option `--client' requires an argument");
+        path = argv[2];
+        argv[2] = argv[0];
+        return nasm_client(path, argc - 2, argv + 2);
+    }
+
+    return nasm_job(argc, argv);
+}
+
 /*
  * Get a parameter for a command line option.
  * First arg must be in the form of e.g. -f...
@@ -941,8 +1172,12 @@ enum text_options {
     OPT_LIMIT,
     OPT_KEEP_ALL,
     OPT_NO_LINE,
+    OPT_NO_PP_CACHE,
     OPT_DEBUG,
-    OPT_REPRODUCIBLE
+    OPT_REPRODUCIBLE,
+    OPT_PROFILE,
+    OPT_CACHE_DIR,
+    OPT_PP_SNAPSHOT
 };
 enum need_arg {
     ARG_NO,
@@ -973,8 +1208,12 @@ static const struct textargs textopts[] = {
     {"limit-",   OPT_LIMIT,   ARG_YES, 0},
     {"keep-all", OPT_KEEP_ALL, ARG_NO, 0},
     {"no-line",  OPT_NO_LINE, ARG_NO, 0},
+    {"no-pp-cache", OPT_NO_PP_CACHE, ARG_NO, 0},
     {"debug",    OPT_DEBUG, ARG_MAYBE, 0},
     {"reproducible", OPT_REPRODUCIBLE, ARG_NO, 0},
+    {"profile",  OPT_PROFILE, ARG_YES, 0},
+    {"cache-dir", OPT_CACHE_DIR, ARG_YES, 0},
+    {"pp-snapshot", OPT_PP_SNAPSHOT, ARG_YES, 0},
     {NULL, OPT_BOGUS, ARG_NO, 0}
 };
 
@@ -982,10 +1221,9 @@ static void show_version(void)
 {
     printf("NASM version %s compiled on %s%s\n",
            nasm_version, nasm_date, nasm_compile_options);
-    exit(0);
+    nasm_exit(0);
 }
 
-static bool stopoptions = false;
 static bool process_arg(char *p, char *q, int pass)
 {
     char *param;
@@ -995,7 +1233,7 @@ static bool process_arg(char *p, char *q, int pass)
         return false;
 
     if (p[0] == '-' && !stopoptions) {
-        if (strchr("oOfpPdDiIlLFXuUZwW", p[1])) {
+        if (strchr("oOfpPdDiIjlLFXuUZwW", p[1])) {
             /* These parameters take values */
             if (!(param = get_param(p, q, &advance)))
                 return advance;
@@ -1008,8 +1246,25 @@ static bool process_arg(char *p, char *q, int pass)
             break;
 
         case 'o':       /* output file */
-            if (pass == 2)
-                copy_filename(&outname, param, "output");
+            if (pass == 2) {
+                /* Applies to the preceding input file, if any */
+                if (ninputs)
+                    copy_filename(&inputs[ninputs-1].outname, param, "output");
+                else
+                    copy_filename(&outname, param, "output");
+            }
+            break;
+
+        case 'j':       /* parallel jobs */
+            if (pass == 1) {
+                char *ep;
+                unsigned long n = strtoul(param, &ep, 10);
+
+                if (*ep || !n || n > 1024)
+                    nasm_nonfatalf(ERR_USAGE, "invalid number of jobs `%s'", param);
+                else
+                    njobs = n;
+            }
             break;
 
         case 'f':       /* output format */
@@ -1135,13 +1390,13 @@ static bool process_arg(char *p, char *q, int pass)
 
         case 'h':
             help(stdout);
-            exit(0);    /* never need usage message here */
+            nasm_exit(0);    /* never need usage message here */
             break;
 
         case 'y':
             /* legacy option */
             dfmt_list(stdout);
-            exit(0);
+            nasm_exit(0);
             break;
 
         case 't':
@@ -1201,11 +1456,13 @@ static bool process_arg(char *p, char *q, int pass)
                     operating_mode |= OP_DEPEND;
                     if (q && (q[0] != '-' || q[1] == '\0')) {
                         depend_file = q;
+                        depend_file_opt = "-MD";
                         advance = true;
                     }
                     break;
                 case 'F':
                     depend_file = q;
+                    depend_file_opt = "-MF";
                     advance = true;
                     break;
                 case 'T':
@@ -1332,15 +1589,30 @@ static bool process_arg(char *p, char *q, int pass)
                 case OPT_NO_LINE:
                     ppopt |= PP_NOLINE;
                     break;
+                case OPT_NO_PP_CACHE:
+                    ppopt |= PP_NOCACHE;
+                    break;
                 case OPT_DEBUG:
                     debug_nasm = param ? strtoul(param, NULL, 10) : debug_nasm+1;
                     break;
                 case OPT_REPRODUCIBLE:
                     reproducible = true;
                     break;
+                case OPT_PROFILE:
+                    if (pass == 1)
+                        copy_filename(&profname, param, "profile");
+                    break;
+                case OPT_CACHE_DIR:
+                    if (pass == 1)
+                        objcache_init(param);
+                    break;
+                case OPT_PP_SNAPSHOT:
+                    if (pass == 1)
+                        copy_filename(&snapname, param, "preprocessor snapshot");
+                    break;
                 case OPT_HELP:
                     help(stdout);
-                    exit(0);
+                    nasm_exit(0);
                 default:
                     panic();
                 }
@@ -1355,9 +1627,15 @@ static bool process_arg(char *p, char *q, int pass)
             nasm_nonfatalf(ERR_USAGE, "unrecognised option `-%c'", p[1]);
             break;
         }
+
+        /* All options but the output file name affect cached output */
+        if (pass == 2 && p[1] != 'o' && p[1] != 'j')
+            objcache_option(p, advance ? q : NULL);
     } else if (pass == 2) {
-        /* In theory we could allow multiple input files... */
-        copy_filename(&inname, p, "input");
+        inputs = nasm_realloc(inputs, (ninputs+1) * sizeof *inputs);
+        inputs[ninputs].inname  = nasm_strdup(p);
+        inputs[ninputs].outname = NULL;
+        ninputs++;
     }
 
     return advance;
@@ -1457,7 +1735,7 @@ static void process_response_file(const char *file, int pass)
     FILE *f = nasm_open_read(file, NF_TEXT);
     if (!f) {
         perror(file);
-        exit(-1);
+        nasm_exit(-1);
     }
     while (fgets(str, sizeof str, f)) {
         process_args(str, pass);
@@ -1469,6 +1747,7 @@ static void parse_cmdline(int argc, char **argv, int pass)
 {
     FILE *rfile;
     char *envreal, *envcopy = NULL, *p;
+    size_t i;
 
     /*
      * Initialize all the warnings to their default state, including
@@ -1527,13 +1806,48 @@ static void parse_cmdline(int argc, char **argv, int pass)
     if (pass != 2)
         return;
 
-    if (!inname)
+    if (!ninputs)
         nasm_fatalf(ERR_USAGE, "no input file specified");
-    else if ((errname && !strcmp(inname, errname)) ||
-             (outname && !strcmp(inname, outname)) ||
-             (listname &&  !strcmp(inname, listname))  ||
-             (depend_file && !strcmp(inname, depend_file)))
-        nasm_fatalf(ERR_USAGE, "will not overwrite input file");
+
+    /* An output file given before any input belongs to the first one */
+    if (outname) {
+        if (inputs[0].outname)
+            nasm_fatal("more than one output file specified: %s\n",
+                       inputs[0].outname);
+        inputs[0].outname = outname;
+    }
+
+    if (ninputs > 1) {
+        const char *opt = NULL;
+
+        if (listname)
+            opt = "-l";
+        else if (depend_file)
+            opt = depend_file_opt;
+        else if (depend_target)
+            opt = "-MT/-MQ";
+        else if (profname)
+            opt = "--profile";
+
+        if (opt)
+            nasm_fatalf(ERR_USAGE, "option `%s' cannot be used with more "
+                        "than one input file", opt);
+    }
+
+    for (i = 0; i < ninputs; i++) {
+        const char *in  = inputs[i].inname;
+        const char *out = inputs[i].outname;
+
+        if ((errname && !strcmp(in, errname)) ||
+            (out && !strcmp(in, out)) ||
+            (listname &&  !strcmp(in, listname))  ||
+            (snapname && !strcmp(in, snapname)) ||
+            (depend_file && !strcmp(in, depend_file)))
+            nasm_fatalf(ERR_USAGE, "will not overwrite input file");
+    }
+
+    inname  = inputs[0].inname;
+    outname = inputs[0].outname;
 
     if (errname) {
         error_file = nasm_open_write(errname, NF_TEXT);
@@ -1627,11 +1941,24 @@ static void process_insn(insn *instruction)
     }
 }
 
+/*
+ * Fetch the next line from the preprocessor
+ */
+static char *get_line(void)
+{
+    uint64_t ptime = profile_start();
+    char *line = pp_getline();
+
+    profile_stop(PROF_PREPROC, ptime);
+    return line;
+}
+
 static void assemble_file(const char *fname, struct strlist *depend_list)
 {
     char *line;
     insn output_ins;
     uint64_t prev_offset_changed;
+    uint64_t pass_start, ptime;
     int64_t stall_count = 0; /* Make sure we make forward progress... */
 
     switch (cmd_sb) {
@@ -1673,6 +2000,7 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         }
 
         global_offset_changed = 0;
+        pass_start = profile_start();
 
 	/*
 	 * Create a warning buffer list unless we are in
@@ -1715,14 +2043,16 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
             location.known = true;
         ofmt->reset();
         switch_segment(ofmt->section(NULL, &globalbits));
-        pp_reset(fname, PP_NORMAL, pass_final() ? depend_list : NULL);
+        relax_reset();
+        pp_reset(fname, PP_NORMAL, depend_list);
 
         globallineno = 0;
 
-        while ((line = pp_getline())) {
+        while ((line = get_line())) {
             if (++globallineno > nasm_limit[LIMIT_LINES])
                 nasm_fatal("overall line count exceeds the maximum %"PRId64"\n",
                            nasm_limit[LIMIT_LINES]);
+            profile_count(PROF_LINES);
 
             /*
              * Here we parse our directives; this is not handled by the
@@ -1732,7 +2062,9 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
                 goto end_of_line; /* Just do final cleanup */
 
             /* Not a directive, or even something that starts with [ */
-            parse_line(line, &output_ins);
+            ptime = profile_start();
+            parse_line(line, &output_ins, globallineno);
+            profile_stop(PROF_PARSE, ptime);
             forward_refs(&output_ins);
             process_insn(&output_ins);
             cleanup_insn(&output_ins);
@@ -1746,6 +2078,9 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         /* We better not be having an error hold still... */
         nasm_assert(!errhold_stack);
 
+        if (global_offset_changed && !terminate_after_phase)
+            relax_solve();
+
         if (global_offset_changed) {
             switch (pass_type()) {
             case PASS_OPT:
@@ -1797,8 +2132,13 @@ static void assemble_file(const char *fname, struct strlist *depend_list)
         }
 
         reset_warnings();
+        profile_pass(_passn, pass_type_name(), pass_start);
     }
 
+    relax_cleanup();
+    parser_cleanup();
+    assemble_cleanup();
+
     if (opt_verbose_info && pass_final()) {
         /*  -On and -Ov switches */
         nasm_info("assembly required 1+%"PRId64"+2 passes\n", pass_count()-3);
@@ -1935,7 +2275,7 @@ static fatal_func die_hard(errflags true_type, errflags severity)
         usage();
 
     /* Terminate immediately */
-    exit(true_type - ERR_FATAL + 1);
+    nasm_exit(true_type - ERR_FATAL + 1);
 }
 
 /*
@@ -2080,6 +2420,8 @@ void nasm_verror(errflags severity, const char *fmt, va_list args)
     struct nasm_errtext *et;
     errflags true_type = true_error_type(severity);
 
+    nasm_error_count++;
+
     if (true_type >= ERR_CRITICAL)
         nasm_verror_critical(severity, fmt, args);
 
@@ -2174,6 +2516,7 @@ static void nasm_issue_error(struct nasm_errtext *et)
             fprintf(error_file, "%s%s%s%s%s%s%s\n",
                     file, linestr, errfmt->beforemsg,
                     pfx, et->msg, here, warnsuf);
+            messages_printed++;
         }
     }
 
@@ -2221,7 +2564,7 @@ static void help(FILE *out)
     int i;
 
     fprintf(out,
-            "Usage: %s [-@ response_file] [options...] [--] filename\n"
+            "Usage: %s [-@ response_file] [options...] [--] filename...\n"
             "       %s -v (or --v)\n",
             _progname, _progname);
     fputs(
@@ -2232,7 +2575,9 @@ static void help(FILE *out)
         "    -v (or --v)   print the NASM version number and exit\n"
         "    -@ file       response file; one command line option per line\n"
         "\n"
-        "    -o outfile    write output to outfile\n"
+        "    -o outfile    write output to outfile; after an input file name,\n"
+        "                  applies to that input file\n"
+        "    -j n          assemble up to n input files in parallel [1]\n"
         "    --keep-all    output files will not be removed even if an error happens\n"
         "\n"
         "    -Xformat      specifiy error reporting format (gnu or vc)\n"
@@ -2287,6 +2632,7 @@ static void help(FILE *out)
         "   --pragma str   pre-executes a specific %%pragma\n"
         "   --before str   add line (usually a preprocessor statement) before the input\n"
         "   --no-line      ignore %line directives in input\n"
+        "   --no-pp-cache  run the preprocessor again on every pass\n"
         "\n"
         "   --prefix str   prepend the given string to the names of all extern,\n"
         "                  common and global symbols (also --gprefix)\n"
@@ -2296,6 +2642,15 @@ static void help(FILE *out)
         "   --lpostfix str append the given string to local symbols\n"
         "\n"
         "   --reproducible attempt to produce run-to-run identical output\n"
+        "   --profile file write timings and event counts to a file (JSON)\n"
+        "   --cache-dir dir reuse output files cached in dir\n"
+        "   --pp-snapshot file\n"
+        "                  save the preprocessor state after the predefinitions\n"
+        "                  and pre-included files in file, and reuse it\n"
+        "\n"
+        "   --server sock  stay resident and run jobs sent with --client\n"
+        "   --client sock options... filenames...\n"
+        "                  have the server listening on sock assemble the files\n"
         "\n"
         "    -w+x          enable warning x (also -Wx)\n"
         "    -w-x          disable warning x (also -Wno-x)\n"
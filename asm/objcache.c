@@ -0,0 +1,307 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * objcache.c  cache of assembled output files
+ *
+ * An entry is keyed on the NASM version, the command line options
+ * other than the input and output file names, the input and output
+ * file names themselves and the current directory.  It consists of
+ * the output file and a manifest listing every file the preprocessor
+ * read (the same list as used for -M) with the MD5 sum of its
+ * contents, and every name tried before the one found when searching
+ * the include path.  The entry is used only if all those files are
+ * unchanged, and none of the names tried has appeared since.
+ *
+ * Output which depends on the date, the time or the environment, as
+ * reported by the preprocessor, is never cached.
+ */
+
+#include "compiler.h"
+
+#include "nasm.h"
+#include "nasmlib.h"
+#include "error.h"
+#include "md5.h"
+#include "filecache.h"
+#include "ver.h"
+#include "objcache.h"
+
+#define MANIFEST_MAGIC "nasm-objcache 1"
+
+static const char *cache_dir;
+static MD5_CTX options;
+
+void objcache_init(const char *dir)
+{
+    nasm_free((char *)cache_dir);
+    cache_dir = dir ? nasm_strdup(dir) : NULL;
+    MD5Init(&options);
+    MD5Update(&options, (const unsigned char *)nasm_version,
+              strlen(nasm_version)+1);
+}
+
+bool objcache_enabled(void)
+{
+    return cache_dir != NULL;
+}
+
+/*
+ * Add a command line option, and its separate argument if any, to the
+ * key.  Options are added in the order given, which is conservative.
+ */
+void objcache_option(const char *opt, const char *arg)
+{
+    if (!cache_dir)
+        return;
+
+    MD5Update(&options, (const unsigned char *)opt, strlen(opt)+1);
+    if (arg)
+        MD5Update(&options, (const unsigned char *)arg, strlen(arg)+1);
+}
+
+static void md5_hex(char *hex, const unsigned char sum[MD5_HASHBYTES])
+{
+    int i;
+
+    for (i = 0; i < MD5_HASHBYTES; i++)
+        sprintf(hex + 2*i, "%02x", sum[i]);
+}
+
+/*
+ * The file name prefix of the cache entry for this input and output
+ */
+static char *entry_name(const char *inname, const char *outname)
+{
+    MD5_CTX ctx = options;
+    unsigned char sum[MD5_HASHBYTES];
+    char hex[2*MD5_HASHBYTES+1];
+    char *cwd = nasm_realpath(".");
+
+    MD5Update(&ctx, (const unsigned char *)inname, strlen(inname)+1);
+    MD5Update(&ctx, (const unsigned char *)outname, strlen(outname)+1);
+    MD5Update(&ctx, (const unsigned char *)cwd, strlen(cwd)+1);
+    MD5Final(sum, &ctx);
+    nasm_free(cwd);
+
+    md5_hex(hex, sum);
+    return nasm_strcatn(cache_dir, "/", hex, NULL);
+}
+
+/*
+ * Compute the hex MD5 sum of a file, or "-" if it does not exist.
+ * Returns false if the file cannot be checked.
+ */
+static bool hash_file(const char *path, char *hex)
+{
+    const struct cached_file *cf = file_cache_get(path, NULL);
+
+    if (!cf) {
+        /* Something which is not a plain file cannot be checked */
+        strcpy(hex, "-");
+        return !nasm_file_exists(path);
+    }
+
+    md5_hex(hex, cf->md5);
+    return true;
+}
+
+/* Copy a file to out, which is closed */
+static bool copy_file(const char *from, FILE *out)
+{
+    char buf[BUFSIZ];
+    FILE *in;
+    size_t n;
+    bool ok;
+
+    in = nasm_open_read(from, NF_BINARY);
+    if (!in) {
+        fclose(out);
+        return false;
+    }
+
+    while ((n = fread(buf, 1, sizeof buf, in)))
+        fwrite(buf, 1, n, out);
+
+    ok = !ferror(in) && !ferror(out);
+    fclose(in);
+    if (fclose(out))
+        ok = false;
+
+    return ok;
+}
+
+/*
+ * The manifest has a line "<sum> <path>" for each file the output
+ * depends on, with the sum as from hash_file(), and "! <path>" for
+ * each name tried in the include path which must still not exist.
+ */
+#define MISSING_MARK "!"
+
+/*
+ * If there is a valid cache entry, copy the cached output file to
+ * outname, add the files it depends on to deps and return true.
+ */
+bool objcache_fetch(const char *inname, const char *outname,
+                    struct strlist *deps)
+{
+    char *entry, *mname, *oname;
+    char line[FILENAME_MAX + 2*MD5_HASHBYTES + 8];
+    char hex[2*MD5_HASHBYTES+1];
+    bool ok = false;
+    FILE *mf, *of;
+
+    if (!cache_dir)
+        return false;
+
+    entry = entry_name(inname, outname);
+    mname = nasm_strcat(entry, ".dep");
+    oname = nasm_strcat(entry, ".out");
+
+    mf = nasm_open_read(mname, NF_TEXT);
+    if (!mf)
+        goto done;
+
+    if (!fgets(line, sizeof line, mf))
+        goto close;
+    line[strcspn(line, "\n")] = '\0';
+    if (strcmp(line, MANIFEST_MAGIC))
+        goto close;
+
+    while (fgets(line, sizeof line, mf)) {
+        char *path;
+
+        line[strcspn(line, "\n")] = '\0';
+        path = strchr(line, ' ');
+        if (!path)
+            goto close;
+        *path++ = '\0';
+
+        if (!strcmp(line, MISSING_MARK)) {
+            if (nasm_file_exists(path))
+                goto close;
+            continue;
+        }
+
+        if (!hash_file(path, hex) || strcmp(line, hex))
+            goto close;
+
+        strlist_add(deps, path);
+    }
+
+    if (ferror(mf))
+        goto close;
+
+    of = nasm_open_write(outname, NF_BINARY);
+    ok = of && copy_file(oname, of);
+
+close:
+    fclose(mf);
+done:
+    nasm_free(oname);
+    nasm_free(mname);
+    nasm_free(entry);
+    return ok;
+}
+
+/*
+ * Record the output file just written to outname, unless it depends
+ * on more than the files in deps.  Failures here are silently
+ * ignored; the cache is just not updated.
+ */
+void objcache_store(const char *inname, const char *outname,
+                    const struct strlist *deps,
+                    const struct strlist *misses)
+{
+    const struct strlist_entry *l;
+    char *entry, *mname, *oname;
+    char *mtemp = NULL, *otemp = NULL;
+    char hex[2*MD5_HASHBYTES+1];
+    FILE *mf, *of;
+    bool ok;
+
+    if (!cache_dir || pp_volatile_used())
+        return;
+
+    entry = entry_name(inname, outname);
+    mname = nasm_strcat(entry, ".dep");
+    oname = nasm_strcat(entry, ".out");
+
+    /*
+     * Write both files under names of their own, so concurrent runs
+     * storing the same entry can't mix, and rename them into place,
+     * the manifest last, so an interrupted update never leaves a
+     * manifest referring to a wrong output file.
+     */
+    remove(mname);
+    of = nasm_open_write_temp(oname, NF_BINARY, &otemp);
+    if (!of)
+        goto done;
+    if (!copy_file(outname, of) || rename(otemp, oname)) {
+        remove(otemp);
+        goto done;
+    }
+
+    mf = nasm_open_write_temp(mname, NF_TEXT, &mtemp);
+    if (!mf)
+        goto done;
+
+    fprintf(mf, "%s\n", MANIFEST_MAGIC);
+    ok = true;
+    strlist_for_each(l, deps) {
+        if (!hash_file(l->str, hex) || strchr(l->str, '\n')) {
+            ok = false;
+            break;
+        }
+        fprintf(mf, "%s %s\n", hex, l->str);
+    }
+    strlist_for_each(l, misses) {
+        if (!ok || nasm_file_exists(l->str) || strchr(l->str, '\n')) {
+            ok = false;
+            break;
+        }
+        fprintf(mf, "%s %s\n", MISSING_MARK, l->str);
+    }
+
+    if (ferror(mf))
+        ok = false;
+    if (fclose(mf) || !ok || rename(mtemp, mname))
+        remove(mtemp);
+
+done:
+    nasm_free(mtemp);
+    nasm_free(otemp);
+    nasm_free(oname);
+    nasm_free(mname);
+    nasm_free(entry);
+}
@@ -49,12 +49,54 @@
 #include "floats.h"
 #include "assemble.h"
 #include "tables.h"
+#include "labels.h"
+#include "raa.h"
 
 
 static int end_expression_next(void);
 
 static struct tokenval tokval;
 
+/*
+ * Cache of parsed source lines, indexed by global line number.
+ *
+ * Most lines parse to the same thing on every pass: unless a line
+ * refers to a symbol, $, $$ or a floating-point constant, the result
+ * depends only on the text of the line and the BITS/DEFAULT REL
+ * settings in effect.  Such lines are parsed once and the result
+ * reused on subsequent passes, as long as the text is the same; a
+ * label at the start of the line still has to be redefined at the
+ * new location every time.  Lines which produce any diagnostic are
+ * always parsed again, so the message is issued on each pass just as
+ * before.  Lines which are parsed again keep the token stream from
+ * their first parse, so at least they need not be scanned again.
+ */
+struct cached_line {
+    bool            valid;      /* Parse result can be reused */
+    bool            deflabel;   /* parse_line() defined the label */
+    int             bits;       /* globalbits when parsed */
+    int             rel;        /* globalrel when parsed */
+    char            *label;
+    int             prefixes[MAXPREFIX];
+    enum opcode     opcode;
+    enum ccode      condition;
+    int             operands;
+    bool            setoprs;    /* An instruction; operands are set */
+    operand         *oprs;
+    extop           *eops;
+    int32_t         times;
+    int             evex_rm;
+    int8_t          evex_brerop;
+    struct tokstream *tokens;   /* Tokens, if the line is parsed again */
+    char            text[1];    /* Source line as passed to parse_line() */
+};
+
+static struct RAA *parse_cache;
+static int64_t parse_cache_max;
+
+static bool parse_volatile;     /* Result depends on more than the text */
+static bool parse_deflabel;     /* define_label() was called */
+
 static void process_size_override(insn *result, operand *op)
 {
     if (tasm_compatible_mode) {
@@ -365,12 +407,49 @@ static int value_to_extop(expr *vect, extop *eop, int32_t myseg)
     return 0;
 }
 
+/*
+ * Is this an integer which can be stored in a run of them?
+ */
+static inline bool plain_number(const extop *eop)
+{
+    return eop->type == EOT_DB_NUMBER && eop->dup == 1 &&
+        eop->elem > 0 && eop->elem <= 8 &&
+        eop->val.num.segment == NO_SEG && eop->val.num.wrt == NO_SEG &&
+        !eop->val.num.relative;
+}
+
+/*
+ * Append an integer to prev, turning prev into a run of integers if
+ * it is a single one.
+ */
+static void add_number(extop *prev, int64_t val)
+{
+    if (prev->type == EOT_DB_NUMBER) {
+        int64_t first = prev->val.num.offset;
+
+        prev->type = EOT_DB_NUMBERS;
+        prev->val.nums.size = 16;
+        prev->val.nums.n    = 1;
+        prev->val.nums.vals =
+            nasm_malloc(prev->val.nums.size * sizeof(int64_t));
+        prev->val.nums.vals[0] = first;
+    } else if (prev->val.nums.n >= prev->val.nums.size) {
+        prev->val.nums.size <<= 1;
+        prev->val.nums.vals =
+            nasm_realloc(prev->val.nums.vals,
+                         prev->val.nums.size * sizeof(int64_t));
+    }
+
+    prev->val.nums.vals[prev->val.nums.n++] = val;
+}
+
 /*
  * Parse an extended expression, used by db et al. "elem" is the element
  * size; initially comes from the specific opcode (e.g. db == 1) but
- * can be overridden.
+ * can be overridden.  If "pack" is set, consecutive plain integers are
+ * stored as one EOT_DB_NUMBERS element.
  */
-static int parse_eops(extop **result, bool critical, int elem)
+static int parse_eops(extop **result, bool critical, int elem, bool pack)
 {
     extop *eop = NULL, *prev = NULL;
     extop **tail = result;
@@ -406,7 +485,8 @@ static int parse_eops(extop **result, bool critical, int elem)
             extop *subexpr;
 
             stdscan(NULL, &tokval); /* Skip paren */
-            if (parse_eops(&eop->val.subexpr, critical, eop->elem) < 0)
+            if (parse_eops(&eop->val.subexpr, critical, eop->elem,
+                           pack) < 0)
                 goto fail;
 
             subexpr = eop->val.subexpr;
@@ -496,6 +576,7 @@ static int parse_eops(extop **result, bool critical, int elem)
             enum floatize fmt;
         is_float:
             eop->type = EOT_DB_FLOAT;
+            parse_volatile = true;  /* Depends on the FLOAT settings */
 
             fmt = float_deffmt(eop->elem);
             if (fmt == FLOAT_ERR) {
@@ -557,6 +638,12 @@ static int parse_eops(extop **result, bool critical, int elem)
             /* Coalesce multiple EOT_DB_RESERVE */
             prev->dup += eop->dup;
             nasm_free(eop);
+        } else if (pack && plain_number(eop) && prev && prev->dup == 1 &&
+                   prev->elem == eop->elem &&
+                   (prev->type == EOT_DB_NUMBERS || plain_number(prev))) {
+            /* Store runs of integers compactly */
+            add_number(prev, eop->val.num.offset);
+            nasm_free(eop);
         } else {
             /* Add this eop to the end of the chain */
             prev = eop;
@@ -594,7 +681,7 @@ fail:
     return -1;
 }
 
-insn *parse_line(char *buffer, insn *result)
+static insn *do_parse_line(char *buffer, insn *result)
 {
     bool insn_is_label = false;
     struct eval_hints hints;
@@ -664,6 +751,7 @@ restart_parse:
             define_label(result->label,
                          in_absolute ? absolute.segment : location.segment,
                          location.offset, true);
+            parse_deflabel = true;
         }
     }
 
@@ -769,7 +857,9 @@ restart_parse:
             goto restart_parse;
         }
         first = false;
-        oper_num = parse_eops(&result->eops, critical, db_bytes(result->opcode));
+        oper_num = parse_eops(&result->eops, critical,
+                              db_bytes(result->opcode),
+                              result->opcode != I_INCBIN);
         if (oper_num < 0)
             goto fail;
 
@@ -1307,6 +1397,10 @@ static void free_eops(extop *e)
             nasm_free(e->val.string.data);
             break;
 
+        case EOT_DB_NUMBERS:
+            nasm_free(e->val.nums.vals);
+            break;
+
         default:
             break;
         }
@@ -1320,3 +1414,192 @@ void cleanup_insn(insn * i)
 {
     free_eops(i->eops);
 }
+
+static extop *dup_eops(const extop *e)
+{
+    extop *head = NULL;
+    extop **tail = &head;
+    extop *n;
+
+    for (; e; e = e->next) {
+        nasm_new(n);
+        *n = *e;
+        n->next = NULL;
+
+        switch (e->type) {
+        case EOT_EXTOP:
+            n->val.subexpr = dup_eops(e->val.subexpr);
+            break;
+
+        case EOT_DB_STRING:
+        case EOT_DB_STRING_FREE:
+            /* The original may point into the source line buffer */
+            n->type = EOT_DB_STRING_FREE;
+            n->val.string.data = nasm_malloc(e->val.string.len + 1);
+            memcpy(n->val.string.data, e->val.string.data,
+                   e->val.string.len);
+            n->val.string.data[e->val.string.len] = '\0';
+            break;
+
+        case EOT_DB_NUMBERS:
+            n->val.nums.vals = nasm_malloc(e->val.nums.size * sizeof(int64_t));
+            memcpy(n->val.nums.vals, e->val.nums.vals,
+                   e->val.nums.n * sizeof(int64_t));
+            break;
+
+        default:
+            break;
+        }
+
+        *tail = n;
+        tail = &n->next;
+    }
+
+    return head;
+}
+
+static void free_cached_line(struct cached_line *cl)
+{
+    if (!cl)
+        return;
+
+    nasm_free(cl->label);
+    nasm_free(cl->oprs);
+    free_eops(cl->eops);
+    stdscan_free_stream(cl->tokens);
+    nasm_free(cl);
+}
+
+static struct cached_line *new_cached_line(const char *text)
+{
+    struct cached_line *cl;
+    size_t len = strlen(text);
+
+    cl = nasm_zalloc(sizeof *cl + len);
+    memcpy(cl->text, text, len + 1);
+    return cl;
+}
+
+static void parse_cache_store(int64_t lineno, struct cached_line *cl,
+                              const insn *ins, bool valid)
+{
+    free_cached_line(raa_read_ptr(parse_cache, lineno));
+
+    cl->valid = valid;
+
+    if (valid) {
+        stdscan_free_stream(cl->tokens);
+        cl->tokens = NULL;
+
+        cl->deflabel    = parse_deflabel;
+        cl->bits        = globalbits;
+        cl->rel         = globalrel;
+        cl->label       = ins->label ? nasm_strdup(ins->label) : NULL;
+        memcpy(cl->prefixes, ins->prefixes, sizeof cl->prefixes);
+        cl->opcode      = ins->opcode;
+        cl->condition   = ins->condition;
+        cl->operands    = ins->operands;
+        cl->eops        = dup_eops(ins->eops);
+        cl->times       = ins->times;
+        cl->evex_rm     = ins->evex_rm;
+        cl->evex_brerop = ins->evex_brerop;
+
+        /* DB et al and INCBIN leave the operand array alone */
+        cl->setoprs = ins->opcode != I_none && ins->opcode != I_INCBIN &&
+            !opcode_is_db(ins->opcode);
+        if (cl->setoprs && ins->operands) {
+            nasm_newn(cl->oprs, ins->operands);
+            memcpy(cl->oprs, ins->oprs, ins->operands * sizeof(operand));
+        }
+    }
+
+    parse_cache = raa_write_ptr(parse_cache, lineno, cl);
+    if (lineno > parse_cache_max)
+        parse_cache_max = lineno;
+}
+
+static insn *parse_cache_replay(const struct cached_line *cl, insn *result)
+{
+    int i;
+
+    stdscan_reset();
+
+    result->forw_ref    = false;
+    result->label       = cl->label;
+    memcpy(result->prefixes, cl->prefixes, sizeof cl->prefixes);
+    result->opcode      = cl->opcode;
+    result->condition   = cl->condition;
+    result->operands    = cl->operands;
+    result->eops        = dup_eops(cl->eops);
+    result->times       = cl->times;
+    result->evex_rm     = cl->evex_rm;
+    result->evex_brerop = cl->evex_brerop;
+
+    if (cl->setoprs) {
+        if (cl->operands)
+            memcpy(result->oprs, cl->oprs, cl->operands * sizeof(operand));
+        for (i = cl->operands; i < MAX_OPERANDS; i++)
+            result->oprs[i].type = 0;
+    }
+
+    if (cl->deflabel)
+        define_label(result->label,
+                     in_absolute ? absolute.segment : location.segment,
+                     location.offset, true);
+
+    return result;
+}
+
+/*
+ * Parse a source line; lineno is its global line number within the
+ * current pass, used to reuse the result of a previous pass.
+ */
+insn *parse_line(char *buffer, insn *result, int64_t lineno)
+{
+    struct cached_line *cl = raa_read_ptr(parse_cache, lineno);
+    struct cached_line *ncl = NULL;
+    struct tokstream **tokens = NULL;
+    uint64_t errors = nasm_error_count;
+    uint64_t crefs  = eval_context_refs;
+
+    if (cl && !strcmp(cl->text, buffer)) {
+        if (cl->valid && cl->bits == globalbits && cl->rel == globalrel)
+            return parse_cache_replay(cl, result);
+        if (cl->valid)
+            ncl = new_cached_line(buffer); /* Context changed */
+        else
+            tokens = &cl->tokens;
+    } else {
+        /* The parser modifies the buffer, so copy it first */
+        ncl = new_cached_line(buffer);
+    }
+
+    parse_volatile = false;
+    parse_deflabel = false;
+
+    if (ncl)
+        tokens = &ncl->tokens;
+    stdscan_set_stream(tokens, buffer);
+    do_parse_line(buffer, result);
+    stdscan_set_stream(NULL, NULL);
+
+    if (ncl)
+        parse_cache_store(lineno, ncl, result,
+                          !parse_volatile && !result->forw_ref &&
+                          errors == nasm_error_count &&
+                          crefs == eval_context_refs);
+
+    return result;
+}
+
+void parser_cleanup(void)
+{
+    int64_t i;
+
+    for (i = 0; i <= parse_cache_max; i++)
+        free_cached_line(raa_read_ptr(parse_cache, i));
+
+    raa_free(parse_cache);
+    parse_cache = NULL;
+    parse_cache_max = 0;
+}
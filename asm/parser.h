@@ -39,7 +39,8 @@
 #ifndef NASM_PARSER_H
 #define NASM_PARSER_H
 
-insn *parse_line(char *buffer, insn *result);
+insn *parse_line(char *buffer, insn *result, int64_t lineno);
 void cleanup_insn(insn *instruction);
+void parser_cleanup(void);
 
 #endif
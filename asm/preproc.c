@@ -76,6 +76,13 @@
 #include "tables.h"
 #include "listing.h"
 #include "dbginfo.h"
+#include "outform.h"
+#include "profile.h"
+#include "filecache.h"
+#include "atom.h"
+#include "md5.h"
+#include "saa.h"
+#include "ver.h"
 
 /*
  * Preprocessor execution options that can be controlled by %pragma or
@@ -147,10 +154,10 @@ static bool is_smac_param(enum token_type toktype)
 }
 
 /*
- * This is tuned so struct Token should be 64 bytes on 64-bit
- * systems and 32 bytes on 32-bit systems. It enables them
- * to be nicely cache aligned, and the text to still be kept
- * inline for nearly all tokens.
+ * This is tuned so struct Token should be 48 bytes on 64-bit
+ * systems and 24 bytes on 32-bit systems. It keeps the text
+ * inline for nearly all tokens; longer text is allocated from
+ * the same arena as the token (see alloc_Token()).
  *
  * We prohibit tokens of length > MAX_TEXT even though
  * length here is an unsigned int; this avoids problems
@@ -162,11 +169,12 @@ static bool is_smac_param(enum token_type toktype)
  * is incorrect, as some token types strip parts of the string,
  * e.g. indirect tokens.
  */
-#define INLINE_TEXT (7*sizeof(char *)-sizeof(enum token_type)-sizeof(unsigned int)-1)
+#define INLINE_TEXT (4*sizeof(char *)-sizeof(enum token_type)-sizeof(unsigned int)-1)
 #define MAX_TEXT (INT_MAX-2)
 
 struct Token {
     Token *next;
+    const struct atom *atom;    /* Interned text, if any; see intern_tlist() */
     enum token_type type;
     unsigned int len;
     union {
@@ -178,6 +186,12 @@ struct Token {
     } text;
 };
 
+static char *alloc_text(size_t size);
+static inline void free_text(Token *t);
+
+/* Set while the pass arena is being discarded wholesale */
+static bool discarding_tokens;
+
 /*
  * Note on the storage of both SMacro and MMacros: the hash table
  * indexes them case-insensitively, and we then have to go through a
@@ -223,6 +237,7 @@ struct SMacro {
     bool casesense;
     bool in_progress;
     bool alias;                 /* This is an alias macro */
+    bool timestamp;             /* One of the date and time macros */
 };
 
 /*
@@ -274,6 +289,7 @@ struct MMacro {
     bool casesense;
     bool plus;                  /* is the last parameter greedy? */
     bool capture_label;         /* macro definition has %00; capture label */
+    bool compiled;              /* Parameters can be spliced in directly */
     int32_t in_progress;        /* is this macro currently being expanded? */
     int32_t max_depth;          /* maximum number of recursive expansions allowed */
     Token *dlist;               /* All defaults as one list */
@@ -295,6 +311,7 @@ struct MMacro {
         struct debug_macro_def *def; /* Definition */
         struct debug_macro_inv *inv; /* Current invocation (if any) */
     } dbg;
+    const MMacro *cached;       /* Persistent copy for the output cache */
 };
 
 
@@ -352,6 +369,8 @@ static inline unsigned int tok_check_len(size_t len)
 
 static inline bool tok_text_match(const struct Token *a, const struct Token *b)
 {
+    if (a->atom && b->atom)
+        return a->atom == b->atom;
     return a->len == b->len && !memcmp(tok_text(a), tok_text(b), a->len);
 }
 
@@ -375,41 +394,26 @@ static Token *set_text(struct Token *t, const char *text, size_t len)
 {
     char *textp;
 
-    if (t->len > INLINE_TEXT)
-	nasm_free(t->text.p.ptr);
-
+    free_text(t);
     nasm_zero(t->text);
 
+    t->atom = NULL;
     t->len = len = tok_check_len(len);
     textp = (len > INLINE_TEXT)
-	? (t->text.p.ptr = nasm_malloc(len+1)) : t->text.a;
+	? (t->text.p.ptr = alloc_text(len+1)) : t->text.a;
     memcpy(textp, text, len);
     textp[len] = '\0';
     return t;
 }
 
 /*
- * Set the text field to the existing pre-allocated string, either
- * taking over or freeing the allocation in the process.
+ * Set the text field to the contents of an existing nasm_malloc()'d
+ * string, which is freed in the process.
  */
 static Token *set_text_free(struct Token *t, char *text, unsigned int len)
 {
-    char *textp;
-
-    if (t->len > INLINE_TEXT)
-	nasm_free(t->text.p.ptr);
-
-    nasm_zero(t->text);
-
-    t->len = len = tok_check_len(len);
-    if (len > INLINE_TEXT) {
-	textp = t->text.p.ptr = text;
-    } else {
-	textp = memcpy(t->text.a, text, len);
-	nasm_free(text);
-    }
-    textp[len] = '\0';
-
+    set_text(t, text, len);
+    nasm_free(text);
     return t;
 }
 
@@ -452,6 +456,60 @@ struct Line {
     MMacro *finishes;
     Token *first;
     struct src_location where;      /* Where defined */
+    struct mmac_slot *slots;        /* Substitutions in a compiled line */
+    unsigned int nslots;
+    bool compiled;                  /* Macro body line has been compiled */
+    bool spliced;                   /* Parameters already substituted */
+};
+
+/*
+ * A compiled multi-line macro body line records, in token order,
+ * which of its tokens are replaced when the macro is expanded; see
+ * compile_mmacro().
+ */
+enum mmac_slot_type {
+    MSLOT_PARAM,                /* %1, %2, ... and %00 */
+    MSLOT_NPARAM,               /* %0 */
+    MSLOT_LOCAL,                /* %%label */
+    MSLOT_INAME,                /* %? */
+    MSLOT_NAME                  /* %?? */
+};
+
+struct mmac_slot {
+    unsigned int pos;           /* Index of the token in the line */
+    enum mmac_slot_type type;
+    unsigned int n;             /* Parameter number for MSLOT_PARAM */
+};
+
+/*
+ * A source file is read into memory in one go, normally through the
+ * file cache.  Lines which are not continued are handed out in place,
+ * by overwriting the line terminator with a NUL until the line has
+ * been tokenized; only lines with continuations are copied, into the
+ * line buffer.
+ */
+struct src_buffer {
+    FILE *fp;                   /* Kept open while the file is being read */
+    char *buf;                  /* File contents, then FILE_CACHE_PAD NULs */
+    char *alloc;                /* Same as buf if not from the file cache */
+    char *end;                  /* End of the file contents */
+    char *pos;                  /* Start of the next line */
+    char *cut;                  /* Terminator replaced by a NUL, if any */
+    char cutc;                  /* Original value of *cut */
+    char *line;                 /* Buffer for continued lines */
+    size_t linesize;
+};
+
+/*
+ * An included file is guarded if everything in it other than blank
+ * lines is inside a %ifndef MACRO ... %endif block without %else or
+ * %elif.  Once it has been read through without any diagnostics, it
+ * need not be read again while MACRO is defined.
+ */
+enum include_guard {
+    GUARD_NONE,                 /* Not guarded, or not an included file */
+    GUARD_START,                /* Nothing but blank lines so far */
+    GUARD_OPEN                  /* The guard condition has been opened */
 };
 
 /*
@@ -464,7 +522,7 @@ struct Line {
  */
 struct Include {
     Include *next;
-    FILE *fp;
+    struct src_buffer *src;     /* NULL for the stdmac pseudo-file */
     Cond *conds;
     Line *expansion;
     uint64_t nolist;            /* Listing inhibit counter */
@@ -473,6 +531,11 @@ struct Include {
     struct src_location where;  /* Filename and current line number */
     int32_t lineinc;            /* Increment given by %line */
     int32_t lineskip;           /* Accounting for passed continuation lines */
+    struct file_hash_entry *file; /* Hash entry of an included file */
+    enum include_guard guard;   /* Include guard detection state */
+    Cond *guard_cond;           /* Condition opened by the guard */
+    char *guard_name;           /* Macro tested by the guard */
+    uint64_t guard_errors;      /* nasm_error_count when opened */
 };
 
 /*
@@ -599,6 +662,15 @@ static struct hash_table mmacros;
  */
 static struct hash_table smacros;
 
+/*
+ * A Bloom filter of the names in smacros, so that the identifiers
+ * which cannot be single-line macros -- most of them -- can be passed
+ * over without a hash table lookup.  %undef leaves its bits set; they
+ * are recomputed whenever the table is cleared.
+ */
+#define SMACRO_FILTER_BITS 4096
+static uint64_t smacro_filter[SMACRO_FILTER_BITS/64];
+
 /*
  * The multi-line macro we are currently defining, or the %rep
  * block we are currently reading, if any.
@@ -623,16 +695,145 @@ static macros_t **stdmacnext;
 static macros_t *stdmacros[8];
 static macros_t *extrastdmac;
 
+/*
+ * The packed standard macro sets are decoded once, and each line is
+ * tokenized the first time it is read.  Later passes, and with
+ * PP_RESIDENT later sessions, copy the tokens instead of decoding and
+ * tokenizing the same text again.
+ */
+struct stdmac_token {
+    enum token_type type;
+    unsigned int len;
+    const char *text;
+};
+
+struct stdmac_line {
+    macros_t *pos;              /* Packed line */
+    macros_t *next;             /* Packed line following it */
+    const char *text;           /* Decoded line */
+    int ntokens;                /* -1 if not tokenized yet */
+    struct stdmac_token *tokens;
+};
+
+struct stdmac_set {
+    struct stdmac_set *next;
+    macros_t *start, *end;      /* Packed set, without the final 127 */
+    size_t nlines;
+    struct stdmac_line *lines;
+    char *text;                 /* Decoded lines */
+};
+
+static struct stdmac_set *stdmac_sets;
+static struct stdmac_set *stdmac_curset; /* Set of the line last read */
+static size_t stdmac_curline;
+
 /*
  * Map of which %use packages have been loaded
  */
 static bool *use_loaded;
 
+/*
+ * Set once the date, the time or the environment has been used in
+ * this session, so the output depends on more than the files read
+ */
+static bool volatile_used;
+
+/*
+ * The predefined date and time macros; see define_macros() in nasm.c
+ */
+static const char * const timestamp_macros[] = {
+    "__?DATE?__", "__?DATE_NUM?__", "__?TIME?__", "__?TIME_NUM?__",
+    "__?UTC_DATE?__", "__?UTC_DATE_NUM?__", "__?UTC_TIME?__",
+    "__?UTC_TIME_NUM?__", "__?POSIX_TIME?__", NULL
+};
+
+/*
+ * Files searched for in the include path and not found, or NULL
+ */
+static struct strlist *search_misses;
+
+/*
+ * Preprocessor output cache.  The expanded line stream of the first
+ * pass is recorded together with the source location stack for each
+ * line, and replayed in the preparatory passes that follow, unless
+ * something seen during the first pass could make the output differ
+ * between passes.  The final pass always runs the real preprocessor,
+ * as it is the one producing listing, debug and dependency information.
+ */
+struct cache_frame {
+    struct cache_frame *next;       /* List of all frames, for freeing */
+    const struct cache_frame *up;   /* Next frame toward the top level */
+    const MMacro *macro;            /* Persistent macro copy or NULL */
+    struct src_location where;
+};
+
+struct cache_line {
+    char *text;                     /* NULL at end of input */
+    const struct cache_frame *frame; /* Source location stack */
+    struct src_location where;      /* Location of the bottom frame */
+};
+
+static struct pp_cache {
+    enum pp_cache_state {
+        PPC_OFF,                    /* Nothing cached */
+        PPC_RECORD,                 /* Recording the first pass */
+        PPC_READY,                  /* Complete recording available */
+        PPC_REPLAY                  /* Replaying a recording */
+    } state;
+    bool in_getline;                /* Inside the real pp_getline() */
+    struct cache_line *lines;
+    size_t nlines, maxlines, pos;
+    struct cache_frame *frames;
+    const struct cache_frame *frame; /* Current frame */
+    MMacro *macros;                 /* Persistent macro copies */
+} ppcache;
+
+/*
+ * Preprocessor state snapshot (--pp-snapshot).  The state reached
+ * after the standard macros, the predefinitions and the pre-included
+ * files is written to a file at that point of the final pass, and
+ * later runs install it instead of processing all of that again, as
+ * long as the snapshot was made by the same version of NASM with the
+ * same options and none of the files read has changed since.
+ *
+ * Anything which would make the state depend on more than that --
+ * output lines, diagnostics, the current pass, the values of symbols,
+ * the date or the environment -- means no snapshot is written.
+ */
+struct snap_file {
+    struct snap_file *next;
+    bool depend;                    /* From %depend, not read */
+    char *name;                     /* As given to the directive */
+    char *path;                     /* As found */
+};
+
+static struct pp_snapshot {
+    enum pp_snapshot_state {
+        PPS_OFF,                    /* No snapshot wanted or possible */
+        PPS_RECORD,                 /* To be written in the final pass */
+        PPS_LOADED                  /* Valid snapshot in memory */
+    } state;
+    bool pending;                   /* Still reading what is recorded */
+    char *path;                     /* Snapshot file name */
+    unsigned char key[MD5_HASHBYTES]; /* Version, options, predefinitions */
+    struct snap_file *files, **files_tail;
+    size_t nmagic;                  /* Number of magic smacros */
+    const SMacro *pass_macro;       /* __?PASS?__, while pending */
+    const Include *inc;             /* Stdmac pseudo-file, while pending */
+    unsigned char *data;            /* Body of the loaded snapshot */
+    size_t len;
+} ppsnap;
+
 /*
  * Forward declarations.
  */
 static void pp_add_stdmac(macros_t *macros);
+static void pp_cache_invalidate(void);
+static void pp_snapshot_reject(void);
+static void pp_snapshot_file(const char *name, const char *path, bool depend);
 static Token *expand_mmac_params(Token * tline);
+static void compile_mmacro(MMacro *m);
+static Token *tokenize(const char *line);
 static Token *expand_smacro(Token * tline);
 static Token *expand_id(Token * tline);
 static Context *get_ctx(const char *name, const char **namep);
@@ -719,9 +920,11 @@ static const char *unquote_token_anystr(Token *t, uint32_t badctl, char qstart)
     if (olen <= INLINE_TEXT || nlen > INLINE_TEXT)
         return p;
 
+    t->len = olen;
+    free_text(t);
+    t->len = nlen;
     nasm_zero(t->text.a);
     memcpy(t->text.a, p, nlen);
-    nasm_free(p);
     return t->text.a;
 }
 
@@ -786,6 +989,31 @@ static Token *reverse_tokens(Token *t)
     return prev;
 }
 
+/*
+ * The output depends on the date, the time or the environment: it
+ * must neither be cached nor be part of a snapshot.
+ */
+static void mark_volatile(void)
+{
+    volatile_used = true;
+    pp_snapshot_reject();
+}
+
+/* Is this the name of one of the date and time macros? */
+static bool is_timestamp_macro(const char *name)
+{
+    const char * const *tm;
+
+    if (name[0] != '_' || name[1] != '_' || name[2] != '?')
+        return false;
+
+    for (tm = timestamp_macros; *tm; tm++) {
+        if (!strcmp(name, *tm))
+            return true;
+    }
+    return false;
+}
+
 /*
  * getenv() variant operating on an input token
  */
@@ -825,6 +1053,7 @@ static const char *pp_getenv(const Token *t, bool warn)
 	txt = buf;
     }
 
+    mark_volatile();
     v = getenv(txt);
     if (warn && !v) {
 	/*!
@@ -852,6 +1081,9 @@ static const char *pp_getenv(const Token *t, bool warn)
  */
 static void free_tlist(Token * list)
 {
+    if (discarding_tokens)
+        return;
+
     while (list)
         list = delete_Token(list);
 }
@@ -864,6 +1096,7 @@ static void free_llist(Line * list)
     Line *l, *tmp;
     list_for_each_safe(l, tmp, list) {
         free_tlist(l->first);
+        nasm_free(l->slots);
         nasm_free(l);
     }
 }
@@ -966,8 +1199,7 @@ static void free_smacro_members(SMacro *s)
     if (s->params) {
         int i;
         for (i = 0; i < s->nparam; i++) {
-	    if (s->params[i].name.len > INLINE_TEXT)
-		nasm_free(s->params[i].name.text.p.ptr);
+	    free_text(&s->params[i].name);
 	}
         nasm_free(s->params);
     }
@@ -1003,6 +1235,41 @@ enum clear_what {
     CLEAR_ALL       = CLEAR_ALLDEFINE|CLEAR_MMACRO
 };
 
+/*
+ * The filter hash is cheap rather than good; the table is small and
+ * only needs to reject most names.  It must ignore case, like the
+ * table itself.
+ */
+static inline uint32_t smacro_filter_hash(const char *name, size_t len)
+{
+    uint32_t h = len;
+
+    h = h * 31 + nasm_tolower(name[0]);
+    h = h * 31 + nasm_tolower(name[len >> 1]);
+    h = h * 31 + nasm_tolower(name[len - 1]);
+    return h * 0x9e3779b1;
+}
+
+static void smacro_filter_add(const char *name)
+{
+    uint32_t h = smacro_filter_hash(name, strlen(name));
+    unsigned int b1 = h >> 20;
+    unsigned int b2 = (h >> 8) & (SMACRO_FILTER_BITS-1);
+
+    smacro_filter[b1 >> 6] |= UINT64_C(1) << (b1 & 63);
+    smacro_filter[b2 >> 6] |= UINT64_C(1) << (b2 & 63);
+}
+
+static inline bool smacro_filter_test(const Token *t)
+{
+    uint32_t h = smacro_filter_hash(tok_text(t), t->len);
+    unsigned int b1 = h >> 20;
+    unsigned int b2 = (h >> 8) & (SMACRO_FILTER_BITS-1);
+
+    return ((smacro_filter[b1 >> 6] >> (b1 & 63)) &
+            (smacro_filter[b2 >> 6] >> (b2 & 63)) & 1);
+}
+
 static void clear_smacro_table(struct hash_table *smt, enum clear_what what)
 {
     struct hash_iterator it;
@@ -1028,12 +1295,20 @@ static void clear_smacro_table(struct hash_table *smt, enum clear_what what)
     }
 
     /*
-     * Free the hash table and keys if and only if it is now empty.
+     * Free the hash table if and only if it is now empty.
      * Note: we cannot free keys even for an empty list above, as that
      * mucks up the hash algorithm.
      */
     if (empty)
-        hash_free_all(smt, true);
+        hash_free(smt);
+
+    if (smt == &smacros) {
+        nasm_zero(smacro_filter);
+        hash_for_each(smt, it, np) {
+            if (np->data)
+                smacro_filter_add(np->key);
+        }
+    }
 }
 
 static void free_smacro_table(struct hash_table *smt)
@@ -1049,7 +1324,6 @@ static void free_mmacro_table(struct hash_table *mmt)
     hash_for_each(mmt, it, np) {
         MMacro *tmp;
         MMacro *m = np->data;
-        nasm_free((void *)np->key);
         list_for_each_safe(m, tmp, m)
             free_mmacro(m);
     }
@@ -1082,6 +1356,12 @@ static void ctx_pop(void)
     nasm_free(c);
 }
 
+/*
+ * The keys of the macro tables are the names of fold atoms (see
+ * atom.h), which belong to the atom table.  They can be searched for
+ * by name with hash_findi(), or by atom, comparing only pointers.
+ */
+
 /*
  * Search for a key in the hash index; adding it if necessary
  * (in which case we initialize the data pointer to NULL.)
@@ -1089,18 +1369,15 @@ static void ctx_pop(void)
 static void **
 hash_findi_add(struct hash_table *hash, const char *str)
 {
+    const struct atom *a = atom_get(str, strlen(str))->fold;
     struct hash_insert hi;
     void **r;
-    char *strx;
-    size_t l = strlen(str) + 1;
 
-    r = hash_findib(hash, str, l, &hi);
+    r = hash_findp(hash, a->ihash, a->name, a->len + 1, &hi);
     if (r)
         return r;
 
-    strx = nasm_malloc(l);  /* Use a more efficient allocator here? */
-    memcpy(strx, str, l);
-    return hash_add(&hi, strx, NULL);
+    return hash_add(&hi, NULL, NULL);
 }
 
 /*
@@ -1118,46 +1395,215 @@ hash_findix(struct hash_table *hash, const char *str)
 }
 
 /*
- * read line from standart macros set,
- * if there no more left -- return NULL
+ * Same as hash_findix(), for the text of a token.  A token with an
+ * atom is found without hashing or comparing any text.
  */
-static char *line_from_stdmac(void)
+static void *
+hash_findix_tok(struct hash_table *hash, const Token *t)
 {
-    unsigned char c;
-    const unsigned char *p = stdmacpos;
-    char *line, *q;
-    size_t len = 0;
+    void **p;
 
-    if (!stdmacpos)
-        return NULL;
+    if (!t->atom)
+        return hash_findix(hash, tok_text(t));
+
+    p = hash_findp(hash, t->atom->ihash, t->atom->fold->name,
+                   t->atom->len + 1, NULL);
+    return p ? *p : NULL;
+}
+
+/*
+ * Intern the identifiers in a list of tokens which is going to be
+ * copied and looked up repeatedly, such as a macro body.  The copies
+ * inherit the atoms; anything which changes the text of a token
+ * drops its atom.
+ */
+static void intern_tlist(Token *t)
+{
+    list_for_each(t, t) {
+        if (!t->atom && (t->type == TOKEN_ID || t->type == TOKEN_PREPROC_ID))
+            t->atom = atom_get(tok_text(t), t->len);
+    }
+}
+
+static void intern_mmacro(MMacro *m)
+{
+    Line *l;
+
+    list_for_each(l, m->expansion)
+        intern_tlist(l->first);
+}
+
+/*
+ * Decode the standard macro set starting at start.
+ */
+static struct stdmac_set *stdmac_decode_set(macros_t *start)
+{
+    struct stdmac_set *set;
+    struct stdmac_line *sl;
+    macros_t *p;
+    unsigned char c;
+    char *q;
+    size_t len = 0, nlines = 0;
 
     /*
      * 32-126 is ASCII, 127 is end of line, 128-31 are directives
      * (allowed to wrap around) corresponding to PP_* tokens 0-159.
+     * Another 127 after the end of a line ends the set.
      */
-    while ((c = *p++) != 127) {
-        uint8_t ndir = c - 128;
-        if (ndir < 256-96)
-            len += pp_directives_len[ndir] + 1;
+    p = start;
+    do {
+        while ((c = *p++) != 127) {
+            uint8_t ndir = c - 128;
+            if (ndir < 256-96)
+                len += pp_directives_len[ndir] + 1;
+            else
+                len++;
+        }
+        len++;
+        nlines++;
+    } while (*p != 127);
+
+    nasm_new(set);
+    set->start  = start;
+    set->end    = p;
+    set->nlines = nlines;
+    nasm_newn(set->lines, nlines);
+    q = set->text = nasm_malloc(len);
+
+    p = start;
+    for (sl = set->lines; sl < set->lines + nlines; sl++) {
+        sl->pos      = p;
+        sl->text     = q;
+        sl->ntokens  = -1;
+        while ((c = *p++) != 127) {
+            uint8_t ndir = c - 128;
+            if (ndir < 256-96) {
+                memcpy(q, pp_directives[ndir], pp_directives_len[ndir]);
+                q += pp_directives_len[ndir];
+                *q++ = ' ';
+            } else {
+                *q++ = c;
+            }
+        }
+        *q++ = '\0';
+        sl->next = p;
+    }
+
+    set->next = stdmac_sets;
+    stdmac_sets = set;
+    return set;
+}
+
+/*
+ * Find the decoded line at pos, which is either in a set already
+ * decoded or the start of a new one.
+ */
+static struct stdmac_line *stdmac_find_line(macros_t *pos)
+{
+    struct stdmac_set *set = stdmac_curset;
+    size_t lo, hi;
+
+    if (set && stdmac_curline + 1 < set->nlines &&
+        set->lines[stdmac_curline + 1].pos == pos)
+        return &set->lines[++stdmac_curline];
+
+    list_for_each(set, stdmac_sets) {
+        if (pos >= set->start && pos < set->end)
+            break;
+    }
+    if (!set)
+        set = stdmac_decode_set(pos);
+
+    lo = 0;
+    hi = set->nlines;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) >> 1;
+        if (set->lines[mid].pos <= pos)
+            lo = mid;
         else
-            len++;
+            hi = mid;
     }
+    nasm_assert(set->lines[lo].pos == pos);
+
+    stdmac_curset  = set;
+    stdmac_curline = lo;
+    return &set->lines[lo];
+}
+
+/*
+ * Tokenize the standard macro line last read by line_from_stdmac().
+ */
+static Token *stdmac_tokenize(void)
+{
+    struct stdmac_line *sl = &stdmac_curset->lines[stdmac_curline];
+    const struct stdmac_token *st;
+    Token *tline, *t, **tail;
+    size_t size;
+    char *text;
+    int i;
 
-    line = nasm_malloc(len + 1);
-    q = line;
+    if (sl->ntokens < 0) {
+        tline = tokenize(sl->text);
 
-    while ((c = *stdmacpos++) != 127) {
-        uint8_t ndir = c - 128;
-        if (ndir < 256-96) {
-            memcpy(q, pp_directives[ndir], pp_directives_len[ndir]);
-            q += pp_directives_len[ndir];
-            *q++ = ' ';
-        } else {
-            *q++ = c;
+        sl->ntokens = 0;
+        size = 0;
+        list_for_each(t, tline) {
+            sl->ntokens++;
+            size += t->len + 1;
         }
+
+        sl->tokens = nasm_malloc(sl->ntokens * sizeof *sl->tokens + size);
+        text = (char *)(sl->tokens + sl->ntokens);
+        i = 0;
+        list_for_each(t, tline) {
+            struct stdmac_token *nt = &sl->tokens[i++];
+            nt->type = t->type;
+            nt->len  = t->len;
+            nt->text = text;
+            memcpy(text, tok_text(t), t->len + 1);
+            text += t->len + 1;
+        }
+        return tline;
+    }
+
+    tline = NULL;
+    tail = &tline;
+    for (st = sl->tokens; st < sl->tokens + sl->ntokens; st++) {
+        *tail = t = new_Token(NULL, st->type, st->text, st->len);
+        tail = &t->next;
     }
-    stdmacpos = p;
-    *q = '\0';
+    return tline;
+}
+
+static void stdmac_free_sets(void)
+{
+    struct stdmac_set *set, *tmp;
+    size_t i;
+
+    list_for_each_safe(set, tmp, stdmac_sets) {
+        for (i = 0; i < set->nlines; i++)
+            nasm_free(set->lines[i].tokens);
+        nasm_free(set->lines);
+        nasm_free(set->text);
+        nasm_free(set);
+    }
+    stdmac_sets = NULL;
+    stdmac_curset = NULL;
+}
+
+/*
+ * read line from standart macros set,
+ * if there no more left -- return NULL
+ */
+static const char *line_from_stdmac(void)
+{
+    const struct stdmac_line *sl;
+
+    if (!stdmacpos)
+        return NULL;
+
+    sl = stdmac_find_line(stdmacpos);
+    stdmacpos = sl->next;
 
     if (*stdmacpos == 127) {
         /* This was the last of this particular macro set */
@@ -1186,96 +1632,187 @@ static char *line_from_stdmac(void)
         }
     }
 
-    return line;
+    return sl->text;
 }
 
 /*
- * Read a line from a file. Return NULL on end of file.
+ * Set up reading a source file opened as fp.  The contents normally
+ * come from the file cache; only if the file is not a regular file
+ * is it read here.  The file stays open until src_close(), so nesting
+ * include files without bound still runs into the limit on open
+ * files.
  */
-static char *line_from_file(FILE *f)
+static struct src_buffer *src_open(FILE *fp, const char *path)
 {
-    int c;
-    unsigned int size, next;
-    const unsigned int delta = 512;
-    const unsigned int pad = 8;
-    bool cont = false;
-    char *buffer, *p;
+    const struct cached_file *cf = file_cache_get(path, fp);
+    struct src_buffer *sb;
+    size_t len;
 
-    istk->where.lineno += istk->lineskip + istk->lineinc;
-    src_set_linnum(istk->where.lineno);
-    istk->lineskip = 0;
+    nasm_new(sb);
+    sb->fp = fp;
+    if (cf) {
+        sb->buf = cf->data;
+        len = cf->len;
+    } else {
+        sb->buf = sb->alloc = nasm_load_file(fp, &len, FILE_CACHE_PAD);
+    }
+    sb->pos = sb->buf;
+    sb->end = sb->buf + len;
+    return sb;
+}
 
-    size = delta;
-    p = buffer = nasm_malloc(size);
+/* Put back the line terminator overwritten by line_from_file() */
+static inline void src_restore(struct src_buffer *sb)
+{
+    if (sb->cut) {
+        *sb->cut = sb->cutc;
+        sb->cut = NULL;
+    }
+}
 
-    do {
-        c = fgetc(f);
+static void src_close(struct src_buffer *sb)
+{
+    if (!sb)
+        return;
+    src_restore(sb);
+    fclose(sb->fp);
+    nasm_free(sb->alloc);
+    nasm_free(sb->line);
+    nasm_free(sb);
+}
 
-        switch (c) {
-        case EOF:
-            if (p == buffer) {
-                nasm_free(buffer);
-                return NULL;
-            }
-            c = 0;
-            break;
+/*
+ * Characters which need attention when splitting a file into lines.
+ * A NUL ends the line just like a newline does.
+ */
+static inline bool is_line_special(char c)
+{
+    switch (c) {
+    case '\0':
+    case '\n':
+    case '\r':
+    case '\\':
+    case 032:                   /* ^Z = legacy MS-DOS end of file mark */
+        return true;
+    default:
+        return false;
+    }
+}
 
-        case '\r':
-            next = fgetc(f);
-            if (next != '\n')
-                ungetc(next, f);
-            if (cont) {
-                cont = false;
-                continue;
-            }
-            c = 0;
-            break;
+/*
+ * Find the first special character at or after p, eight bytes at a
+ * time; the NUL after the end of the buffer guarantees a match.  A
+ * word with a hit is rescanned a byte at a time, which is exact and
+ * does not depend on the byte order.
+ */
+#define BYTES_ONE  UINT64_C(0x0101010101010101)
+#define BYTES_HIGH UINT64_C(0x8080808080808080)
+#define ZERO_BYTES(x) (((x) - BYTES_ONE) & ~(x) & BYTES_HIGH)
 
-        case '\n':
-            if (cont) {
-                cont = false;
-                continue;
+static inline char *find_line_special(char *p)
+{
+    for (;;) {
+        uint64_t w;
+        int i;
+
+        memcpy(&w, p, sizeof w);
+        if (ZERO_BYTES(w) |
+            ZERO_BYTES(w ^ (BYTES_ONE * '\n')) |
+            ZERO_BYTES(w ^ (BYTES_ONE * '\r')) |
+            ZERO_BYTES(w ^ (BYTES_ONE * '\\')) |
+            ZERO_BYTES(w ^ (BYTES_ONE * 032))) {
+            for (i = 0; i < (int)sizeof w; i++) {
+                if (is_line_special(p[i]))
+                    return p + i;
             }
-            c = 0;
-            break;
+        }
+        p += sizeof w;
+    }
+}
 
-        case 032:               /* ^Z = legacy MS-DOS end of file mark */
-            c = 0;
-            break;
+/*
+ * Append [p, e) to the continued line being built up in sb->line.
+ */
+static void src_append(struct src_buffer *sb, size_t *lenp,
+                       const char *p, const char *e)
+{
+    size_t len = *lenp;
+    size_t need = len + (e - p) + 1;
+
+    if (need > sb->linesize) {
+        sb->linesize = need + (need >> 1) + 256;
+        sb->line = nasm_realloc(sb->line, sb->linesize);
+    }
+    memcpy(sb->line + len, p, e - p);
+    *lenp = len + (e - p);
+}
+
+/*
+ * Read a line from a file. Return NULL on end of file.  The line is
+ * valid until src_restore() is called, which must happen before the
+ * file is read from again.
+ */
+static const char *line_from_file(struct src_buffer *sb)
+{
+    char *p, *e;
+    size_t len = 0;
+    bool cont = false;
+
+    istk->where.lineno += istk->lineskip + istk->lineinc;
+    src_set_linnum(istk->where.lineno);
+    istk->lineskip = 0;
 
-        case '\\':
-            next = fgetc(f);
-            ungetc(next, f);
-            if (next == '\r' || next == '\n') {
-                cont = true;
-                istk->lineskip += istk->lineinc;
+    p = e = sb->pos;
+    for (;;) {
+        e = find_line_special(e);
+        if (*e == '\\') {
+            if (e[1] != '\n' && e[1] != '\r') {
+                e++;            /* Just an ordinary backslash */
                 continue;
             }
-            break;
-        }
 
-        if (p >= (buffer + size - pad)) {
-            buffer = nasm_realloc(buffer, size + delta);
-            p = buffer + size - pad;
-            size += delta;
+            /* Line continuation; drop the backslash and the newline */
+            src_append(sb, &len, p, e);
+            cont = true;
+            istk->lineskip += istk->lineinc;
+            e++;
+            e += (e[0] == '\r' && e[1] == '\n') + 1;
+            p = e;
+            continue;
         }
+        break;
+    }
+
+    if (e >= sb->end) {
+        /* End of file */
+        sb->pos = sb->end;
+        if (p == e && !len)
+            return NULL;
+    } else {
+        sb->pos = e + 1 + (e[0] == '\r' && e[1] == '\n');
+    }
 
-        *p++ = c;
-    } while (c);
+    if (cont) {
+        src_append(sb, &len, p, e);
+        sb->line[len] = '\0';
+        return sb->line;
+    }
 
-    return buffer;
+    sb->cut  = e;
+    sb->cutc = *e;
+    *e = '\0';
+    return p;
 }
 
 /*
  * Common read routine regardless of source
  */
-static char *read_line(void)
+static const char *read_line(void)
 {
-    char *line;
-    FILE *f = istk->fp;
+    const char *line;
 
-    if (f)
-        line = line_from_file(f);
+    if (istk->src)
+        line = line_from_file(istk->src);
     else
         line = line_from_stdmac();
 
@@ -1289,13 +1826,81 @@ static char *read_line(void)
 }
 
 /*
- * Tokenize a line of text. This is a very simple process since we
- * don't need to parse the value out of e.g. numeric tokens: we
- * simply split one string into many.
+ * Inside a non-emitting conditional block, a line only needs to be
+ * tokenized if it may be a condition directive (which affects the
+ * nesting) or a line directive (which is processed regardless), or
+ * if tokenizing it could issue a diagnostic, which takes a quote or
+ * a preprocessor construct outside a comment.  Any other line can
+ * be dropped as it is.
  */
-static Token *tokenize(const char *line)
+static bool cond_skip_line(const char *line)
 {
-    enum token_type type;
+    const char *p;
+
+    if (*line == '#')
+        return false;           /* Possibly a cpp-style line directive */
+
+    p = nasm_skip_spaces(line);
+    if (*p == '%') {
+        char dname[PP_TOKLEN_MAX+1];
+        enum preproc_token op;
+        size_t len = 1;
+
+        while (nasm_isidchar(p[len]))
+            len++;
+        if (len < 2)
+            return false;       /* Some other preprocessor construct */
+
+        op = PP_INVALID;
+        if (len < sizeof dname) {
+            memcpy(dname, p, len);
+            dname[len] = '\0';
+            op = pp_token_hash(dname);
+            if (PP_HAS_CASE(op) & PP_INSENSITIVE(op))
+                op--;
+        }
+        if (op == PP_LINE || is_condition(op))
+            return false;
+
+        p += len;
+    }
+
+    p = strpbrk(p, "%;'\"`");
+    return !p || *p == ';';
+}
+
+/*
+ * Read a line which needs to be tokenized, passing over the ones
+ * which cond_skip_line() says can be ignored.
+ */
+static const char *read_tokline(void)
+{
+    const char *line;
+    bool skipping;
+
+    skipping = istk->conds && !emitting(istk->conds->state) &&
+        !defining && !(ppopt & PP_TASM);
+
+    while ((line = read_line())) {
+        if (!skipping || !cond_skip_line(line))
+            break;
+
+        if (istk->src)
+            src_restore(istk->src);
+        profile_count(PROF_COND_SKIPPED);
+    }
+
+    return line;
+}
+
+/*
+ * Tokenize a line of text. This is a very simple process since we
+ * don't need to parse the value out of e.g. numeric tokens: we
+ * simply split one string into many.
+ */
+static Token *tokenize(const char *line)
+{
+    enum token_type type;
     Token *list = NULL;
     Token *t, **tail = &list;
 
@@ -1687,52 +2292,86 @@ static Token *tokenize(const char *line)
 }
 
 /*
- * Tokens are allocated in blocks to improve speed. Set the blocksize
- * to 0 to use regular nasm_malloc(); this is useful for debugging.
+ * Tokens, and the text of tokens too long to be kept inline, are
+ * allocated from arenas.  Whatever is set up before the first pass
+ * (the command line pre-defines) comes from the session arena;
+ * everything allocated during a pass comes from the pass arena, which
+ * is thrown away as a whole at the end of the pass rather than token
+ * by token.  Freed tokens are reused within a pass, but the space
+ * for long text is only recovered when the arena is reset.
+ *
+ * Set the blocksize to 0 to use regular nasm_malloc() for everything;
+ * this is useful for debugging.
  *
  * alloc_Token() returns a zero-initialized token structure.
  */
 #define TOKEN_BLOCKSIZE 4096
+#define TEXT_CHUNKSIZE  65536
 
 #if TOKEN_BLOCKSIZE
 
-static Token *freeTokens  = NULL;
-static Token *tokenblocks = NULL;
+struct text_chunk {
+    struct text_chunk *next;
+};
 
-static Token *alloc_Token(void)
-{
-    Token *t = freeTokens;
+struct token_arena {
+    Token *blocks;              /* Token blocks, in order of use */
+    Token *block;               /* Block currently being handed out */
+    size_t used;                /* Entries used in the current block */
+    Token *free;                /* Freed tokens */
+    struct text_chunk *chunks;  /* Text chunks, in order of use */
+    struct text_chunk *chunk;   /* Chunk currently being handed out */
+    size_t textused;            /* Bytes used in the current chunk */
+    struct text_chunk *large;   /* Text too big to share a chunk */
+    size_t inuse;               /* Bytes of blocks and chunks in use */
+};
 
-    if (unlikely(!t)) {
-        Token *block;
-        size_t i;
+static struct token_arena session_arena, pass_arena;
+static struct token_arena *arena = &session_arena;
 
-        nasm_newn(block, TOKEN_BLOCKSIZE);
+/* Memory in use by the token arenas */
+static size_t token_memory;
 
-        /*
-         * The first entry in each array are a linked list of
-         * block allocations and is not used for data.
-         */
-        block[0].next = tokenblocks;
-	block[0].type = TOKEN_BLOCK;
-        tokenblocks = block;
+static void token_memory_add(struct token_arena *a, size_t bytes)
+{
+    a->inuse += bytes;
+    token_memory += bytes;
+    profile_peak(PROF_TOKEN_MEMORY, token_memory);
+}
 
-        /*
-         * Add the rest to the free list
-         */
-        for (i = 2; i < TOKEN_BLOCKSIZE - 1; i++)
-            block[i].next = &block[i+1];
+static Token *alloc_Token(void)
+{
+    struct token_arena *a = arena;
+    Token *t = a->free;
 
-        freeTokens = &block[2];
+    profile_count(PROF_TOKENS);
 
-        /*
-         * Return the topmost usable token
-         */
-        return &block[1];
+    if (t) {
+        a->free = t->next;
+    } else {
+        if (unlikely(!a->block || a->used >= TOKEN_BLOCKSIZE)) {
+            Token *block = a->block ? a->block[0].next : a->blocks;
+
+            if (!block) {
+                /*
+                 * The first entry in each block links the blocks
+                 * together and is not used for data.
+                 */
+                nasm_newn(block, TOKEN_BLOCKSIZE);
+                block[0].type = TOKEN_BLOCK;
+                if (a->block)
+                    a->block[0].next = block;
+                else
+                    a->blocks = block;
+            }
+            a->block = block;
+            a->used  = 1;
+            token_memory_add(a, TOKEN_BLOCKSIZE * sizeof(Token));
+        }
+        t = &a->block[a->used++];
     }
 
-    freeTokens = t->next;
-    t->next = NULL;
+    nasm_zero(*t);
     return t;
 }
 
@@ -1743,22 +2382,122 @@ static Token *delete_Token(Token *t)
     nasm_assert(t && t->type != TOKEN_FREE);
 
     next = t->next;
-    nasm_zero(*t);
     t->type = TOKEN_FREE;
-    t->next = freeTokens;
-    freeTokens = t;
+    t->next = arena->free;
+    arena->free = t;
 
     return next;
 }
 
-static void delete_Blocks(void)
+/*
+ * Allocate space for the text of a token, including the final null.
+ */
+static char *alloc_text(size_t size)
+{
+    struct token_arena *a = arena;
+    struct text_chunk *c;
+
+    if (size > TEXT_CHUNKSIZE/8) {
+        c = nasm_malloc(sizeof *c + size);
+        c->next = a->large;
+        a->large = c;
+        token_memory_add(a, sizeof *c + size);
+        return (char *)(c + 1);
+    }
+
+    if (unlikely(!a->chunk || a->textused + size > TEXT_CHUNKSIZE)) {
+        c = a->chunk ? a->chunk->next : a->chunks;
+        if (!c) {
+            c = nasm_malloc(sizeof *c + TEXT_CHUNKSIZE);
+            c->next = NULL;
+            if (a->chunk)
+                a->chunk->next = c;
+            else
+                a->chunks = c;
+        }
+        a->chunk    = c;
+        a->textused = 0;
+        token_memory_add(a, sizeof *c + TEXT_CHUNKSIZE);
+    }
+
+    a->textused += size;
+    return (char *)(a->chunk + 1) + a->textused - size;
+}
+
+/* Text is only released together with its arena */
+static inline void free_text(Token *t)
+{
+    (void)t;
+}
+
+static void free_text_chunks(struct text_chunk *list)
+{
+    struct text_chunk *c, *tmp;
+
+    list_for_each_safe(c, tmp, list)
+        nasm_free(c);
+}
+
+/*
+ * Make all the memory in an arena available again.  If keep is set,
+ * hold on to the memory for the next user of the arena, otherwise
+ * give it back.
+ */
+static void reset_arena(struct token_arena *a, bool keep)
+{
+    free_text_chunks(a->large);
+
+    if (!keep) {
+        Token *block, *blocktmp;
+
+        list_for_each_safe(block, blocktmp, a->blocks)
+            nasm_free(block);
+        free_text_chunks(a->chunks);
+        a->blocks = NULL;
+        a->chunks = NULL;
+    }
+
+    token_memory -= a->inuse;
+    a->inuse    = 0;
+    a->block    = NULL;
+    a->used     = 0;
+    a->free     = NULL;
+    a->chunk    = NULL;
+    a->textused = 0;
+    a->large    = NULL;
+}
+
+/*
+ * Switch to the pass arena, for the duration of a pass.
+ */
+static void begin_pass_tokens(void)
+{
+    arena = &pass_arena;
+}
+
+/*
+ * Throw away everything allocated during the pass.  The token lists
+ * hanging off the macro tables and so on are not walked at all;
+ * teardown runs between begin_discard_tokens() and
+ * end_pass_tokens(), and it only needs to free the other data.
+ */
+static void begin_discard_tokens(void)
 {
-    Token *block, *blocktmp;
+    discarding_tokens = arena == &pass_arena;
+}
 
-    list_for_each_safe(block, blocktmp, tokenblocks)
-        nasm_free(block);
+static void end_pass_tokens(void)
+{
+    discarding_tokens = false;
+    reset_arena(&pass_arena, true);
+    arena = &session_arena;
+}
 
-    freeTokens = tokenblocks = NULL;
+static void delete_Blocks(bool keep)
+{
+    reset_arena(&pass_arena, keep);
+    reset_arena(&session_arena, keep);
+    arena = &session_arena;
 }
 
 #else
@@ -1767,21 +2506,49 @@ static inline Token *alloc_Token(void)
 {
     Token *t;
     nasm_new(*t);
+    profile_count(PROF_TOKENS);
     return t;
 }
 
+static inline char *alloc_text(size_t size)
+{
+    return nasm_malloc(size);
+}
+
+static inline void free_text(Token *t)
+{
+    if (t->len > INLINE_TEXT)
+        nasm_free(t->text.p.ptr);
+}
+
 static Token *delete_Token(Token *t)
 {
     Token *next = t->next;
+    free_text(t);
     nasm_free(t);
     return next;
 }
 
-static inline void delete_Blocks(void)
+static inline void begin_pass_tokens(void)
+{
+    /* Nothing to do */
+}
+
+static inline void begin_discard_tokens(void)
+{
+    /* Nothing to do */
+}
+
+static inline void end_pass_tokens(void)
 {
     /* Nothing to do */
 }
 
+static inline void delete_Blocks(bool keep)
+{
+    (void)keep;
+}
+
 #endif
 
 /*
@@ -1807,7 +2574,7 @@ static Token *new_Token(Token * next, enum token_type type,
 
         if (text) {
             textp = (txtlen > INLINE_TEXT)
-                ? (t->text.p.ptr = nasm_malloc(txtlen+1)) : t->text.a;
+                ? (t->text.p.ptr = alloc_text(txtlen+1)) : t->text.a;
             memcpy(textp, text, txtlen);
             textp[txtlen] = '\0';   /* In case we needed malloc() */
         } else {
@@ -1818,17 +2585,19 @@ static Token *new_Token(Token * next, enum token_type type,
              * the buffer is filled and before the token is added
              * to any line lists.
              */
-            if (txtlen > INLINE_TEXT)
-                t->text.p.ptr = nasm_zalloc(txtlen+1);
+            if (txtlen > INLINE_TEXT) {
+                t->text.p.ptr = alloc_text(txtlen+1);
+                memset(t->text.p.ptr, 0, txtlen+1);
+            }
         }
     }
     return t;
 }
 
 /*
- * Same as new_Token(), but text belongs to the new token and is
- * either taken over or freed.  This function MUST be called
- * with valid txt and txtlen, unlike new_Token().
+ * Same as new_Token(), but text is a nasm_malloc()'d string which
+ * is freed.  This function MUST be called with valid txt and txtlen,
+ * unlike new_Token().
  */
 static Token *new_Token_free(Token * next, enum token_type type,
                              char *text, size_t txtlen)
@@ -1841,10 +2610,12 @@ static Token *new_Token_free(Token * next, enum token_type type,
 
     if (txtlen <= INLINE_TEXT) {
         memcpy(t->text.a, text, txtlen);
-        free(text);
     } else {
-        t->text.p.ptr = text;
+        t->text.p.ptr = alloc_text(txtlen+1);
+        memcpy(t->text.p.ptr, text, txtlen);
+        t->text.p.ptr[txtlen] = '\0';
     }
+    nasm_free(text);
 
     return t;
 }
@@ -1857,7 +2628,7 @@ static Token *dup_Token(Token *next, const Token *src)
     t->next = next;
 
     if (t->len > INLINE_TEXT) {
-        t->text.p.ptr = nasm_malloc(t->len + 1);
+        t->text.p.ptr = alloc_text(t->len + 1);
         memcpy(t->text.p.ptr, src->text.p.ptr, t->len+1);
     }
 
@@ -2015,9 +2786,24 @@ static int ppscan(void *private_data, struct tokenval *tokval)
     default:
         return tokval->t_type = tline->type;
 
+    case TOKEN_HERE:
+    case TOKEN_BASE:
+        /* The value of $ and $$ can change between passes */
+        pp_cache_invalidate();
+        return tokval->t_type = tline->type;
+
     case TOKEN_ID:
         /* This could be an assembler keyword */
-	return nasm_token_hash(txt, tokval);
+	switch (nasm_token_hash(txt, tokval)) {
+        case TOKEN_ID:
+        case TOKEN_INSN:
+            /* A symbol reference; its value can change between passes */
+            pp_cache_invalidate();
+            break;
+        default:
+            break;
+        }
+        return tokval->t_type;
 
     case TOKEN_NUM:
     {
@@ -2196,6 +2982,7 @@ static FILE *inc_fopen_search(const char *file, char **slpath,
             return fp;
         }
 
+        strlist_add(search_misses, sp);
         nasm_free(sp);
 
         if (!ip) {
@@ -2216,8 +3003,113 @@ struct file_hash_entry {
     const char *path;
     struct file_hash_entry *full; /* Hash entry for the full path */
     int64_t include_pass; /* Pass in which last included (for %require) */
+    char *guard;          /* Include guard macro, if known to have one */
+    uint64_t session;     /* Session in which path was last searched for */
 };
 
+/*
+ * With PP_RESIDENT, FileHash is kept from one session to the next as
+ * long as the working directory stays the same.  A search result
+ * from an earlier session is checked again the first time it is used:
+ * the file must still exist and none of the names before it in the
+ * (possibly different) include path may have appeared since.  Files
+ * which were not found are searched for again.
+ */
+static struct file_hash_entry file_not_searched;
+static uint64_t file_hash_session;
+static char *file_hash_cwd;
+static bool file_hash_checked;
+
+static void file_hash_free(void)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+
+    hash_for_each(&FileHash, it, np) {
+        struct file_hash_entry *fhe = np->data;
+
+        nasm_free((void *)np->key);
+        if (fhe && fhe != &file_not_searched) {
+            nasm_free((void *)fhe->path);
+            nasm_free(fhe->guard);
+            nasm_free(fhe);
+        }
+    }
+    hash_free(&FileHash);
+}
+
+static void file_hash_new_session(void)
+{
+    struct hash_iterator it;
+    const struct hash_node *cnp;
+    char *cwd = nasm_realpath(".");
+
+    file_hash_session++;
+
+    if (!file_hash_cwd || strcmp(cwd, file_hash_cwd)) {
+        file_hash_free();
+        nasm_free(file_hash_cwd);
+        file_hash_cwd = cwd;
+        return;
+    }
+    nasm_free(cwd);
+
+    hash_for_each(&FileHash, it, cnp) {
+        struct hash_node *np = (struct hash_node *)cnp;
+        struct file_hash_entry *fhe = np->data;
+
+        if (!fhe) {
+            np->data = &file_not_searched;
+        } else if (fhe != &file_not_searched) {
+            /* The file may have been changed */
+            fhe->include_pass = 0;
+            nasm_delete(fhe->guard);
+        }
+    }
+}
+
+/*
+ * Is a search result from an earlier session still what a search
+ * would find now?  If so, it counts as searched in this session.
+ */
+static bool inc_still_found(const char *file, struct file_hash_entry *fhe,
+                            struct strlist *dhead)
+{
+    const struct strlist_entry *ip = strlist_head(ipath_list);
+    const char *prefix = "";
+    bool found = false;
+    char *sp;
+
+    if (!fhe || fhe->session == file_hash_session)
+        return true;
+
+    while (1) {
+        sp = nasm_catfile(prefix, file);
+        if (!strcmp(sp, fhe->path)) {
+            found = nasm_file_exists(sp);
+            nasm_free(sp);
+            break;
+        }
+        if (nasm_file_exists(sp)) {
+            nasm_free(sp);     /* Now shadows the file found before */
+            break;
+        }
+        strlist_add(search_misses, sp);
+        nasm_free(sp);
+
+        if (!ip)
+            break;
+        prefix = ip->str;
+        ip = ip->next;
+    }
+
+    if (found) {
+        fhe->session = file_hash_session;
+        strlist_add(dhead, fhe->path);
+    }
+    return found;
+}
+
 static FILE *inc_fopen(const char *file,
                        struct strlist *dhead,
                        const char **found_path,
@@ -2233,7 +3125,8 @@ static FILE *inc_fopen(const char *file,
     bool skip_open = (omode == INC_PROBE);
 
     fhep = (struct file_hash_entry **)hash_find(&FileHash, file, &hi);
-    if (fhep) {
+    if (fhep && *fhep != &file_not_searched &&
+        inc_still_found(file, *fhep, dhead)) {
         fhe = *fhep;
         if (fhe) {
             path = fhe->path;
@@ -2251,8 +3144,20 @@ static FILE *inc_fopen(const char *file,
             nasm_new(fhe);
             fhe->path = path;
             fhe->full = fhe;    /* It is *possible*... */
+            fhe->session = file_hash_session;
+        }
+        if (fhep) {
+            /* Only an entry which is its own ->full can be shared */
+            struct file_hash_entry *old = *fhep;
+            if (old && old != &file_not_searched && old->full != old) {
+                nasm_free((void *)old->path);
+                nasm_free(old->guard);
+                nasm_free(old);
+            }
+            *fhep = fhe;
+        } else {
+            hash_add(&hi, nasm_strdup(file), fhe);
         }
-        hash_add(&hi, nasm_strdup(file), fhe);
 
         /*
          * Add a hash entry for the canonical path if there isn't one
@@ -2271,14 +3176,18 @@ static FILE *inc_fopen(const char *file,
                 fullp = (struct file_hash_entry **)
                     hash_find(&FileHash, fullpath, &hi);
 
-                if (fullp) {
+                if (fullp && *fullp && *fullp != &file_not_searched) {
                     full = *fullp;
                     nasm_free(fullpath);
                 } else {
                     nasm_new(full);
                     full->path = fullpath;
                     full->full = full;
-                    hash_add(&hi, path, full);
+                    full->session = file_hash_session;
+                    if (fullp)
+                        *fullp = full;
+                    else
+                        hash_add(&hi, nasm_strdup(path), full);
                 }
                 fhe->full = full;
             }
@@ -2370,6 +3279,92 @@ restart:
     return false;
 }
 
+/*
+ * Include guard handling; see enum include_guard.
+ */
+
+/* The full path hash entry for a file opened by %include `file' */
+static struct file_hash_entry *inc_file_entry(const char *file)
+{
+    struct file_hash_entry **fhep;
+
+    fhep = (struct file_hash_entry **)hash_find(&FileHash, file, NULL);
+    if (!fhep || !*fhep || *fhep == &file_not_searched)
+        return NULL;
+    return (*fhep)->full;
+}
+
+/* Is the macro defined, in the sense of %ifdef? */
+static bool guard_defined(const char *name)
+{
+    SMacro *smac;
+
+    return smacro_defined(NULL, name, -1, &smac, true, false) &&
+        smac && !smac->alias;
+}
+
+/*
+ * Would including this file again do nothing at all, not even
+ * anything that shows in the listing, the debug information or
+ * the preprocessed output?  The debug backends see every change
+ * of source location, so only skip when none is active.
+ */
+static bool inc_guarded(const struct file_hash_entry *fhe)
+{
+    return fhe && fhe->guard && guard_defined(fhe->guard) &&
+        pp_mode != PP_PREPROC && dfmt == &null_debug_form &&
+        (istk->nolist || !list_active()) &&
+        (istk->noline || !(ppdbg & PDBG_INCLUDE));
+}
+
+/* Track the guard state of the current file for a non-blank line */
+static void guard_line(Token *tline)
+{
+    Token *t;
+
+    switch (istk->guard) {
+    case GUARD_START:
+        istk->guard = GUARD_NONE;
+        t = skip_white(tline);
+        if (defining || !tok_is(t, TOKEN_PREPROC_ID) ||
+            pp_token_hash(tok_text(t)) != PP_IFNDEF)
+            break;
+        t = skip_white(t->next);
+        if (!tok_is(t, TOKEN_ID) || skip_white(t->next))
+            break;
+        istk->guard = GUARD_OPEN;
+        istk->guard_name = nasm_strdup(tok_text(t));
+        break;
+
+    case GUARD_OPEN:
+        if (!istk->guard_cond) {
+            /* The %ifndef has been processed by now */
+            istk->guard_cond = istk->conds;
+            if (!istk->conds || istk->conds->next)
+                istk->guard = GUARD_NONE;
+        } else if (!istk->conds) {
+            /* Something after the %endif */
+            istk->guard = GUARD_NONE;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Record the guard of a file which has been read to the end */
+static void guard_end(Include *i)
+{
+    if (i->guard == GUARD_OPEN && i->guard_cond && !i->conds &&
+        i->guard_errors == nasm_error_count) {
+        nasm_free(i->file->guard);
+        i->file->guard = i->guard_name;
+        i->guard_name = NULL;
+    }
+    nasm_free(i->guard_name);
+}
+
 /* param should be a natural number [0; INT_MAX] */
 static int read_param_count(const char *str)
 {
@@ -3120,6 +4115,8 @@ static SMacro *define_smacro(const char *mname, bool casesense,
         /* Create a new macro */
         smtbl  = ctx ? &ctx->localmac : &smacros;
         smhead = (SMacro **) hash_findi_add(smtbl, mname);
+        if (!ctx)
+            smacro_filter_add(mname);
         nasm_new(smac);
         smac->next = *smhead;
         *smhead = smac;
@@ -3127,7 +4124,9 @@ static SMacro *define_smacro(const char *mname, bool casesense,
 
     smac->name      = nasm_strdup(mname);
     smac->casesense = casesense;
+    smac->timestamp = !ctx && is_timestamp_macro(mname);
     smac->expansion = reverse_tokens(expansion);
+    intern_tlist(smac->expansion);
     smac->expand    = smacro_expand_default;
     smac->nparam    = nparam;
     if (tmpl) {
@@ -3586,6 +4585,7 @@ static int do_directive(Token *tline, Token **output)
     const char *mname;
     struct ppscan pps;
     Include *inc;
+    FILE *fp;
     Context *ctx;
     Cond *cond;
     MMacro *mmac, **mmhead;
@@ -3990,7 +4990,9 @@ static int do_directive(Token *tline, Token **output)
         if (t->next)
             nasm_warn(WARN_OTHER, "trailing garbage after `%s' ignored", dname);
 
-        strlist_add(deplist, unquote_token_cstr(t));
+        p = unquote_token_cstr(t);
+        strlist_add(deplist, p);
+        pp_snapshot_file(p, NULL, true);
         goto done;
 
     case PP_INCLUDE:
@@ -4006,17 +5008,25 @@ static int do_directive(Token *tline, Token **output)
         if (t->next)
             nasm_warn(WARN_OTHER, "trailing garbage after `%s' ignored", dname);
         p = unquote_token_cstr(t);
-        nasm_new(inc);
-        inc->next = istk;
+        if (inc_guarded(inc_file_entry(p))) {
+            /* It would be skipped in its entirety */
+            profile_count(PROF_GUARDED_INCLUDES);
+            break;
+        }
         found_path = NULL;
-        inc->fp = inc_fopen(p, deplist, &found_path,
-                            (pp_mode == PP_DEPS) ? INC_OPTIONAL :
-                            (op == PP_REQUIRE) ? INC_REQUIRED :
-                            INC_NEEDED, NF_TEXT);
-        if (!inc->fp) {
-            /* -MG given but file not found, or repeated %require */
-            nasm_free(inc);
-        } else {
+        fp = inc_fopen(p, deplist, &found_path,
+                       (pp_mode == PP_DEPS) ? INC_OPTIONAL :
+                       (op == PP_REQUIRE) ? INC_REQUIRED :
+                       INC_NEEDED, NF_TEXT);
+        /* No file if -MG given but file not found, or repeated %require */
+        if (fp) {
+            pp_snapshot_file(p, found_path ? found_path : p, false);
+            nasm_new(inc);
+            inc->next    = istk;
+            inc->src     = src_open(fp, found_path ? found_path : p);
+            inc->file    = inc_file_entry(p);
+            inc->guard   = inc->file ? GUARD_START : GUARD_NONE;
+            inc->guard_errors = nasm_error_count;
             inc->nolist  = istk->nolist;
             inc->noline  = istk->noline;
             inc->where   = istk->where;
@@ -4164,6 +5174,8 @@ issue_error:
     CASE_PP_ELIF:
         if (!istk->conds)
             nasm_fatal("`%s': no matching `%%if'", dname);
+        if (istk->conds == istk->guard_cond)
+            istk->guard = GUARD_NONE;
         switch(istk->conds->state) {
         case COND_IF_TRUE:
             istk->conds->state = COND_DONE;
@@ -4202,6 +5214,8 @@ issue_error:
                        "trailing garbage after `%%else' ignored");
         if (!istk->conds)
 	    nasm_fatal("`%%else: no matching `%%if'");
+        if (istk->conds == istk->guard_cond)
+            istk->guard = GUARD_NONE;
         switch(istk->conds->state) {
         case COND_IF_TRUE:
         case COND_DONE:
@@ -4284,6 +5298,8 @@ issue_error:
             nasm_nonfatal("`%s': not defining a macro", tok_text(tline));
             goto done;
         }
+        intern_mmacro(defining);
+        compile_mmacro(defining);
         mmhead = (MMacro **) hash_findi_add(&mmacros, defining->name);
         defining->next = *mmhead;
         *mmhead = defining;
@@ -4477,6 +5493,8 @@ issue_error:
          * continues) until the whole expansion is forcibly removed
          * from istk->expansion by a %exitrep.
          */
+        intern_mmacro(defining);
+
         nasm_new(l);
         l->next = istk->expansion;
         l->finishes = defining;
@@ -5184,6 +6202,25 @@ err:
  * %-n) and MMacro-local identifiers (%%foo) as well as
  * macro indirection (%[...]) and range (%{..:..}).
  */
+/*
+ * Paste tokens together after substituting macro parameters
+ */
+static void paste_mmac_params(Token **head)
+{
+    static const struct concat_mask t[] = {
+        {
+            CONCAT_ID | CONCAT_FLOAT,   /* head */
+            CONCAT_ID | CONCAT_NUM | CONCAT_FLOAT | CONCAT_OP /* tail */
+        },
+        {
+            CONCAT_NUM,     /* head */
+            CONCAT_NUM      /* tail */
+        }
+    };
+
+    paste_tokens(head, t, ARRAY_SIZE(t), false);
+}
+
 static Token *expand_mmac_params(Token * tline)
 {
     Token **tail, *thead;
@@ -5372,47 +6409,209 @@ static Token *expand_mmac_params(Token * tline)
 
     *tail = NULL;
 
-    if (changed) {
-        const struct concat_mask t[] = {
-            {
-                CONCAT_ID | CONCAT_FLOAT,   /* head */
-                CONCAT_ID | CONCAT_NUM | CONCAT_FLOAT | CONCAT_OP /* tail */
-            },
-            {
-                CONCAT_NUM,     /* head */
-                CONCAT_NUM      /* tail */
-            }
-        };
-        paste_tokens(&thead, t, ARRAY_SIZE(t), false);
-    }
+    if (changed)
+        paste_mmac_params(&thead);
 
     return thead;
 }
 
-static Token *expand_smacro_noreset(Token * tline);
-
 /*
- * Expand *one* single-line macro instance. If the first token is not
- * a macro at all, it is simply copied to the output and the pointer
- * advanced.  tpp should be a pointer to a pointer (usually the next
- * pointer of the previous token) to the first token. **tpp is updated
- * to point to the first token of the expansion, and *tpp updated to
- * point to the next pointer of the last token of the expansion.
+ * Compile the body of a newly defined multi-line macro: record for
+ * each line where the parameters, %0, %?, %?? and macro-local labels
+ * go, so expand_mmacro() can splice them in while copying the line,
+ * rather than leaving expand_mmac_params() to look for them when the
+ * line is read back.
  *
- * If the expansion is empty, *tpp will be unchanged but **tpp will
- * be advanced past the macro call.
- *
- * Return the macro expanded, or NULL if no expansion took place.
+ * Doing the substitution early must not change the result, so the
+ * macro must not be recursive, must not %rotate its parameters and
+ * must not define other macros, whose bodies would be substituted
+ * into.  A line with a substitution which may issue a diagnostic, or
+ * depends on anything but the parameters, is left to
+ * expand_mmac_params().
  */
-static SMacro *expand_one_smacro(Token ***tpp)
+static void compile_mmac_line(Line *l)
 {
-    Token **params = NULL;
-    const char *mname;
-    Token *mstart = **tpp;
-    Token *tline  = mstart;
-    SMacro *head, *m;
-    int i;
-    Token *t, *tup, *tafter;
+    const Token *t;
+    struct mmac_slot *slot;
+    unsigned int pos, nslots;
+
+    nslots = 0;
+    list_for_each(t, l->first) {
+        switch (t->type) {
+        case TOKEN_MMACRO_PARAM:
+        case TOKEN_LOCAL_SYMBOL:
+        case TOKEN_PREPROC_Q:
+        case TOKEN_PREPROC_QQ:
+            nslots++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (nslots)
+        nasm_newn(l->slots, nslots);
+    slot = l->slots;
+
+    pos = 0;
+    list_for_each(t, l->first) {
+        const char *text = tok_text(t);
+        unsigned long n;
+        char *ep;
+
+        switch (t->type) {
+        case TOKEN_MMACRO_PARAM:
+            if (text[1] == '0' && !text[2]) {
+                slot->type = MSLOT_NPARAM;
+                break;
+            }
+            if (!nasm_isdigit(text[1]) ||
+                (text[1] == '0' && (text[2] != '0' || text[3])))
+                goto lazy;      /* Range, condition code or invalid */
+            n = strtoul(text + 1, &ep, 10);
+            if (*ep || n > UINT_MAX)
+                goto lazy;
+            slot->type = MSLOT_PARAM;
+            slot->n = n;
+            break;
+        case TOKEN_LOCAL_SYMBOL:
+            slot->type = MSLOT_LOCAL;
+            break;
+        case TOKEN_PREPROC_Q:
+            slot->type = MSLOT_INAME;
+            break;
+        case TOKEN_PREPROC_QQ:
+            slot->type = MSLOT_NAME;
+            break;
+        default:
+            pos++;
+            continue;
+        }
+        slot->pos = pos++;
+        slot++;
+    }
+
+    l->nslots = nslots;
+    l->compiled = true;
+    return;
+
+lazy:
+    nasm_delete(l->slots);
+}
+
+static void compile_mmacro(MMacro *m)
+{
+    Line *l;
+    const Token *t;
+    enum preproc_token op;
+
+    if (m->max_depth || (ppopt & PP_TASM))
+        return;
+
+    list_for_each(l, m->expansion) {
+        list_for_each(t, l->first) {
+            if (t->type == TOKEN_INDIRECT)
+                return;
+            if (t->type != TOKEN_PREPROC_ID)
+                continue;
+
+            op = pp_token_hash(tok_text(t));
+            if (PP_HAS_CASE(op) & PP_INSENSITIVE(op))
+                op--;
+            if (op == PP_ROTATE || op == PP_MACRO || op == PP_RMACRO)
+                return;
+        }
+    }
+
+    list_for_each(l, m->expansion)
+        compile_mmac_line(l);
+    m->compiled = true;
+}
+
+/*
+ * Copy a compiled macro body line, splicing in the substitutions for
+ * the current expansion of the macro.
+ */
+static Token *splice_mmac_line(const Line *l, const MMacro *mac)
+{
+    Token *thead = NULL, **tail = &thead;
+    const struct mmac_slot *slot = l->slots;
+    const struct mmac_slot *send = slot + l->nslots;
+    const Token *t;
+    unsigned int pos = 0;
+    unsigned int n;
+    char *text;
+
+    list_for_each(t, l->first) {
+        if (slot == send || slot->pos != pos++) {
+            *tail = dup_Token(NULL, t);
+            tail = &(*tail)->next;
+            continue;
+        }
+
+        switch (slot->type) {
+        case MSLOT_PARAM:
+            n = slot->n;
+            if (n <= mac->nparam) {
+                n = mmac_rotate(mac, n);
+                dup_tlistn(mac->params[n], mac->paramlen[n], &tail);
+            }
+            break;
+        case MSLOT_NPARAM:
+            text = nasm_asprintf("%d", mac->nparam);
+            *tail = new_Token_free(NULL, TOKEN_NUM, text, strlen(text));
+            tail = &(*tail)->next;
+            break;
+        case MSLOT_LOCAL:
+            text = nasm_asprintf("..@%"PRIu64".%s", mac->unique,
+                                 tok_text(t) + 2);
+            *tail = new_Token_free(NULL, TOKEN_ID, text, strlen(text));
+            tail = &(*tail)->next;
+            break;
+        case MSLOT_INAME:
+            *tail = new_Token(NULL, TOKEN_ID, mac->iname, 0);
+            tail = &(*tail)->next;
+            break;
+        case MSLOT_NAME:
+            *tail = new_Token(NULL, TOKEN_ID, mac->name, 0);
+            tail = &(*tail)->next;
+            break;
+        }
+        slot++;
+    }
+
+    *tail = NULL;
+
+    if (l->nslots)
+        paste_mmac_params(&thead);
+
+    return thead;
+}
+
+static Token *expand_smacro_noreset(Token * tline);
+
+/*
+ * Expand *one* single-line macro instance. If the first token is not
+ * a macro at all, it is simply copied to the output and the pointer
+ * advanced.  tpp should be a pointer to a pointer (usually the next
+ * pointer of the previous token) to the first token. **tpp is updated
+ * to point to the first token of the expansion, and *tpp updated to
+ * point to the next pointer of the last token of the expansion.
+ *
+ * If the expansion is empty, *tpp will be unchanged but **tpp will
+ * be advanced past the macro call.
+ *
+ * Return the macro expanded, or NULL if no expansion took place.
+ */
+static SMacro *expand_one_smacro(Token ***tpp)
+{
+    Token **params = NULL;
+    const char *mname;
+    Token *mstart = **tpp;
+    Token *tline  = mstart;
+    SMacro *head, *m;
+    int i;
+    Token *t, *tup, *tafter;
     int nparam = 0;
     bool cond_comma;
 
@@ -5431,7 +6630,11 @@ static SMacro *expand_one_smacro(Token ***tpp)
         }
         goto not_a_macro;
     } else if (tline->type == TOKEN_ID || tline->type == TOKEN_PREPROC_ID) {
-        head = (SMacro *)hash_findix(&smacros, mname);
+        if (likely(!smacro_filter_test(mstart))) {
+            profile_count(PROF_SMACRO_FILTERED);
+            goto not_a_macro;
+        }
+        head = (SMacro *)hash_findix_tok(&smacros, mstart);
     } else if (tline->type == TOKEN_LOCAL_MACRO) {
         Context *ctx = get_ctx(mname, &mname);
         head = ctx ? (SMacro *)hash_findix(&ctx->localmac, mname) : NULL;
@@ -5566,6 +6769,9 @@ static SMacro *expand_one_smacro(Token ***tpp)
 
     /* Expand the macro */
     m->in_progress = true;
+    profile_count(PROF_SMACROS);
+    if (m->timestamp)
+        mark_volatile();
 
     if (nparam) {
         /* Extract parameters */
@@ -5722,6 +6928,8 @@ static SMacro *expand_one_smacro(Token ***tpp)
     }
 
     /* Note: we own the expansion this returns. */
+    if (unlikely(m == ppsnap.pass_macro))
+        pp_snapshot_reject();   /* Differs between passes */
     t = m->expand(m, params, nparam);
 
     tafter = tline->next;   /* Skip past the macro call */
@@ -6109,7 +7317,7 @@ static MMacro *is_mmacro(Token * tline, int *nparamp, Token ***paramsp)
     *nparamp = 0;
     *paramsp = NULL;
 
-    head = (MMacro *) hash_findix(&mmacros, finding);
+    head = (MMacro *) hash_findix_tok(&mmacros, tline);
 
     /*
      * Efficiency: first we see if any macro exists with the given
@@ -6525,11 +7733,42 @@ static void debug_macro_output(void)
  * there is one to be expanded. If there is, push the expansion on
  * istk->expansion and return 1. Otherwise return 0.
  */
+/*
+ * Can the parameters be spliced into the compiled body of this
+ * macro as it is expanded?  The body lines are listed as they are
+ * read, before substitution, so not if they would be listed; and not
+ * if any parameter contains a preprocessor token, which could make
+ * a directive out of a line, or be substituted into again.
+ */
+static bool mmacro_can_splice(const MMacro *m)
+{
+    const Token *t;
+    unsigned int i;
+
+    if (!m->compiled)
+        return false;
+
+    if (list_active() && !istk->nolist && !(m->nolist & NL_LIST))
+        return false;
+
+    for (i = 0; i <= m->nparam; i++) {
+        int cnt = m->paramlen[i];
+
+        for (t = m->params[i]; t && cnt--; t = t->next) {
+            if (t->type >= TOKEN_START_PP)
+                return false;
+        }
+    }
+
+    return true;
+}
+
 static int expand_mmacro(Token * tline)
 {
     Token *startline = tline;
     Token *label = NULL;
     bool dont_prepend = false;
+    bool splice;
     Token **params, *t, *tt;
     MMacro *m;
     Line *l, *ll;
@@ -6580,6 +7819,7 @@ static int expand_mmacro(Token * tline)
 
     mmacro_deadman.total++;
     mmacro_deadman.levels++;
+    profile_count(PROF_MMACROS);
 
     /*
      * Fix up the parameters: this involves stripping leading and
@@ -6679,42 +7919,45 @@ static int expand_mmacro(Token * tline)
     m->mstk = istk->mstk;
     istk->mstk.mstk = istk->mstk.mmac = m;
 
+    /*
+     * If we had a label, and this macro contains an %00 parameter,
+     * save the value as a special parameter (which is what it is).
+     */
+    if (label && m->capture_label) {
+        params[0] = dup_Token(NULL, label);
+        paramlen[0] = 1;
+        free_tlist(startline);
+    }
+
+    splice = mmacro_can_splice(m);
     list_for_each(l, m->expansion) {
         nasm_new(ll);
         ll->next = istk->expansion;
         istk->expansion = ll;
-        ll->first = dup_tlist(l->first, NULL);
+        if (splice && l->compiled) {
+            ll->first = splice_mmac_line(l, m);
+            ll->spliced = true;
+        } else {
+            ll->first = dup_tlist(l->first, NULL);
+        }
         ll->where = l->where;
     }
 
     /*
      * If we had a label, and this macro definition does not include
-     * a %00, push it on as the first line of, ot
-     * the macro expansion.
+     * a %00, push it on as the first line of the macro expansion.
      */
-    if (label) {
-        /*
-         * We had a label. If this macro contains an %00 parameter,
-         * save the value as a special parameter (which is what it
-         * is), otherwise push it as the first line of the macro
-         * expansion.
-         */
-        if (m->capture_label) {
-            params[0] = dup_Token(NULL, label);
-            paramlen[0] = 1;
-            free_tlist(startline);
-       } else {
-            nasm_new(ll);
-            ll->finishes = NULL;
-            ll->next = istk->expansion;
-            istk->expansion = ll;
-            ll->first = startline;
-            ll->where = istk->where;
-            if (!dont_prepend) {
-                while (label->next)
-                    label = label->next;
-                label->next = tt = make_tok_char(NULL, ':');
-            }
+    if (label && !m->capture_label) {
+        nasm_new(ll);
+        ll->finishes = NULL;
+        ll->next = istk->expansion;
+        istk->expansion = ll;
+        ll->first = startline;
+        ll->where = istk->where;
+        if (!dont_prepend) {
+            while (label->next)
+                label = label->next;
+            label->next = tt = make_tok_char(NULL, ':');
         }
     }
 
@@ -6757,6 +8000,17 @@ bool pp_suppress_error(errflags severity)
 	 !emitting(istk->conds->state)))
         return true;
 
+    /*
+     * A diagnostic issued while preprocessing would not be repeated
+     * if the output of this pass were replayed.  Pass-2 messages are
+     * dropped in all but the final pass, which is never replayed.
+     */
+    if (ppcache.in_getline && !(severity & ERR_PASS2))
+        pp_cache_invalidate();
+
+    /* Nor would it be repeated if a snapshot were installed */
+    pp_snapshot_reject();
+
     return false;
 }
 
@@ -6917,134 +8171,1084 @@ static void pp_add_magic_stdmac(void)
     }
 }
 
-static void pp_reset_stdmac(enum preproc_mode mode)
+/*
+ * Preprocessor state snapshot; see struct pp_snapshot.  The file
+ * consists of SNAPSHOT_MAGIC, the key, the MD5 sum of the body and
+ * the body, in which numbers are written as unsigned LEB128 and
+ * strings and token texts with their length and a final NUL.
+ */
+#define SNAPSHOT_MAGIC "nasm-ppsnap 1"
+#define SNAPSHOT_HDRLEN (sizeof SNAPSHOT_MAGIC + 2*MD5_HASHBYTES)
+
+void pp_snapshot(const char *path)
 {
-    int apass;
-    struct Include *inc;
+    nasm_free(ppsnap.path);
+    ppsnap.path = path ? nasm_strdup(path) : NULL;
+}
 
-    /*
-     * Set up the stdmac packages as a virtual include file,
-     * indicated by a null file pointer.
-     */
-    nasm_new(inc);
-    inc->next = istk;
-    inc->nolist = inc->noline = !list_option('b');
-    inc->where = istk->where;
-    istk = inc;
-    if (!istk->nolist) {
-        lfmt->uplevel(LIST_INCLUDE, 0);
-    }
-    if (!istk->noline) {
-        src_set(0, NULL);
-        istk->where = src_where();
-        if (ppdbg & PDBG_INCLUDE)
-            dfmt->debug_include(true, istk->next->where, istk->where);
+static void pp_snapshot_free(void)
+{
+    struct snap_file *f, *fnext;
+
+    list_for_each_safe(f, fnext, ppsnap.files) {
+        nasm_free(f->name);
+        nasm_free(f->path);
+        nasm_free(f);
     }
+    nasm_free(ppsnap.data);
 
-    pp_add_magic_stdmac();
+    ppsnap.state      = PPS_OFF;
+    ppsnap.pending    = false;
+    ppsnap.files      = NULL;
+    ppsnap.files_tail = &ppsnap.files;
+    ppsnap.pass_macro = NULL;
+    ppsnap.inc        = NULL;
+    ppsnap.data       = NULL;
+    ppsnap.len        = 0;
+}
 
-    if (tasm_compatible_mode)
-        pp_add_stdmac(nasm_stdmac_tasm);
+/*
+ * Something seen while reading what would be recorded makes the
+ * state unfit for a snapshot.
+ */
+static void pp_snapshot_reject(void)
+{
+    ppsnap.pending    = false;
+    ppsnap.pass_macro = NULL;
+    ppsnap.inc        = NULL;
+}
 
-    pp_add_stdmac(nasm_stdmac_nasm);
-    pp_add_stdmac(nasm_stdmac_version);
+/* Record a file opened by %include or %require, or named by %depend */
+static void pp_snapshot_file(const char *name, const char *path, bool depend)
+{
+    struct snap_file *f;
 
-    if (extrastdmac)
-        pp_add_stdmac(extrastdmac);
+    if (!ppsnap.pending)
+        return;
 
-    stdmacpos  = stdmacros[0];
-    stdmacnext = &stdmacros[1];
+    nasm_new(f);
+    f->depend = depend;
+    f->name   = nasm_strdup(name);
+    f->path   = path ? nasm_strdup(path) : NULL;
+    *ppsnap.files_tail = f;
+    ppsnap.files_tail = &f->next;
+}
 
-    do_predef = true;
+static size_t count_magic_smacros(void)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+    const SMacro *m;
+    size_t n = 0;
 
-    /*
-     * Define the __?PASS?__ macro.  This is defined here unlike all the
-     * other builtins, because it is special -- it varies between
-     * passes -- but there is really no particular reason to make it
-     * magic.
-     *
-     * 0 = dependencies only
-     * 1 = preparatory passes
-     * 2 = final pass
-     * 3 = preproces only
-     */
-    switch (mode) {
-    case PP_NORMAL:
-        apass = pass_final() ? 2 : 1;
-        break;
-    case PP_DEPS:
-        apass = 0;
-        break;
-    case PP_PREPROC:
-        apass = 3;
-        break;
-    default:
-        panic();
+    hash_for_each(&smacros, it, np) {
+        list_for_each(m, (const SMacro *)np->data)
+            n += m->expand != smacro_expand_default;
     }
-
-    define_smacro("__?PASS?__", true, make_tok_num(NULL, apass), NULL);
+    return n;
 }
 
-void pp_reset(const char *file, enum preproc_mode mode,
-              struct strlist *dep_list)
+/*
+ * A predefinition of the date or the time, which is different on
+ * every run, is not part of the key but applied again after
+ * installing a snapshot.  Returns the name defined, if it is one.
+ */
+static Token *snap_volatile_define(const Line *l)
 {
-    cstk = NULL;
-    defining = NULL;
-    nested_mac_count = 0;
-    nested_rep_count = 0;
-    init_macros();
-    unique = 0;
-    deplist = dep_list;
-    pp_mode = mode;
+    Token *t = l->first;
 
-    /* Reset options to default */
-    nasm_zero(ppconf);
+    if (!tok_is(t, TOKEN_PREPROC_ID) || strcmp(tok_text(t), "%define"))
+        return NULL;
 
-    /* Disable all debugging info, except in the last pass */
-    ppdbg = 0;
-    if (!(ppopt & PP_TRIVIAL)) {
-        if (pass_final()) {
-            if (dfmt->debug_mmacros)
-                ppdbg |= PDBG_MMACROS;
-            if (dfmt->debug_smacros)
-                ppdbg |= PDBG_SMACROS;
-            if (dfmt->debug_include)
-                ppdbg |= PDBG_INCLUDE;
-        }
+    t = skip_white(t->next);
+    if (!tok_is(t, TOKEN_ID) || !is_timestamp_macro(tok_text(t)))
+        return NULL;
 
-        if (list_option('s'))
-            ppdbg |= PDBG_LIST_SMACROS;
-    }
+    return t;
+}
 
-    memset(use_loaded, 0, use_package_count * sizeof(bool));
+static void snap_md5_str(MD5_CTX *ctx, const char *str)
+{
+    MD5Update(ctx, (const unsigned char *)str, strlen(str)+1);
+}
 
-    /* First set up the top level input file */
-    nasm_new(istk);
-    istk->fp = nasm_open_read(file, NF_TEXT);
-    if (!istk->fp) {
-	nasm_fatalf(ERR_NOFILE, "unable to open input file `%s'%s%s",
-                    file, errno ? " " : "", errno ? strerror(errno) : "");
-    }
-    src_set(0, file);
-    istk->where = src_where();
-    istk->lineinc = 1;
+/*
+ * Compute the key of the snapshot: everything other than the files
+ * read which could change the state.
+ */
+static void pp_snapshot_key(unsigned char *key)
+{
+    const struct strlist_entry *ip;
+    const Line *l;
+    MD5_CTX ctx;
+    uint8_t flags[2];
+    char *str;
 
-    if (ppdbg & PDBG_INCLUDE) {
-        /* Let the debug format know the main file */
-        dfmt->debug_include(true, src_nowhere(), istk->where);
-    }
+    MD5Init(&ctx);
+    snap_md5_str(&ctx, nasm_version);
 
-    strlist_add(deplist, file);
+    flags[0] = tasm_compatible_mode;
+    flags[1] = !!(ppopt & PP_NOLINE);
+    MD5Update(&ctx, flags, sizeof flags);
+    MD5Update(&ctx, (const unsigned char *)&list_options, sizeof list_options);
+    MD5Update(&ctx, (const unsigned char *)nasm_limit, sizeof nasm_limit);
+    MD5Update(&ctx, warning_state, sizeof warning_state);
+    MD5Update(&ctx, (const unsigned char *)&use_package_count,
+              sizeof use_package_count);
 
-    do_predef = false;
+    str = nasm_realpath(".");
+    snap_md5_str(&ctx, str);
+    nasm_free(str);
 
-    if (!(ppopt & PP_TRIVIAL))
+    if (ipath_list) {
+        strlist_for_each(ip, ipath_list)
+            snap_md5_str(&ctx, ip->str);
+    }
+
+    list_for_each(l, predef) {
+        const Token *name = snap_volatile_define(l);
+
+        if (name) {
+            snap_md5_str(&ctx, "%define");
+            snap_md5_str(&ctx, tok_text(name));
+            continue;
+        }
+
+        str = detoken(l->first, false);
+        snap_md5_str(&ctx, str);
+        nasm_free(str);
+    }
+
+    MD5Final(key, &ctx);
+}
+
+/* Apply the date and time predefinitions to the installed snapshot */
+static void snap_redefine(const Line *l)
+{
+    Token *name;
+
+    if (!l)
+        return;
+
+    snap_redefine(l->next);     /* Oldest first */
+
+    name = snap_volatile_define(l);
+    if (name && smacro_defined(NULL, tok_text(name), 0, NULL, true, true))
+        define_smacro(tok_text(name), true,
+                      dup_tlist(skip_white(name->next), NULL), NULL);
+}
+
+/*
+ * Writing a snapshot
+ */
+static void snap_wnum(struct SAA *s, uint64_t v)
+{
+    do {
+        uint8_t b = v & 0x7f;
+
+        v >>= 7;
+        saa_write8(s, b | (v ? 0x80 : 0));
+    } while (v);
+}
+
+/* Write a string, which can be NULL */
+static void snap_wstr(struct SAA *s, const char *str)
+{
+    if (!str) {
+        snap_wnum(s, 0);
+        return;
+    }
+
+    snap_wnum(s, strlen(str)+1);
+    saa_wbytes(s, str, strlen(str)+1);
+}
+
+static void snap_wtoken(struct SAA *s, const Token *t)
+{
+    snap_wnum(s, t->type);
+    snap_wnum(s, t->len);
+    saa_wbytes(s, tok_text(t), t->len);
+    saa_write8(s, 0);
+}
+
+static void snap_wtokens(struct SAA *s, const Token *tlist)
+{
+    const Token *t;
+    size_t n = 0;
+
+    list_for_each(t, tlist)
+        n++;
+
+    snap_wnum(s, n);
+    list_for_each(t, tlist)
+        snap_wtoken(s, t);
+}
+
+static void snap_wlocation(struct SAA *s, struct src_location where)
+{
+    snap_wstr(s, where.filename);
+    snap_wnum(s, (uint32_t)where.lineno);
+}
+
+/*
+ * Write the macros of a hash bucket oldest first, so that they can
+ * be pushed back in the same order.  The magic macros, which are
+ * always the oldest, are defined anew instead.
+ */
+static void snap_wsmacro(struct SAA *s, const SMacro *m)
+{
+    int i;
+
+    if (!m)
+        return;
+
+    snap_wsmacro(s, m->next);
+    if (m->expand != smacro_expand_default)
+        return;
+
+    snap_wnum(s, 1);
+    snap_wstr(s, m->name);
+    snap_wnum(s, m->casesense);
+    snap_wnum(s, m->alias);
+    snap_wnum(s, m->varadic);
+    snap_wnum(s, m->nparam);
+    for (i = 0; i < m->nparam; i++) {
+        snap_wnum(s, m->params[i].flags);
+        snap_wtoken(s, &m->params[i].name);
+    }
+    snap_wtokens(s, m->expansion);
+}
+
+static void snap_wsmacros(struct SAA *s, struct hash_table *smt)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+
+    hash_for_each(smt, it, np)
+        snap_wsmacro(s, np->data);
+    snap_wnum(s, 0);
+}
+
+static void snap_wmmacro(struct SAA *s, const MMacro *m)
+{
+    const Line *l;
+    size_t n = 0;
+
+    if (!m)
+        return;
+
+    snap_wmmacro(s, m->next);
+
+    snap_wnum(s, 1);
+    snap_wstr(s, m->name);
+    snap_wnum(s, m->casesense);
+    snap_wnum(s, m->plus);
+    snap_wnum(s, m->nolist);
+    snap_wnum(s, m->capture_label);
+    snap_wnum(s, m->nparam_min);
+    snap_wnum(s, m->nparam_max);
+    snap_wnum(s, m->max_depth);
+    snap_wnum(s, m->ndefs);
+    snap_wtokens(s, m->dlist);
+    snap_wlocation(s, m->where);
+
+    list_for_each(l, m->expansion)
+        n++;
+    snap_wnum(s, n);
+    list_for_each(l, m->expansion) {
+        snap_wlocation(s, l->where);
+        snap_wtokens(s, l->first);
+    }
+}
+
+static void snap_wcontext(struct SAA *s, Context *c)
+{
+    if (!c)
+        return;
+
+    snap_wcontext(s, c->next);  /* Outermost first */
+    snap_wstr(s, c->name);
+    snap_wnum(s, c->number);
+    snap_wnum(s, c->depth);
+    snap_wsmacros(s, &c->localmac);
+}
+
+/*
+ * Write the snapshot, now that the standard macros and everything
+ * predefined have been processed in the final pass.
+ */
+static void pp_snapshot_save(void)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+    const struct snap_file *f;
+    const struct cached_file *cf;
+    unsigned char sum[MD5_HASHBYTES];
+    struct SAA *s;
+    MD5_CTX ctx;
+    Context *c;
+    size_t n;
+    char *body, *tname;
+    int i;
+    time_t mtime;
+    FILE *fp;
+    bool ok;
+
+    pp_snapshot_reject();       /* Nothing more to record */
+
+    if (defining || count_magic_smacros() != ppsnap.nmagic)
+        return;
+
+    s = saa_init(1);
+    snap_wnum(s, time(NULL));
+
+    n = 0;
+    list_for_each(f, ppsnap.files)
+        n++;
+    snap_wnum(s, n);
+    list_for_each(f, ppsnap.files) {
+        snap_wnum(s, f->depend);
+        snap_wstr(s, f->name);
+        if (f->depend)
+            continue;
+
+        cf = file_cache_get(f->path, NULL);
+        if (!cf || !nasm_file_time(&mtime, f->path))
+            goto done;
+
+        snap_wstr(s, f->path);
+        snap_wnum(s, cf->len);
+        snap_wnum(s, (uint64_t)mtime);
+        saa_wbytes(s, cf->md5, MD5_HASHBYTES);
+    }
+
+    snap_wnum(s, unique);
+    snap_wnum(s, StackSize);
+    snap_wstr(s, StackPointer);
+    snap_wnum(s, (uint64_t)(int64_t)ArgOffset);
+    snap_wnum(s, (uint64_t)(int64_t)LocalOffset);
+    snap_wnum(s, ppconf.noaliases);
+    snap_wnum(s, ppconf.sane_empty_expansion);
+    for (i = 0; i < use_package_count; i++)
+        snap_wnum(s, use_loaded[i]);
+
+    n = 0;
+    list_for_each(c, cstk)
+        n++;
+    snap_wnum(s, n);
+    snap_wcontext(s, cstk);
+
+    snap_wsmacros(s, &smacros);
+
+    hash_for_each(&mmacros, it, np)
+        snap_wmmacro(s, np->data);
+    snap_wnum(s, 0);
+
+    n = s->datalen;
+    body = nasm_malloc(n);
+    saa_rewind(s);
+    saa_rnbytes(s, body, n);
+
+    MD5Init(&ctx);
+    MD5Update(&ctx, (unsigned char *)body, n);
+    MD5Final(sum, &ctx);
+
+    /* Write a file of its own and rename it, so concurrent runs can't mix */
+    fp = nasm_open_write_temp(ppsnap.path, NF_BINARY, &tname);
+    if (fp) {
+        fwrite(SNAPSHOT_MAGIC, 1, sizeof SNAPSHOT_MAGIC, fp);
+        fwrite(ppsnap.key, 1, MD5_HASHBYTES, fp);
+        fwrite(sum, 1, MD5_HASHBYTES, fp);
+        fwrite(body, 1, n, fp);
+        ok = !ferror(fp);
+        if (fclose(fp) || !ok || rename(tname, ppsnap.path))
+            remove(tname);
+    }
+    nasm_free(tname);
+    nasm_free(body);
+
+done:
+    saa_free(s);
+}
+
+/*
+ * Reading a snapshot.  The body has been checked against its MD5
+ * sum, so it is only read past its end because of a bug.
+ */
+struct snap_reader {
+    const unsigned char *p, *end;
+};
+
+static const unsigned char *snap_rbytes(struct snap_reader *r, size_t n)
+{
+    const unsigned char *p = r->p;
+
+    nasm_assert((size_t)(r->end - p) >= n);
+    r->p += n;
+    return p;
+}
+
+static uint64_t snap_rnum(struct snap_reader *r)
+{
+    uint64_t v = 0;
+    unsigned int shift = 0;
+    uint8_t b;
+
+    do {
+        b = *snap_rbytes(r, 1);
+        v |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    return v;
+}
+
+static const char *snap_rstr(struct snap_reader *r)
+{
+    size_t n = snap_rnum(r);
+
+    return n ? (const char *)snap_rbytes(r, n) : NULL;
+}
+
+static Token *snap_rtoken(struct snap_reader *r, Token *t)
+{
+    enum token_type type = snap_rnum(r);
+    size_t len = snap_rnum(r);
+    const char *text = (const char *)snap_rbytes(r, len+1);
+
+    if (!t)
+        return new_Token(NULL, type, text, len);
+
+    t->type = type;
+    return set_text(t, text, len);
+}
+
+static Token *snap_rtokens(struct snap_reader *r)
+{
+    Token *list = NULL;
+    Token **tail = &list;
+    size_t n = snap_rnum(r);
+
+    while (n--) {
+        *tail = snap_rtoken(r, NULL);
+        tail = &(*tail)->next;
+    }
+    return list;
+}
+
+static struct src_location snap_rlocation(struct snap_reader *r)
+{
+    struct src_location where;
+
+    where.filename = src_intern_fname(snap_rstr(r));
+    where.lineno   = (int32_t)snap_rnum(r);
+    return where;
+}
+
+static void snap_rsmacros(struct snap_reader *r, struct hash_table *smt)
+{
+    SMacro *m, **head;
+    int i;
+
+    while (snap_rnum(r)) {
+        nasm_new(m);
+        m->name      = nasm_strdup(snap_rstr(r));
+        m->casesense = snap_rnum(r);
+        m->alias     = snap_rnum(r);
+        m->varadic   = snap_rnum(r);
+        m->nparam    = snap_rnum(r);
+        if (m->nparam) {
+            nasm_newn(m->params, m->nparam);
+            for (i = 0; i < m->nparam; i++) {
+                m->params[i].flags = snap_rnum(r);
+                snap_rtoken(r, &m->params[i].name);
+            }
+        }
+        m->expansion = snap_rtokens(r);
+        intern_tlist(m->expansion);
+        m->expand    = smacro_expand_default;
+        m->timestamp = smt == &smacros && is_timestamp_macro(m->name);
+
+        head = (SMacro **)hash_findi_add(smt, m->name);
+        m->next = *head;
+        *head = m;
+        if (smt == &smacros)
+            smacro_filter_add(m->name);
+    }
+}
+
+static void snap_rmmacros(struct snap_reader *r)
+{
+    MMacro *m, **head;
+    Line *l, **tail;
+    size_t n;
+    int ndefs;
+
+    while (snap_rnum(r)) {
+        nasm_new(m);
+        m->name          = nasm_strdup(snap_rstr(r));
+        m->casesense     = snap_rnum(r);
+        m->plus          = snap_rnum(r);
+        m->nolist        = snap_rnum(r);
+        m->capture_label = snap_rnum(r);
+        m->nparam_min    = snap_rnum(r);
+        m->nparam_max    = snap_rnum(r);
+        m->max_depth     = snap_rnum(r);
+        ndefs            = snap_rnum(r);
+        m->dlist         = snap_rtokens(r);
+        m->where         = snap_rlocation(r);
+        m->dstk.mmac     = m;
+
+        /* The default list was cut short already if need be */
+        if (m->dlist) {
+            count_mmac_params(m->dlist, &m->ndefs, &m->defaults);
+            if (m->ndefs > ndefs)
+                m->ndefs = ndefs;
+        }
+
+        tail = &m->expansion;
+        n = snap_rnum(r);
+        while (n--) {
+            nasm_new(l);
+            l->where = snap_rlocation(r);
+            l->first = snap_rtokens(r);
+            *tail = l;
+            tail = &l->next;
+        }
+
+        intern_mmacro(m);
+        compile_mmacro(m);
+        head = (MMacro **)hash_findi_add(&mmacros, m->name);
+        m->next = *head;
+        *head = m;
+    }
+}
+
+/*
+ * Install the loaded snapshot, after the magic macros have been
+ * defined.
+ */
+static void pp_snapshot_install(void)
+{
+    struct snap_reader r;
+    const char *name, *path, *sp;
+    Context *c;
+    size_t n;
+    FILE *fp;
+    int i;
+
+    r.p   = ppsnap.data;
+    r.end = ppsnap.data + ppsnap.len;
+
+    snap_rnum(&r);              /* Time written */
+
+    /*
+     * Open each included file once more, so it is in the dependency
+     * list and counts as included for %require.
+     */
+    n = snap_rnum(&r);
+    while (n--) {
+        bool depend = snap_rnum(&r);
+
+        name = snap_rstr(&r);
+        if (depend) {
+            strlist_add(deplist, name);
+            continue;
+        }
+
+        snap_rstr(&r);
+        snap_rnum(&r);
+        snap_rnum(&r);
+        snap_rbytes(&r, MD5_HASHBYTES);
+
+        fp = inc_fopen(name, deplist, &path, INC_OPTIONAL, NF_TEXT);
+        if (fp)
+            fclose(fp);
+    }
+
+    unique      = snap_rnum(&r);
+    StackSize   = snap_rnum(&r);
+    sp          = snap_rstr(&r);
+    StackPointer = !strcmp(sp, "rbp") ? "rbp" : !strcmp(sp, "bp") ? "bp" : "ebp";
+    ArgOffset   = (int64_t)snap_rnum(&r);
+    LocalOffset = (int64_t)snap_rnum(&r);
+    ppconf.noaliases            = snap_rnum(&r);
+    ppconf.sane_empty_expansion = snap_rnum(&r);
+    for (i = 0; i < use_package_count; i++)
+        use_loaded[i] = snap_rnum(&r);
+
+    n = snap_rnum(&r);
+    while (n--) {
+        nasm_new(c);
+        name = snap_rstr(&r);
+        c->name   = name ? nasm_strdup(name) : NULL;
+        c->number = snap_rnum(&r);
+        c->depth  = snap_rnum(&r);
+        snap_rsmacros(&r, &c->localmac);
+        c->next = cstk;
+        cstk = c;
+    }
+
+    snap_rsmacros(&r, &smacros);
+    snap_rmmacros(&r);
+    nasm_assert(r.p == r.end);
+
+    snap_redefine(predef);
+}
+
+/*
+ * Is a file recorded in the snapshot unchanged?  As git does for its
+ * index, the size and modification time are trusted only if the file
+ * had not been modified any more in the second the snapshot was
+ * written; otherwise the contents are compared.
+ */
+static bool snap_file_unchanged(const char *path, uint64_t size,
+                                int64_t mtime, const unsigned char *md5,
+                                int64_t written)
+{
+    const struct cached_file *cf;
+    time_t t;
+
+    if (nasm_file_size_by_path(path) != (off_t)size)
+        return false;
+
+    if (nasm_file_time(&t, path) && (int64_t)t == mtime && mtime < written)
+        return true;
+
+    cf = file_cache_get(path, NULL);
+    return cf && !memcmp(cf->md5, md5, MD5_HASHBYTES);
+}
+
+/*
+ * Read the snapshot file, if it has the right key and none of the
+ * files it was made from has changed.
+ */
+static bool pp_snapshot_load(void)
+{
+    unsigned char hdr[SNAPSHOT_HDRLEN];
+    unsigned char sum[MD5_HASHBYTES];
+    struct snap_reader r;
+    MD5_CTX ctx;
+    int64_t written;
+    off_t size;
+    size_t n;
+    FILE *fp;
+    bool ok = false;
+
+    fp = nasm_open_read(ppsnap.path, NF_BINARY);
+    if (!fp)
+        return false;
+
+    size = nasm_file_size(fp);
+    if (size < (off_t)sizeof hdr || fread(hdr, 1, sizeof hdr, fp) != sizeof hdr ||
+        memcmp(hdr, SNAPSHOT_MAGIC, sizeof SNAPSHOT_MAGIC) ||
+        memcmp(hdr + sizeof SNAPSHOT_MAGIC, ppsnap.key, MD5_HASHBYTES))
+        goto close;
+
+    ppsnap.len  = size - sizeof hdr;
+    ppsnap.data = nasm_malloc(ppsnap.len + 1);
+    if (fread(ppsnap.data, 1, ppsnap.len, fp) != ppsnap.len)
+        goto close;
+
+    MD5Init(&ctx);
+    MD5Update(&ctx, ppsnap.data, ppsnap.len);
+    MD5Final(sum, &ctx);
+    if (memcmp(sum, hdr + sizeof SNAPSHOT_MAGIC + MD5_HASHBYTES, MD5_HASHBYTES))
+        goto close;
+
+    r.p   = ppsnap.data;
+    r.end = ppsnap.data + ppsnap.len;
+    written = snap_rnum(&r);
+    n = snap_rnum(&r);
+    while (n--) {
+        const char *name, *path;
+        char *found;
+        uint64_t fsize;
+        int64_t mtime;
+        bool same;
+
+        if (snap_rnum(&r)) {
+            snap_rstr(&r);      /* %depend */
+            continue;
+        }
+        name  = snap_rstr(&r);
+        path  = snap_rstr(&r);
+        fsize = snap_rnum(&r);
+        mtime = snap_rnum(&r);
+        if (!snap_file_unchanged(path, fsize, mtime,
+                                 snap_rbytes(&r, MD5_HASHBYTES), written))
+            goto close;
+
+        /* A file earlier in the include path may now shadow it */
+        inc_fopen_search(name, &found, INC_PROBE, NF_TEXT);
+        same = found && !strcmp(found, path);
+        nasm_free(found);
+        if (!same)
+            goto close;
+    }
+    ok = true;
+
+close:
+    fclose(fp);
+    if (!ok) {
+        nasm_free(ppsnap.data);
+        ppsnap.data = NULL;
+        ppsnap.len  = 0;
+    }
+    return ok;
+}
+
+/*
+ * Decide at the start of a session whether the snapshot is to be
+ * installed or written.
+ */
+static void pp_snapshot_start(enum preproc_mode mode)
+{
+    pp_snapshot_free();
+
+    if (!ppsnap.path || mode != PP_NORMAL || (ppopt & PP_TRIVIAL) ||
+        dfmt->debug_mmacros || dfmt->debug_smacros || dfmt->debug_include)
+        return;
+
+    pp_snapshot_key(ppsnap.key);
+    ppsnap.state = pp_snapshot_load() ? PPS_LOADED : PPS_RECORD;
+}
+
+static void pp_reset_stdmac(enum preproc_mode mode)
+{
+    int apass;
+    struct Include *inc;
+    SMacro *pass_macro;
+
+    /*
+     * Define the __?PASS?__ macro.  This is defined here unlike all the
+     * other builtins, because it is special -- it varies between
+     * passes -- but there is really no particular reason to make it
+     * magic.
+     *
+     * 0 = dependencies only
+     * 1 = preparatory passes
+     * 2 = final pass
+     * 3 = preproces only
+     */
+    switch (mode) {
+    case PP_NORMAL:
+        apass = pass_final() ? 2 : 1;
+        break;
+    case PP_DEPS:
+        apass = 0;
+        break;
+    case PP_PREPROC:
+        apass = 3;
+        break;
+    default:
+        panic();
+    }
+
+    if (ppsnap.state == PPS_LOADED) {
+        /* Only %use packages are read as standard macros */
+        stdmacpos  = NULL;
+        stdmacnext = &stdmacros[ARRAY_SIZE(stdmacros)-1];
+
+        pp_add_magic_stdmac();
+        pp_snapshot_install();
+        if (smacro_defined(NULL, "__?PASS?__", 0, NULL, true, true))
+            define_smacro("__?PASS?__", true, make_tok_num(NULL, apass), NULL);
+        return;
+    }
+
+    /*
+     * Set up the stdmac packages as a virtual include file,
+     * indicated by a null file pointer.
+     */
+    nasm_new(inc);
+    inc->next = istk;
+    inc->nolist = inc->noline = !list_option('b');
+    inc->where = istk->where;
+    istk = inc;
+    if (!istk->nolist) {
+        lfmt->uplevel(LIST_INCLUDE, 0);
+    }
+    if (!istk->noline) {
+        src_set(0, NULL);
+        istk->where = src_where();
+        if (ppdbg & PDBG_INCLUDE)
+            dfmt->debug_include(true, istk->next->where, istk->where);
+    }
+
+    pp_add_magic_stdmac();
+
+    if (ppsnap.state == PPS_RECORD && pass_final()) {
+        ppsnap.pending = true;
+        ppsnap.inc     = inc;
+        ppsnap.nmagic  = count_magic_smacros();
+    }
+
+    if (tasm_compatible_mode)
+        pp_add_stdmac(nasm_stdmac_tasm);
+
+    pp_add_stdmac(nasm_stdmac_nasm);
+    pp_add_stdmac(nasm_stdmac_version);
+
+    if (extrastdmac)
+        pp_add_stdmac(extrastdmac);
+
+    stdmacpos  = stdmacros[0];
+    stdmacnext = &stdmacros[1];
+
+    do_predef = true;
+
+    pass_macro = define_smacro("__?PASS?__", true,
+                               make_tok_num(NULL, apass), NULL);
+    if (ppsnap.pending)
+        ppsnap.pass_macro = pass_macro;
+}
+
+/*
+ * Output cache handling; see the description of struct pp_cache.
+ */
+static void pp_cache_free(void)
+{
+    struct cache_frame *f, *fnext;
+    MMacro *m, *mnext;
+    size_t i;
+
+    for (i = 0; i < ppcache.nlines; i++)
+        nasm_free(ppcache.lines[i].text);
+    nasm_free(ppcache.lines);
+
+    list_for_each_safe(f, fnext, ppcache.frames)
+        nasm_free(f);
+
+    list_for_each_safe(m, mnext, ppcache.macros) {
+        nasm_free(m->name);
+        nasm_free(m);
+    }
+
+    nasm_zero(ppcache);
+}
+
+/*
+ * Something pass-dependent was seen; the current pass cannot be
+ * recorded.
+ */
+static void pp_cache_invalidate(void)
+{
+    if (ppcache.state == PPC_RECORD)
+        pp_cache_free();
+    pp_snapshot_reject();
+}
+
+/*
+ * Return the persistent copy of an mmacro, which has just enough
+ * information for pp_error_list_macros().
+ */
+static const MMacro *pp_cache_macro(const void *macro)
+{
+    MMacro *m = (MMacro *)macro;
+    MMacro *c;
+
+    if (!m)
+        return NULL;
+
+    if (!m->cached) {
+        nasm_new(c);
+        c->name   = m->name ? nasm_strdup(m->name) : NULL;
+        c->nolist = m->nolist;
+        c->where  = m->where;
+        c->next   = ppcache.macros;
+        ppcache.macros = c;
+        m->cached = c;
+    }
+
+    return m->cached;
+}
+
+static const struct cache_frame *
+pp_cache_new_frame(const struct src_location_stack *sl)
+{
+    struct cache_frame *f;
+
+    nasm_new(f);
+    f->next  = ppcache.frames;
+    ppcache.frames = f;
+    f->up    = sl->up ? pp_cache_new_frame(sl->up) : NULL;
+    f->macro = pp_cache_macro(sl->macro);
+    f->where = sl->l;
+
+    return f;
+}
+
+/*
+ * Does the source location stack match a recorded frame?  The
+ * location of the bottom frame is stored with each line instead.
+ */
+static bool pp_cache_same_frame(const struct cache_frame *f)
+{
+    const struct src_location_stack *sl;
+
+    for (sl = _src_bottom; sl && f; sl = sl->up, f = f->up) {
+        const MMacro *m = sl->macro;
+
+        if ((m ? m->cached : NULL) != f->macro)
+            return false;
+        if (sl != _src_bottom && !src_location_same(sl->l, f->where))
+            return false;
+    }
+
+    return !sl && !f;
+}
+
+static void pp_cache_record(const char *line)
+{
+    struct cache_line *cl;
+
+    if (ppcache.nlines >= ppcache.maxlines) {
+        ppcache.maxlines = ppcache.maxlines ? ppcache.maxlines << 1 : 4096;
+        ppcache.lines = nasm_realloc(ppcache.lines, ppcache.maxlines *
+                                     sizeof(*ppcache.lines));
+    }
+
+    if (!pp_cache_same_frame(ppcache.frame))
+        ppcache.frame = pp_cache_new_frame(_src_bottom);
+
+    cl = &ppcache.lines[ppcache.nlines++];
+    cl->text  = line ? nasm_strdup(line) : NULL;
+    cl->frame = ppcache.frame;
+    cl->where = src_where();
+}
+
+static void pp_cache_push_frame(const struct cache_frame *f)
+{
+    if (f->up) {
+        pp_cache_push_frame(f->up);
+        src_macro_push(f->macro, f->where);
+    } else {
+        src_update(f->where);
+    }
+}
+
+static char *pp_cache_getline(void)
+{
+    const struct cache_line *cl;
+
+    nasm_assert(ppcache.pos < ppcache.nlines);
+    cl = &ppcache.lines[ppcache.pos++];
+
+    if (cl->frame != ppcache.frame) {
+        while (src_macro_current())
+            src_macro_pop();
+        pp_cache_push_frame(cl->frame);
+        ppcache.frame = cl->frame;
+    }
+    src_update(cl->where);
+
+    return cl->text ? nasm_strdup(cl->text) : NULL;
+}
+
+/*
+ * Decide what to do with the output cache at the start of a pass.
+ * Returns true if the pass is to be replayed from the cache.
+ */
+static bool pp_cache_reset(enum preproc_mode mode)
+{
+    bool usable = mode == PP_NORMAL && !(ppopt & PP_NOCACHE) &&
+        !list_on_every_pass();
+
+    if (usable && pass_first()) {
+        pp_cache_free();
+        ppcache.state = PPC_RECORD;
+    } else if (usable && !pass_final() && ppcache.state == PPC_READY) {
+        ppcache.state = PPC_REPLAY;
+        ppcache.pos   = 0;
+        ppcache.frame = NULL;
+        return true;
+    } else {
+        pp_cache_free();
+    }
+
+    return false;
+}
+
+void pp_reset(const char *file, enum preproc_mode mode,
+              struct strlist *dep_list)
+{
+    FILE *fp;
+
+    if ((ppopt & PP_RESIDENT) && !file_hash_checked) {
+        file_hash_new_session();
+        file_hash_checked = true;
+    }
+
+    if (pp_cache_reset(mode))
+        return;
+
+    if (pass_first() || mode != PP_NORMAL) {
+        volatile_used = false;
+        pp_snapshot_start(mode);
+    }
+
+    begin_pass_tokens();
+
+    cstk = NULL;
+    defining = NULL;
+    nested_mac_count = 0;
+    nested_rep_count = 0;
+    init_macros();
+    unique = 0;
+    deplist = dep_list;
+    pp_mode = mode;
+
+    /* Reset options to default */
+    nasm_zero(ppconf);
+
+    /* Disable all debugging info, except in the last pass */
+    ppdbg = 0;
+    if (!(ppopt & PP_TRIVIAL)) {
+        if (pass_final()) {
+            if (dfmt->debug_mmacros)
+                ppdbg |= PDBG_MMACROS;
+            if (dfmt->debug_smacros)
+                ppdbg |= PDBG_SMACROS;
+            if (dfmt->debug_include)
+                ppdbg |= PDBG_INCLUDE;
+        }
+
+        if (list_option('s'))
+            ppdbg |= PDBG_LIST_SMACROS;
+    }
+
+    memset(use_loaded, 0, use_package_count * sizeof(bool));
+
+    /* First set up the top level input file */
+    nasm_new(istk);
+    fp = nasm_open_read(file, NF_TEXT);
+    if (!fp) {
+	nasm_fatalf(ERR_NOFILE, "unable to open input file `%s'%s%s",
+                    file, errno ? " " : "", errno ? strerror(errno) : "");
+    }
+    istk->src = src_open(fp, file);
+    src_set(0, file);
+    istk->where = src_where();
+    istk->lineinc = 1;
+
+    if (ppdbg & PDBG_INCLUDE) {
+        /* Let the debug format know the main file */
+        dfmt->debug_include(true, src_nowhere(), istk->where);
+    }
+
+    strlist_add(deplist, file);
+
+    do_predef = false;
+
+    if (!(ppopt & PP_TRIVIAL))
         pp_reset_stdmac(mode);
 }
 
 void pp_init(enum preproc_opt opt)
 {
     ppopt = opt;
+    extrastdmac = NULL;
     nasm_newn(use_loaded, use_package_count);
 }
 
@@ -7061,6 +9265,7 @@ static Token *pp_tokline(void)
         Line *l = istk->expansion;
         Token *tline = NULL;
         Token *dtline;
+        bool spliced = false;
 
         /*
          * Fetch a tokenized line, either from the macro-expansion
@@ -7190,7 +9395,7 @@ static Token *pp_tokline(void)
         }
 
         do {                    /* until we get a line we can use */
-            char *line;
+            const char *line;
 
             if (istk->expansion) {      /* from a macro expansion */
                 Line *l = istk->expansion;
@@ -7198,31 +9403,35 @@ static Token *pp_tokline(void)
                 istk->expansion = l->next;
                 istk->where = l->where;
                 tline = l->first;
+                spliced = l->spliced;
                 nasm_free(l);
 
                 if (!istk->noline)
                     src_update(istk->where);
 
                 if (!istk->nolist) {
-                    line = detoken(tline, false);
-                    lfmt->line(LIST_MACRO, istk->where.lineno, line);
-                    nasm_free(line);
+                    char *text = detoken(tline, false);
+                    lfmt->line(LIST_MACRO, istk->where.lineno, text);
+                    nasm_free(text);
                 }
-            } else if ((line = read_line())) {
-                tline = tokenize(line);
-                nasm_free(line);
+            } else if ((line = read_tokline())) {
+                tline = istk->src ? tokenize(line) : stdmac_tokenize();
+                if (istk->src)
+                    src_restore(istk->src);
+                if (istk->guard && skip_white(tline))
+                    guard_line(tline);
             } else {
                 /*
                  * The current file has ended; work down the istk
                  */
                 Include *i = istk;
 
-                if (i->fp)
-                    fclose(i->fp);
+                src_close(i->src);
                 if (i->conds) {
                     /* nasm_fatal can't be conditionally suppressed */
                     nasm_fatal("expected `%%endif' before end of file");
                 }
+                guard_end(i);
 
                 istk = i->next;
 
@@ -7237,6 +9446,9 @@ static Token *pp_tokline(void)
                         src_update(istk->where);
                 }
 
+                if (i == ppsnap.inc)
+                    pp_snapshot_save();
+
                 nasm_free(i);
                 return &tok_pop;
             }
@@ -7250,9 +9462,10 @@ static Token *pp_tokline(void)
          * those tokens should be left alone to go into the
          * definition; and unless we're in a non-emitting
          * condition, in which case we don't want to meddle with
-         * anything.
+         * anything.  A line spliced from a compiled macro body has
+         * had its parameters substituted already.
          */
-        if (!defining &&
+        if (!spliced && !defining &&
             !(istk->conds && !emitting(istk->conds->state)) &&
             !(istk->mstk.mmac && !istk->mstk.mmac->in_progress)) {
             tline = expand_mmac_params(tline);
@@ -7324,6 +9537,11 @@ char *pp_getline(void)
     char *line = NULL;
     Token *tline;
 
+    if (ppcache.state == PPC_REPLAY)
+        return pp_cache_getline();
+
+    ppcache.in_getline = true;
+
     while (true) {
         tline = pp_tokline();
         if (tline == &tok_pop) {
@@ -7349,11 +9567,27 @@ char *pp_getline(void)
         nasm_free(buf);
     }
 
+    /* Output before the main file cannot be left out of a snapshot */
+    if (ppsnap.pending && line && *nasm_skip_spaces(line))
+        pp_snapshot_reject();
+
+    ppcache.in_getline = false;
+    if (ppcache.state == PPC_RECORD)
+        pp_cache_record(line);
+
     return line;
 }
 
 void pp_cleanup_pass(void)
 {
+    if (ppcache.state == PPC_REPLAY) {
+        ppcache.state = PPC_READY;
+        src_set_fname(NULL);
+        return;
+    }
+
+    begin_discard_tokens();
+
     if (defining) {
         if (defining->name) {
             nasm_nonfatal("end of file while still defining macro `%s'",
@@ -7372,7 +9606,8 @@ void pp_cleanup_pass(void)
     while (istk) {
         Include *i = istk;
         istk = istk->next;
-        fclose(i->fp);
+        src_close(i->src);
+        nasm_free(i->guard_name);
         if (!istk && (ppdbg & PDBG_INCLUDE)) {
             /* Signal closing the top-level input file */
             dfmt->debug_include(false, src_nowhere(), i->where);
@@ -7385,15 +9620,33 @@ void pp_cleanup_pass(void)
 
     if (ppdbg & PDBG_MMACROS)
         debug_macro_output();
+
+    if (ppcache.state == PPC_RECORD) {
+        /* Only a complete recording can be replayed */
+        if (ppcache.nlines && !ppcache.lines[ppcache.nlines-1].text)
+            ppcache.state = PPC_READY;
+        else
+            pp_cache_free();
+    }
+
+    end_pass_tokens();
 }
 
 void pp_cleanup_session(void)
 {
+    pp_cache_free();
+    pp_snapshot_free();
     nasm_free(use_loaded);
     free_llist(predef);
     predef = NULL;
-    delete_Blocks();
+    nasm_zero(stdmacros);
+    if (!(ppopt & PP_RESIDENT))
+        stdmac_free_sets();
+    delete_Blocks(ppopt & PP_RESIDENT);
+    atom_free_all();
     ipath_list = NULL;
+    search_misses = NULL;
+    file_hash_checked = false;
 }
 
 void pp_include_path(struct strlist *list)
@@ -7401,6 +9654,16 @@ void pp_include_path(struct strlist *list)
     ipath_list = list;
 }
 
+void pp_search_misses(struct strlist *list)
+{
+    search_misses = list;
+}
+
+bool pp_volatile_used(void)
+{
+    return volatile_used;
+}
+
 void pp_pre_include(char *fname)
 {
     Token *inc, *space, *name;
@@ -7410,7 +9673,7 @@ void pp_pre_include(char *fname)
     space = new_White(name);
     inc = new_Token(space, TOKEN_PREPROC_ID, "%include", 0);
 
-    l = nasm_malloc(sizeof(Line));
+    nasm_new(l);
     l->next = predef;
     l->first = inc;
     l->finishes = NULL;
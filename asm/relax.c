@@ -0,0 +1,474 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 1996-2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * relax.c - span-dependent jump relaxation
+ *
+ * A jump which has a short form is "span-dependent": whether the
+ * short form can be used depends on the distance to its target,
+ * which in turn depends on the size of the jumps in between.  The
+ * optimizer resolves this by running assembly passes until no label
+ * moves any more, but typically each of those passes only changes
+ * the size of a handful of jumps.
+ *
+ * To speed this up, each preparatory pass records every such jump
+ * and every label definition.  Once a pass is fully explained by the
+ * jump size changes - every label moved by exactly the size change
+ * of the jumps before it, and the jump sizes follow from the label
+ * values of the previous pass - the following passes are simulated
+ * on this record alone, the same way the assembler would run them,
+ * until no label moves.  The resulting label values are handed to
+ * the next real pass, which will normally find nothing to change.
+ * If it does, the prediction was wrong (something other than a jump
+ * depends on the label values) and the engine is disabled for the
+ * rest of the assembly.
+ */
+
+#include "compiler.h"
+
+#include "nasm.h"
+#include "nasmlib.h"
+#include "error.h"
+#include "labels.h"
+#include "raa.h"
+#include "relax.h"
+
+struct jump {
+    int32_t segment;            /* Segment of the jump */
+    int32_t tsegment;           /* Segment of the target */
+    int64_t offset;             /* Offset of the jump */
+    int64_t target;             /* Target offset as seen in this pass */
+    int64_t size, shortsize, longsize;
+};
+
+struct rlabel {
+    union label *lptr;
+    int32_t segment, prev_segment;
+    int64_t offset, prev_offset;
+    bool known;                 /* Also defined in the previous pass */
+    size_t njumps;              /* Number of jumps preceding the label */
+};
+
+/* What a jump points to */
+enum anchor_type {
+    ANCHOR_FAR,                 /* Another segment, never short */
+    ANCHOR_LABEL,               /* A recorded label */
+    ANCHOR_SELF                 /* Relative to the jump itself, e.g. $+2 */
+};
+
+struct anchor {
+    enum anchor_type type;
+    size_t label;               /* For ANCHOR_LABEL */
+    int64_t delta;              /* For ANCHOR_SELF */
+};
+
+static struct {
+    bool active;                /* Recording the current pass */
+    bool solvable;              /* Nothing unmodelled seen in this pass */
+    bool predicted;             /* Label values have been predicted */
+    bool disabled;              /* A prediction failed */
+    struct jump *jumps, *prev_jumps;
+    size_t njumps, maxjumps;
+    size_t nprev_jumps, maxprev_jumps;
+    struct rlabel *labels;
+    size_t nlabels, maxlabels;
+} relax;
+
+/* Working data for relax_solve() */
+static struct anchor *anchors;
+static int *jseg, *lseg;        /* Dense segment numbers, -1 if none */
+static int64_t *delta;          /* Per segment size change */
+
+void relax_reset(void)
+{
+    struct jump *jumps = relax.jumps;
+    size_t maxjumps = relax.maxjumps;
+
+    if (pass_final() || relax.disabled) {
+        relax.active = false;
+        return;
+    }
+
+    relax.jumps          = relax.prev_jumps;
+    relax.maxjumps       = relax.maxprev_jumps;
+    relax.prev_jumps     = jumps;
+    relax.maxprev_jumps  = maxjumps;
+    relax.nprev_jumps    = relax.njumps;
+    relax.njumps         = 0;
+    relax.nlabels        = 0;
+    relax.active         = true;
+    relax.solvable       = true;
+}
+
+void relax_jump(int32_t segment, int64_t offset, int64_t size,
+                int64_t shortsize, int64_t longsize,
+                int32_t tsegment, int64_t target)
+{
+    struct jump *jp;
+
+    if (!relax.active)
+        return;
+
+    if (relax.njumps >= relax.maxjumps) {
+        relax.maxjumps = relax.maxjumps ? relax.maxjumps << 1 : 1024;
+        relax.jumps = nasm_realloc(relax.jumps,
+                                   relax.maxjumps * sizeof(*relax.jumps));
+    }
+
+    jp = &relax.jumps[relax.njumps++];
+    jp->segment   = segment;
+    jp->tsegment  = tsegment;
+    jp->offset    = offset;
+    jp->target    = target;
+    jp->size      = size;
+    jp->shortsize = shortsize;
+    jp->longsize  = longsize;
+}
+
+void relax_label(union label *lptr, int32_t segment, int64_t offset,
+                 bool known, int32_t prev_segment, int64_t prev_offset)
+{
+    struct rlabel *l;
+
+    if (!relax.active)
+        return;
+
+    if (relax.nlabels >= relax.maxlabels) {
+        relax.maxlabels = relax.maxlabels ? relax.maxlabels << 1 : 1024;
+        relax.labels = nasm_realloc(relax.labels,
+                                    relax.maxlabels * sizeof(*relax.labels));
+    }
+
+    l = &relax.labels[relax.nlabels++];
+    l->lptr         = lptr;
+    l->segment      = segment;
+    l->offset       = offset;
+    l->known        = known;
+    l->prev_segment = prev_segment;
+    l->prev_offset  = prev_offset;
+    l->njumps       = relax.njumps;
+}
+
+/*
+ * Something whose size may depend on label values, and which we
+ * cannot model, was seen in this pass.
+ */
+void relax_unsolvable(void)
+{
+    relax.solvable = false;
+}
+
+/*
+ * Find a label with the given offset among the labels lv[lo..hi),
+ * which are sorted by offset.  Returns hi if there is none.
+ */
+static size_t find_offset(const size_t *sl, const int64_t *lv,
+                         size_t lo, size_t hi, int64_t offset)
+{
+    size_t end = hi;
+
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) >> 1);
+        if (lv[sl[mid]] < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo < end && lv[sl[lo]] == offset) ? lo : end;
+}
+
+/*
+ * Simulate one pass.  The positions are given relative to the jumps
+ * in base and the label offsets in lbase; lv contains the label
+ * values of the previous pass on entry, and those of this pass on
+ * exit.  Returns the number of labels which changed.
+ */
+static size_t relax_pass(const struct jump *base, const int64_t *lbase,
+                         int64_t *lv, int64_t *sizes, int nsegs)
+{
+    size_t j = 0, l, changed = 0;
+
+    memset(delta, 0, nsegs * sizeof(*delta));
+
+    for (l = 0; l <= relax.nlabels; l++) {
+        size_t end = l < relax.nlabels ? relax.labels[l].njumps : relax.njumps;
+
+        for (; j < end; j++) {
+            const struct jump *jp = &relax.jumps[j];
+            const struct anchor *a = &anchors[j];
+            int64_t here = base[j].offset + delta[jseg[j]];
+            int64_t target, dist, size;
+
+            switch (a->type) {
+            case ANCHOR_LABEL:
+                target = lv[a->label];
+                break;
+            case ANCHOR_SELF:
+                target = here + a->delta;
+                break;
+            default:
+                target = 0;
+                break;
+            }
+
+            dist = target - here - jp->shortsize;
+            if (a->type != ANCHOR_FAR && dist >= -128 && dist <= 127)
+                size = jp->shortsize;
+            else
+                size = jp->longsize;
+
+            sizes[j] = size;
+            delta[jseg[j]] += size - base[j].size;
+        }
+
+        if (l < relax.nlabels && lseg[l] >= 0) {
+            int64_t v = lbase[l] + delta[lseg[l]];
+            if (v != lv[l]) {
+                lv[l] = v;
+                changed++;
+            }
+        }
+    }
+
+    return changed;
+}
+
+/*
+ * Called at the end of a preparatory pass in which labels moved.
+ */
+void relax_solve(void)
+{
+    struct RAA *segmap = raa_init();
+    int nsegs = 0;
+    size_t *seglabels = NULL, *segstart = NULL;
+    int64_t *lv = NULL, *lcur = NULL, *lprev = NULL, *sizes = NULL;
+    size_t j, l, changed, prev_changed, stall, iter;
+    int s;
+
+    if (!relax.active)
+        return;
+
+    if (relax.predicted) {
+        /* The prediction was wrong, give up */
+        relax_cleanup();
+        relax.disabled = true;
+        return;
+    }
+
+    if (!relax.solvable || !relax.njumps ||
+        relax.njumps != relax.nprev_jumps)
+        return;
+
+    /* Number the segments containing jumps */
+    nasm_newn(jseg, relax.njumps);
+    for (j = 0; j < relax.njumps; j++) {
+        const struct jump *jp = &relax.jumps[j];
+
+        if (jp->segment != relax.prev_jumps[j].segment)
+            goto done;
+
+        s = raa_read(segmap, jp->segment);
+        if (!s) {
+            s = ++nsegs;
+            segmap = raa_write(segmap, jp->segment, s);
+        }
+        jseg[j] = s - 1;
+    }
+
+    nasm_newn(lseg, relax.nlabels);
+    nasm_newn(delta, nsegs);
+    nasm_newn(segstart, nsegs + 1);
+    for (l = 0; l < relax.nlabels; l++) {
+        const struct rlabel *lp = &relax.labels[l];
+
+        lseg[l] = lp->segment == NO_SEG ? -1 :
+            (int)raa_read(segmap, lp->segment) - 1;
+        if (lseg[l] >= 0)
+            segstart[lseg[l] + 1]++;
+    }
+
+    /*
+     * Check that every label moved by the size change of the jumps
+     * preceding it in the same segment.
+     */
+    j = 0;
+    for (l = 0; l < relax.nlabels; l++) {
+        const struct rlabel *lp = &relax.labels[l];
+        int64_t moved;
+
+        for (; j < lp->njumps; j++)
+            delta[jseg[j]] += relax.jumps[j].size - relax.prev_jumps[j].size;
+
+        if (!lp->known || lp->segment != lp->prev_segment)
+            goto done;
+
+        moved = lseg[l] >= 0 ? delta[lseg[l]] : 0;
+        if (lp->offset != lp->prev_offset + moved)
+            goto done;
+    }
+
+    /* Labels of each segment, in order */
+    for (s = 0; s < nsegs; s++)
+        segstart[s + 1] += segstart[s];
+    nasm_newn(seglabels, segstart[nsegs]);
+    memset(delta, 0, nsegs * sizeof(*delta));
+    for (l = 0; l < relax.nlabels; l++) {
+        if (lseg[l] >= 0)
+            seglabels[segstart[lseg[l]] + delta[lseg[l]]++] = l;
+    }
+
+    nasm_newn(lcur, relax.nlabels);
+    nasm_newn(lprev, relax.nlabels);
+    for (l = 0; l < relax.nlabels; l++) {
+        lcur[l]  = relax.labels[l].offset;
+        lprev[l] = relax.labels[l].prev_offset;
+    }
+
+    /* The labels of a segment must be in address order */
+    for (s = 0; s < nsegs; s++) {
+        for (l = segstart[s] + 1; l < segstart[s + 1]; l++) {
+            if (lcur[seglabels[l]] < lcur[seglabels[l - 1]] ||
+                lprev[seglabels[l]] < lprev[seglabels[l - 1]])
+                goto done;
+        }
+    }
+
+    /*
+     * Find the target of each jump.  A label defined before the jump
+     * was seen with its value in this pass, a label defined after it
+     * with its value in the previous pass.
+     */
+    nasm_newn(anchors, relax.njumps);
+    for (j = 0; j < relax.njumps; j++) {
+        const struct jump *jp = &relax.jumps[j];
+        struct anchor *a = &anchors[j];
+        size_t lo, hi, mid, back, fwd;
+
+        if (jp->tsegment != jp->segment) {
+            a->type = ANCHOR_FAR;
+            continue;
+        }
+
+        /* Split the labels of this segment at the jump */
+        s  = jseg[j];
+        lo = segstart[s];
+        hi = segstart[s + 1];
+        while (lo < hi) {
+            mid = lo + ((hi - lo) >> 1);
+            if (relax.labels[seglabels[mid]].njumps <= j)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        back = find_offset(seglabels, lcur, segstart[s], lo, jp->target);
+        fwd  = find_offset(seglabels, lprev, lo, segstart[s + 1], jp->target);
+
+        if (back < lo && fwd < segstart[s + 1]) {
+            goto done;          /* Ambiguous */
+        } else if (back < lo) {
+            a->type  = ANCHOR_LABEL;
+            a->label = seglabels[back];
+        } else if (fwd < segstart[s + 1]) {
+            a->type  = ANCHOR_LABEL;
+            a->label = seglabels[fwd];
+        } else {
+            a->type  = ANCHOR_SELF;
+            a->delta = jp->target - jp->offset;
+        }
+    }
+
+    /*
+     * Verify the model: starting from the previous pass, it must
+     * reproduce the jump sizes of this pass.
+     */
+    nasm_newn(lv, relax.nlabels);
+    nasm_newn(sizes, relax.njumps);
+    memcpy(lv, lprev, relax.nlabels * sizeof(*lv));
+    relax_pass(relax.prev_jumps, lprev, lv, sizes, nsegs);
+    for (j = 0; j < relax.njumps; j++) {
+        if (sizes[j] != relax.jumps[j].size)
+            goto done;
+    }
+
+    /* Run passes until nothing moves, with the same limits as the real ones */
+    memcpy(lv, lcur, relax.nlabels * sizeof(*lv));
+    prev_changed = (size_t)-1;
+    stall = iter = 0;
+    while ((changed = relax_pass(relax.jumps, lcur, lv, sizes, nsegs))) {
+        iter++;
+        if (changed < prev_changed) {
+            prev_changed = changed;
+            stall = 0;
+        } else {
+            stall++;
+        }
+
+        if ((int64_t)stall > nasm_limit[LIMIT_STALLED] ||
+            pass_count() + (int64_t)iter >= nasm_limit[LIMIT_PASSES])
+            goto done;
+    }
+
+    if (iter) {
+        for (l = 0; l < relax.nlabels; l++) {
+            if (lv[l] != lcur[l])
+                set_label_offset(relax.labels[l].lptr, lv[l]);
+        }
+        relax.predicted = true;
+    }
+
+done:
+    raa_free(segmap);
+    nasm_free(jseg);
+    nasm_free(lseg);
+    nasm_free(delta);
+    nasm_free(anchors);
+    nasm_free(segstart);
+    nasm_free(seglabels);
+    nasm_free(lcur);
+    nasm_free(lprev);
+    nasm_free(lv);
+    nasm_free(sizes);
+    jseg = lseg = NULL;
+    delta = NULL;
+    anchors = NULL;
+}
+
+void relax_cleanup(void)
+{
+    nasm_free(relax.jumps);
+    nasm_free(relax.prev_jumps);
+    nasm_free(relax.labels);
+    nasm_zero(relax);
+}
@@ -49,3 +49,8 @@ int32_t seg_alloc(void)
     next_seg += 2;
     return this_seg;
 }
+
+void seg_alloc_reset(void)
+{
+    next_seg = 2;
+}
@@ -44,13 +44,56 @@
 
 /*
  * Standard scanner routine used by parser.c and some output
- * formats. It keeps a succession of temporary-storage strings in
- * stdscan_tempstorage, which can be cleared using stdscan_reset.
+ * formats. It keeps the token strings it returns in temporary
+ * storage blocks, which can be cleared using stdscan_reset.
  */
 static char *stdscan_bufptr = NULL;
-static char **stdscan_tempstorage = NULL;
-static int stdscan_tempsize = 0, stdscan_templen = 0;
-#define STDSCAN_TEMP_DELTA 256
+
+struct stdscan_block {
+    struct stdscan_block *prev;
+    size_t size;
+    char data[1];
+};
+static struct stdscan_block *stdscan_block;
+static size_t stdscan_used, stdscan_lastlen;
+static const char *stdscan_src; /* Source of the last stdscan_copy() */
+#define STDSCAN_BLOCK_SIZE 4096
+
+/*
+ * A token stream records the tokens stdscan() returned for a line,
+ * so that the line can be parsed again on a later pass without being
+ * scanned again.  The parser goes back and forth over a line, so
+ * the stream is a log of every call, together with the position in
+ * the line where it was made; it is replayed only as long as each
+ * call is made at the same position as before.  Since the parser
+ * only ever sees the same tokens, it then makes the same calls.
+ *
+ * Strings are unquoted in place, and some tokens issue diagnostics;
+ * those are simply scanned again at replay, from the same position
+ * in an identical buffer.
+ */
+struct scantok {
+    int64_t integer;            /* t_integer */
+    int64_t inttwo;             /* t_inttwo */
+    uint32_t from, to;          /* Buffer offsets before and after */
+    uint32_t text, textlen;     /* Buffer offset of t_charptr text */
+    enum token_type type;
+    int8_t flag;                /* t_flag */
+    bool rescan;                /* Scan this one again */
+};
+
+struct tokstream {
+    size_t ntok;
+    struct scantok tok[1];
+};
+
+static char *stdscan_base;      /* Start of the line being streamed */
+static size_t stdscan_baselen;
+static const struct tokstream *stdscan_replay_ts; /* Stream being replayed */
+static size_t stdscan_replay_pos;
+static struct tokstream **stdscan_record_tsp; /* Stream being recorded */
+static struct scantok *stdscan_rec;           /* ... and its tokens so far */
+static size_t stdscan_nrec, stdscan_maxrec;
 
 void stdscan_set(char *str)
 {
@@ -64,13 +107,22 @@ char *stdscan_get(void)
 
 static void stdscan_pop(void)
 {
-    nasm_free(stdscan_tempstorage[--stdscan_templen]);
+    stdscan_used -= stdscan_lastlen;
 }
 
 void stdscan_reset(void)
 {
-    while (stdscan_templen > 0)
-        stdscan_pop();
+    struct stdscan_block *b, *prev;
+
+    if (!stdscan_block)
+        return;
+
+    for (b = stdscan_block->prev; b; b = prev) {
+        prev = b->prev;
+        nasm_free(b);
+    }
+    stdscan_block->prev = NULL;
+    stdscan_used = 0;
 }
 
 /*
@@ -80,28 +132,85 @@ void stdscan_reset(void)
 void stdscan_cleanup(void)
 {
     stdscan_reset();
-    nasm_free(stdscan_tempstorage);
+    nasm_free(stdscan_block);
+    stdscan_block = NULL;
+    nasm_free(stdscan_rec);
+    stdscan_rec = NULL;
+    stdscan_maxrec = 0;
 }
 
 static char *stdscan_copy(const char *p, int len)
 {
+    struct stdscan_block *b = stdscan_block;
     char *text;
 
-    text = nasm_malloc(len + 1);
+    if (!b || b->size - stdscan_used < (size_t)len + 1) {
+        size_t size = len < STDSCAN_BLOCK_SIZE ? STDSCAN_BLOCK_SIZE : len + 1;
+
+        b = nasm_malloc(sizeof *b + size - 1);
+        b->prev = stdscan_block;
+        b->size = size;
+        stdscan_block = b;
+        stdscan_used = 0;
+    }
+
+    text = b->data + stdscan_used;
     memcpy(text, p, len);
     text[len] = '\0';
 
-    if (stdscan_templen >= stdscan_tempsize) {
-        stdscan_tempsize += STDSCAN_TEMP_DELTA;
-        stdscan_tempstorage = nasm_realloc(stdscan_tempstorage,
-                                           stdscan_tempsize *
-                                           sizeof(char *));
-    }
-    stdscan_tempstorage[stdscan_templen++] = text;
+    stdscan_lastlen = len + 1;
+    stdscan_used += stdscan_lastlen;
+    stdscan_src = p;
 
     return text;
 }
 
+static void stdscan_end_record(void)
+{
+    struct tokstream *ts;
+
+    if (!stdscan_record_tsp || !stdscan_nrec) {
+        stdscan_record_tsp = NULL;
+        return;
+    }
+
+    ts = nasm_malloc(sizeof *ts + (stdscan_nrec - 1) * sizeof *ts->tok);
+    ts->ntok = stdscan_nrec;
+    memcpy(ts->tok, stdscan_rec, stdscan_nrec * sizeof *ts->tok);
+    *stdscan_record_tsp = ts;
+    stdscan_record_tsp = NULL;
+}
+
+/*
+ * Scan the line starting at base through the token stream *tsp,
+ * replaying it if there is one and recording a new one if not.
+ * Called with a NULL tsp to stop.
+ */
+void stdscan_set_stream(struct tokstream **tsp, char *base)
+{
+    stdscan_end_record();
+    stdscan_replay_ts = NULL;
+
+    if (!tsp)
+        return;
+
+    stdscan_base    = base;
+    stdscan_baselen = strlen(base);
+
+    if (*tsp) {
+        stdscan_replay_ts  = *tsp;
+        stdscan_replay_pos = 0;
+    } else {
+        stdscan_record_tsp = tsp;
+        stdscan_nrec       = 0;
+    }
+}
+
+void stdscan_free_stream(struct tokstream *ts)
+{
+    nasm_free(ts);
+}
+
 /*
  * a token is enclosed with braces. proper token type will be assigned
  * accordingly with the token flag.
@@ -122,12 +231,10 @@ static int stdscan_handle_brace(struct tokenval *tv)
     return tv->t_type;
 }
 
-int stdscan(void *private_data, struct tokenval *tv)
+static int stdscan_scan(struct tokenval *tv)
 {
     const char *r;
 
-    (void)private_data;         /* Don't warn that this parameter is unused */
-
     nasm_zero(*tv);
 
     stdscan_bufptr = nasm_skip_spaces(stdscan_bufptr);
@@ -344,3 +451,96 @@ int stdscan(void *private_data, struct tokenval *tv)
     } else                      /* just an ordinary char */
         return tv->t_type = (uint8_t)(*stdscan_bufptr++);
 }
+
+/* Replay the next token of the stream, if it was scanned from here */
+static const struct scantok *stdscan_replay(struct tokenval *tv)
+{
+    const struct tokstream *ts = stdscan_replay_ts;
+    const struct scantok *st;
+
+    if (stdscan_replay_pos >= ts->ntok)
+        goto stop;
+
+    st = &ts->tok[stdscan_replay_pos];
+    if (stdscan_bufptr != stdscan_base + st->from)
+        goto stop;
+
+    stdscan_replay_pos++;
+    if (st->rescan)
+        return st;
+
+    nasm_zero(*tv);
+    tv->t_integer = st->integer;
+    tv->t_inttwo  = st->inttwo;
+    tv->t_flag    = st->flag;
+    if (st->textlen)
+        tv->t_charptr = stdscan_copy(stdscan_base + st->text, st->textlen);
+    stdscan_bufptr = stdscan_base + st->to;
+    return st;
+
+stop:
+    stdscan_replay_ts = NULL;
+    return NULL;
+}
+
+static void stdscan_record(const struct tokenval *tv, const char *from,
+                           uint64_t errors)
+{
+    struct scantok *st;
+
+    if (from < stdscan_base || from > stdscan_base + stdscan_baselen ||
+        stdscan_bufptr > stdscan_base + stdscan_baselen) {
+        /* Not scanning the line the stream belongs to */
+        stdscan_end_record();
+        return;
+    }
+
+    if (stdscan_nrec >= stdscan_maxrec) {
+        stdscan_maxrec = stdscan_maxrec ? stdscan_maxrec << 1 : 64;
+        stdscan_rec = nasm_realloc(stdscan_rec,
+                                   stdscan_maxrec * sizeof *stdscan_rec);
+    }
+
+    st = &stdscan_rec[stdscan_nrec++];
+    nasm_zero(*st);
+    st->from = from - stdscan_base;
+
+    if (tv->t_type == TOKEN_STR || tv->t_type == TOKEN_ERRSTR ||
+        errors != nasm_error_count) {
+        st->rescan = true;
+        return;
+    }
+
+    st->to      = stdscan_bufptr - stdscan_base;
+    st->type    = tv->t_type;
+    st->integer = tv->t_integer;
+    st->inttwo  = tv->t_inttwo;
+    st->flag    = tv->t_flag;
+    if (tv->t_charptr) {
+        st->text    = stdscan_src - stdscan_base;
+        st->textlen = stdscan_lastlen - 1;
+    }
+}
+
+int stdscan(void *private_data, struct tokenval *tv)
+{
+    const char *from = stdscan_bufptr;
+    uint64_t errors = nasm_error_count;
+    int type;
+
+    (void)private_data;         /* Don't warn that this parameter is unused */
+
+    if (stdscan_replay_ts) {
+        const struct scantok *st = stdscan_replay(tv);
+        if (st && !st->rescan)
+            return tv->t_type = st->type;
+        return stdscan_scan(tv);
+    }
+
+    type = stdscan_scan(tv);
+
+    if (stdscan_record_tsp)
+        stdscan_record(tv, from, errors);
+
+    return type;
+}
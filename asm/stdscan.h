@@ -46,4 +46,9 @@ int stdscan(void *private_data, struct tokenval *tv);
 int nasm_token_hash(const char *token, struct tokenval *tv);
 void stdscan_cleanup(void);
 
+/* Token streams, to scan a line only once across passes */
+struct tokstream;
+void stdscan_set_stream(struct tokstream **tsp, char *base);
+void stdscan_free_stream(struct tokstream *ts);
+
 #endif
@@ -142,6 +142,13 @@ typedef struct nasm_errhold *errhold;
 errhold nasm_error_hold_push(void);
 void nasm_error_hold_pop(errhold hold, bool issue);
 
+/*
+ * Count of all messages passed to nasm_verror(), including those
+ * which end up suppressed; lets a caller tell if an operation
+ * produced any diagnostics at all.
+ */
+extern uint64_t nasm_error_count;
+
 /* Should be included from within error.h only */
 #include "warnings.h"
 
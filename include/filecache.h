@@ -0,0 +1,77 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * filecache.h - contents of input files, read once per session
+ */
+
+#ifndef NASM_FILECACHE_H
+#define NASM_FILECACHE_H
+
+#include "compiler.h"
+#include "md5.h"
+
+/* Zero bytes after the contents; enough for a NUL and a word read */
+#define FILE_CACHE_PAD 16
+
+struct cached_file {
+    /*
+     * The contents may be modified temporarily (the preprocessor
+     * terminates lines in place), but must be restored before anyone
+     * else gets to look at them.
+     */
+    char *data;                 /* Contents, then FILE_CACHE_PAD NULs */
+    size_t len;
+    unsigned char md5[MD5_HASHBYTES]; /* MD5 sum of the contents */
+};
+
+/*
+ * Return the contents of the file path, which fp is an open stream
+ * for if it is not NULL.  The file is read the first time it is
+ * asked for, and again only if its size or modification time has
+ * changed.  Returns NULL if the file cannot be opened or is not a
+ * regular file; in the latter case fp can still be read directly.
+ */
+const struct cached_file *file_cache_get(const char *path, FILE *fp);
+
+/* Forget all cached files, at the end of a session */
+void file_cache_free(void);
+
+/*
+ * Start a session in a resident process, keeping the files cached
+ * by the last one if the working directory is the same.
+ */
+void file_cache_new_session(void);
+
+#endif /* NASM_FILECACHE_H */
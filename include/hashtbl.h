@@ -89,6 +89,8 @@ void **hash_findi(struct hash_table *head, const char *string,
 		struct hash_insert *insert);
 void **hash_findib(struct hash_table *head, const void *key, size_t keylen,
                    struct hash_insert *insert);
+void **hash_findp(struct hash_table *head, uint64_t hash, const void *key,
+                  size_t keylen, struct hash_insert *insert);
 void **hash_add(struct hash_insert *insert, const void *key, void *data);
 static inline void hash_iterator_init(const struct hash_table *head,
                                       struct hash_iterator *iterator)
@@ -76,7 +76,7 @@ IF_GEN_HELPER(xor, ^)
 
 #define _itemp_smask(idx)      (insns_flags[(idx)].field[0] & IF_SMASK)
 #define _itemp_armask(idx)     (insns_flags[(idx)].field[0] & IF_ARMASK)
-#define _itemp_arg(idx)        ((_itemp_armask(idx) >> IF_AR0) - 1)
+#define _itemp_arg(idx)        (ilog2_32(_itemp_armask(idx)) - IF_AR0)
 
 #define itemp_smask(itemp)      _itemp_smask((itemp)->iflag_idx)
 #define itemp_arg(itemp)        _itemp_arg((itemp)->iflag_idx)
@@ -21,8 +21,39 @@ struct itemplate {
     decoflags_t     deco[MAX_OPERANDS]; /* bit flags for operand decorators */
     const uint8_t   *code;              /* the code it assembles to */
     uint32_t        iflag_idx;          /* some flags referenced by index */
+    uint32_t        mflags;             /* ITM_* flags for the matcher */
 };
 
+/*
+ * Template properties tested by the instruction matcher.  insns.pl
+ * derives these from the instruction flags and the bytecode, so
+ * matching a template does not need to look up insns_flags[].
+ */
+#define ITM_SIZE_MASK   0x0000000f      /* Operand size flag, one of: */
+#define ITM_SB          0x00000001
+#define ITM_SW          0x00000002
+#define ITM_SD          0x00000003
+#define ITM_SQ          0x00000004
+#define ITM_SO          0x00000005
+#define ITM_SY          0x00000006
+#define ITM_SZ          0x00000007
+#define ITM_ANYSIZE     0x00000008
+#define ITM_SIZE        0x00000009
+#define ITM_AR_SHIFT    4
+#define ITM_AR_MASK     0x00000070      /* Size flag applies to operand n-1 */
+#define ITM_AR(n)       (((n)+1) << ITM_AR_SHIFT)
+#define ITM_SM          0x00000080
+#define ITM_SM2         0x00000100
+#define ITM_SX          0x00000200
+#define ITM_OPT         0x00000400
+#define ITM_VEX         0x00000800
+#define ITM_EVEX        0x00001000
+#define ITM_LONG        0x00002000
+#define ITM_NOLONG      0x00004000
+#define ITM_NOHLE       0x00008000
+#define ITM_BND         0x00010000
+#define ITM_JUMP        0x00020000      /* Relaxable jump (\370 or \371) */
+
 /* Use this helper to test instruction template flags */
 static inline bool itemp_has(const struct itemplate *itemp, unsigned int bit)
 {
@@ -43,6 +74,12 @@ struct disasm_index {
 
 /* Tables for the assembler and disassembler, respectively */
 extern const struct itemplate * const nasm_instructions[];
+/*
+ * Templates indexed by opcode and operand count, in the same order
+ * as in nasm_instructions[]; each list is terminated by NULL.
+ */
+extern const struct itemplate * const * const
+    nasm_insn_index[][MAX_OPERANDS+1];
 extern const struct disasm_index itable[256];
 extern const struct disasm_index * const itable_vex[NASM_VEX_CLASSES][32][4];
 
@@ -52,7 +89,7 @@ extern const uint8_t nasm_bytecodes[];
 /*
  * this define is used to signify the end of an itemplate
  */
-#define ITEMPLATE_END {I_none,0,{0,},{0,},NULL,0}
+#define ITEMPLATE_END {I_none,0,{0,},{0,},NULL,0,0}
 
 /*
  * Pseudo-op tests
@@ -59,6 +59,8 @@ enum label_type {
     LBL_BACKEND                 /* Backend-defined symbols like ..got */
 };
 
+union label;
+
 enum label_type lookup_label(const char *label, int32_t *segment, int64_t *offset);
 static inline bool is_extern(enum label_type type)
 {
@@ -67,6 +69,7 @@ static inline bool is_extern(enum label_type type)
 void define_label(const char *label, int32_t segment, int64_t offset,
                   bool normal);
 void backend_label(const char *label, int32_t segment, int64_t offset);
+void set_label_offset(union label *lptr, int64_t offset);
 bool declare_label(const char *label, enum label_type type,
                    const char *special);
 void set_label_mangle(enum mangle_index which, const char *what);
@@ -105,6 +105,7 @@ enum out_type {
     OUT_ADDRESS,    /* An address (symbol value) */
     OUT_RELADDR,    /* A relative address */
     OUT_SEGMENT,    /* A segment number */
+    OUT_FILEDATA,   /* Range of an input file (OFMT_FILEDATA only) */
 
     /*
      * These values are used by the legacy backend interface only;
@@ -125,6 +126,16 @@ enum out_flags {
     OUT_SIGNMASK = 3            /* Mask for signedness bits */
 };
 
+/*
+ * What the data pointer points to for OUT_FILEDATA.  The backend
+ * copies the range into the output file when it writes it, so the
+ * contents of the file are never read into memory.
+ */
+struct out_filedata {
+    const char *path;
+    uint64_t offset;            /* Start of the range in the file */
+};
+
 /*
  * The data we send down to the backend.
  * XXX: We still want to push down the base address symbol if
@@ -421,7 +432,9 @@ enum preproc_mode {
 enum preproc_opt {
     PP_TRIVIAL  = 1,            /* Only %line or # directives */
     PP_NOLINE   = 2,            /* Ignore %line and # directives */
-    PP_TASM     = 4             /* TASM compatibility hacks */
+    PP_TASM     = 4,            /* TASM compatibility hacks */
+    PP_NOCACHE  = 8,            /* Don't replay output across passes */
+    PP_RESIDENT = 16            /* Keep caches for the next session */
 };
 
 /*
@@ -470,6 +483,18 @@ void pp_pre_command(const char *what, char *str);
 /* Include path from command line */
 void pp_include_path(struct strlist *ipath);
 
+/* Record the files searched for in the include path and not found */
+void pp_search_misses(struct strlist *list);
+
+/* Snapshot file of the state after the predefinitions, or NULL */
+void pp_snapshot(const char *path);
+
+/*
+ * True if the output depends on the date, the time or the environment,
+ * not only on the files read, in this session
+ */
+bool pp_volatile_used(void);
+
 /* Unwind the macro stack when printing an error message */
 void pp_error_list_macros(errflags severity);
 
@@ -675,7 +700,8 @@ enum extop_type { /* extended operand types */
     EOT_DB_FLOAT,       /* Floating-pointer number (special byte string) */
     EOT_DB_STRING_FREE, /* Byte string which should be nasm_free'd*/
     EOT_DB_NUMBER,      /* Integer */
-    EOT_DB_RESERVE      /* ? */
+    EOT_DB_RESERVE,     /* ? */
+    EOT_DB_NUMBERS      /* Run of plain integers */
 };
 
 typedef struct extop { /* extended operand */
@@ -691,6 +717,10 @@ typedef struct extop { /* extended operand */
             int32_t  wrt;        /* address wrt */
             bool     relative;   /* self-relative expression */
         } num;
+        struct {                 /* integers without a segment or wrt */
+            int64_t *vals;
+            size_t   n, size;
+        } nums;
         struct extop *subexpr;   /* actual expressions */
     } val;
     size_t dup;                  /* duplicated? */
@@ -886,6 +916,7 @@ struct ofmt {
      */
 #define OFMT_TEXT		1	/* Text file format */
 #define OFMT_KEEP_ADDR	2	/* Keep addr; no conversion to data */
+#define OFMT_FILEDATA	4	/* Accepts OUT_FILEDATA */
 
     unsigned int flags;
 
@@ -247,8 +247,10 @@ int64_t readstrnum(char *str, int length, bool *warn);
 
 /*
  * seg_alloc: allocate a hitherto unused segment number.
+ * seg_alloc_reset: start over from the first segment number.
  */
 int32_t seg_alloc(void);
+void seg_alloc_reset(void);
 
 /*
  * Add/replace or remove an extension to the end of a filename
@@ -369,6 +371,8 @@ enum file_flags {
 
 FILE *nasm_open_read(const char *filename, enum file_flags flags);
 FILE *nasm_open_write(const char *filename, enum file_flags flags);
+FILE *nasm_open_write_temp(const char *filename, enum file_flags flags,
+                          char **tempname);
 
 void nasm_set_binary_mode(FILE *f);
 
@@ -400,8 +404,10 @@ const void *nasm_map_file(FILE *fp, off_t start, off_t len);
 void nasm_unmap_file(const void *p, size_t len);
 off_t nasm_file_size(FILE *f);
 off_t nasm_file_size_by_path(const char *pathname);
+void *nasm_load_file(FILE *f, size_t *lenp, size_t pad);
 bool nasm_file_time(time_t *t, const char *pathname);
 void fwritezero(off_t bytes, FILE *fp);
+bool nasm_copy_file_range(FILE *in, off_t offset, off_t len, FILE *out);
 
 static inline bool const_func overflow_general(int64_t value, int bytes)
 {
@@ -464,4 +470,27 @@ static inline int64_t const_func signed_bits(int64_t value, int bits)
 /* try to get the system stack size */
 extern size_t nasm_get_stack_size_limit(void);
 
+/*
+ * Run func(0) ... func(n-1), each in a worker process of its own, at
+ * most njobs at a time.  The standard output and standard error of
+ * each worker are collected and copied to stdout and errfile in index
+ * order.  Returns true if all the workers returned zero.
+ */
+typedef int (*nasm_worker_func)(size_t index, FILE *err);
+bool nasm_run_workers(size_t n, unsigned int njobs,
+                      nasm_worker_func func, FILE *errfile);
+
+/*
+ * Listen on the local socket path and run func for each job sent by
+ * nasm_client(), one at a time, in the working directory and with the
+ * environment, standard output and standard error of the client.  If
+ * func sets *restart, or the job crashes, the next job is run in a
+ * fresh copy of the server process.  Does not return.
+ */
+typedef int (*nasm_job_func)(int argc, char **argv, bool *restart);
+no_return nasm_serve(const char *path, nasm_job_func func);
+
+/* Send a job to a server; returns the exit status of the job */
+int nasm_client(const char *path, int argc, char **argv);
+
 #endif
@@ -0,0 +1,108 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * profile.h - counters and timers for the --profile option
+ */
+
+#ifndef NASM_PROFILE_H
+#define NASM_PROFILE_H
+
+#include "compiler.h"
+
+/*
+ * Event counters; these are always maintained, since an increment
+ * is cheaper than testing if profiling is enabled.
+ */
+enum profile_counter {
+    PROF_LINES,                 /* Lines seen by the assembler */
+    PROF_TOKENS,                /* Preprocessor tokens allocated */
+    PROF_SMACROS,               /* Single-line macro expansions */
+    PROF_MMACROS,               /* Multi-line macro expansions */
+    PROF_HASH_LOOKUPS,          /* Hash table lookups */
+    PROF_HASH_PROBES,           /* Hash table slots examined */
+    PROF_LABEL_LOOKUPS,         /* Label table lookups */
+    PROF_TOKEN_MEMORY,          /* Peak memory held for preprocessor tokens */
+    PROF_GUARDED_INCLUDES,      /* Includes skipped due to include guards */
+    PROF_COND_SKIPPED,          /* Lines skipped untokenized in false %if */
+    PROF_SMACRO_FILTERED,       /* Identifiers ruled out as smacros unlooked */
+    PROF_ENCODE_HITS,           /* Instruction sizes found in the cache */
+    PROF_ENCODE_MISSES,         /* Instruction sizes computed */
+    PROF_COUNTERS
+};
+
+/* Timed phases of a pass; these never nest */
+enum profile_phase {
+    PROF_PREPROC,               /* Preprocessor */
+    PROF_PARSE,                 /* Instruction parser */
+    PROF_MATCH,                 /* Template matching and sizing */
+    PROF_OUTPUT,                /* Output format backend */
+    PROF_PHASES
+};
+
+extern bool profiling;
+extern uint64_t profile_counters[PROF_COUNTERS];
+extern uint64_t profile_times[PROF_PHASES];
+
+static inline void profile_count(enum profile_counter counter)
+{
+    profile_counters[counter]++;
+}
+
+/* Record a new value for a high water mark counter */
+static inline void profile_peak(enum profile_counter counter, uint64_t value)
+{
+    if (value > profile_counters[counter])
+        profile_counters[counter] = value;
+}
+
+uint64_t profile_clock(void);
+
+/* Start timing a phase; returns the start time */
+static inline uint64_t profile_start(void)
+{
+    return unlikely(profiling) ? profile_clock() : 0;
+}
+
+/* Charge the time since start to a phase */
+static inline void profile_stop(enum profile_phase phase, uint64_t start)
+{
+    if (unlikely(profiling))
+        profile_times[phase] += profile_clock() - start;
+}
+
+void profile_reset(void);
+void profile_pass(int64_t passn, const char *type, uint64_t start);
+void profile_write(const char *fname, const char *input, uint64_t start);
+
+#endif /* NASM_PROFILE_H */
@@ -0,0 +1,88 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * atom.c - interned identifiers
+ *
+ * The preprocessor looks up the same identifiers in its macro tables
+ * over and over.  Interning them once per session means the case
+ * folded hash only has to be computed once per spelling, and keys
+ * can be compared by address.
+ */
+
+#include "compiler.h"
+
+#include "nasmlib.h"
+#include "hashtbl.h"
+#include "atom.h"
+
+static struct hash_table atoms; /* By exact spelling */
+static struct hash_table folds; /* Ignoring case */
+
+const struct atom *atom_get(const char *name, size_t len)
+{
+    struct hash_insert hi;
+    struct atom *a;
+    char *p;
+    void **fp;
+
+    fp = hash_findb(&atoms, name, len, &hi);
+    if (fp)
+        return *fp;
+
+    a = nasm_malloc(sizeof *a + len + 1);
+    p = (char *)(a + 1);
+    memcpy(p, name, len);
+    p[len] = '\0';
+    a->name  = p;
+    a->len   = len;
+    a->ihash = crc64ib(CRC64_INIT, p, len+1);
+    hash_add(&hi, p, a);
+
+    fp = hash_findib(&folds, p, len, &hi);
+    if (fp) {
+        a->fold = *fp;
+    } else {
+        a->fold = a;
+        hash_add(&hi, p, a);
+    }
+
+    return a;
+}
+
+void atom_free_all(void)
+{
+    hash_free(&folds);
+    hash_free_all(&atoms, false);
+}
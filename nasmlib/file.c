@@ -32,6 +32,7 @@
  * ----------------------------------------------------------------------- */
 
 #include "file.h"
+#include <time.h>
 
 void nasm_read(void *ptr, size_t size, FILE *f)
 {
@@ -101,6 +102,82 @@ void fwritezero(off_t bytes, FILE *fp)
     }
 }
 
+/*
+ * Copy len bytes at offset in the file in to the current position of
+ * out.  If the system can do it, the data goes from one file to the
+ * other without passing through our memory.  Returns false if the
+ * input file could not be read or is too short.
+ */
+bool nasm_copy_file_range(FILE *in, off_t offset, off_t len, FILE *out)
+{
+    const void *map;
+    char *buf;
+    size_t blksize, n;
+
+    /* A mapping of a file which has become shorter faults */
+    if (nasm_file_size(in) < offset + len)
+        return false;
+
+#if defined(HAVE_FILENO) && \
+    (defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SENDFILE))
+    if (len > 0 && !fflush(out) && ftello(out) != (off_t)-1) {
+        const int ifd = fileno(in), ofd = fileno(out);
+        off_t ipos = offset, opos = ftello(out);
+        ssize_t m;
+
+# ifdef HAVE_COPY_FILE_RANGE
+        while (len > 0) {
+            m = copy_file_range(ifd, &ipos, ofd, &opos, len, 0);
+            if (m <= 0)
+                break;
+            len -= m;
+        }
+# endif
+# ifdef HAVE_SENDFILE
+        if (len > 0 && lseek(ofd, opos, SEEK_SET) == opos) {
+            while (len > 0) {
+                m = sendfile(ofd, ifd, &ipos, len);
+                if (m <= 0)
+                    break;
+                opos += m;
+                len  -= m;
+            }
+        }
+# endif
+        /* Let stdio know where we are now */
+        if (fseeko(out, opos, SEEK_SET))
+            return false;
+        offset = ipos;
+    }
+#endif
+
+    if (len <= 0)
+        return true;
+
+    map = nasm_map_file(in, offset, len);
+    if (map) {
+        nasm_write(map, len, out);
+        nasm_unmap_file(map, len);
+        return true;
+    }
+
+    if (fseeko(in, offset, SEEK_SET))
+        return false;
+
+    blksize = len < ZERO_BUF_SIZE ? (size_t)len : ZERO_BUF_SIZE;
+    buf = nasm_malloc(blksize);
+    while (len > 0) {
+        n = fread(buf, 1, len < (off_t)blksize ? (size_t)len : blksize, in);
+        if (!n)
+            break;
+        nasm_write(buf, n, out);
+        len -= n;
+    }
+    nasm_free(buf);
+
+    return len <= 0;
+}
+
 #ifdef _WIN32
 
 /*
@@ -232,6 +309,57 @@ FILE *nasm_open_write(const char *filename, enum file_flags flags)
     return f;
 }
 
+/*
+ * Open a new file with a unique name in the same directory as
+ * filename, to be renamed over it once it has been written.  The
+ * name is returned in *tempname, which the caller must free.
+ */
+FILE *nasm_open_write_temp(const char *filename, enum file_flags flags,
+                           char **tempname)
+{
+    FILE *f = NULL;
+    char *tname;
+
+#if defined(HAVE_MKSTEMP) && defined(HAVE_FDOPEN)
+    int fd;
+
+    tname = nasm_strcat(filename, ".XXXXXX");
+    fd = mkstemp(tname);
+    if (fd >= 0) {
+        f = fdopen(fd, "wb");
+        if (!f) {
+            close(fd);
+            remove(tname);
+        }
+    }
+#else
+    unsigned int i;
+
+    /* Not atomic, but good enough to keep concurrent runs apart */
+    tname = NULL;
+    for (i = 0; i < 100; i++) {
+        nasm_free(tname);
+        tname = nasm_asprintf("%s.%x.tmp",
+                              filename, (unsigned int)(time(NULL) + rand()));
+        if (!nasm_file_exists(tname)) {
+            f = nasm_open_write(tname, flags & ~NF_FATAL);
+            break;
+        }
+    }
+#endif
+
+    if (!f) {
+        if (flags & NF_FATAL)
+            nasm_fatalf(ERR_NOFILE, "unable to open output file: `%s': %s",
+                        tname, strerror(errno));
+        nasm_free(tname);
+        tname = NULL;
+    }
+
+    *tempname = tname;
+    return f;
+}
+
 /* The appropriate "rb" strings for os_fopen() */
 static const os_fopenflag fopenflags_rb[3] = { 'r', 'b', 0 };
 
@@ -303,6 +431,39 @@ fail:
     return -1;
 }
 
+/*
+ * Read the rest of an open file into memory, in as few reads as
+ * possible.  The buffer is followed by pad zero bytes, which are not
+ * included in the length returned in *lenp.
+ */
+void *nasm_load_file(FILE *f, size_t *lenp, size_t pad)
+{
+    off_t size = nasm_file_size(f);
+    size_t len = 0, bufsize;
+    char *buf;
+
+    if (size > 0 && (off_t)(size_t)size == size)
+        bufsize = size + 1;     /* +1 so a complete file hits EOF */
+    else
+        bufsize = 65536;
+
+    buf = nasm_malloc(bufsize + pad);
+    for (;;) {
+        size_t n = fread(buf + len, 1, bufsize - len, f);
+
+        len += n;
+        if (len < bufsize)
+            break;              /* EOF or error */
+
+        bufsize <<= 1;
+        buf = nasm_realloc(buf, bufsize + pad);
+    }
+
+    memset(buf + len, 0, pad);
+    *lenp = len;
+    return buf;
+}
+
 /*
  * Report file size given pathname
  */
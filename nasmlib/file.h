@@ -57,6 +57,9 @@
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 #ifndef R_OK
 # define R_OK 4                 /* Classic Unix constant, same on Windows */
@@ -0,0 +1,165 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+
+/*
+ * filecache.c - contents of input files, read once per session
+ *
+ * The same files are read by every assembly pass, possibly several
+ * times per pass, and then again for their checksums by the CodeView
+ * backend and the object cache.  Keep them in memory instead, keyed
+ * by the path they were opened by.
+ *
+ * A resident process (--server) keeps them from one session to the
+ * next, as long as the working directory, which the paths are
+ * relative to, stays the same.
+ */
+
+#include "file.h"
+#include "hashtbl.h"
+#include "filecache.h"
+
+struct file_cache_entry {
+    struct cached_file file;
+    off_t size;                 /* As of when the file was read */
+    time_t mtime;
+};
+
+static struct hash_table file_cache;
+static void **stale_data;       /* Replaced contents, possibly still in use */
+static size_t nstale;
+static char *file_cache_cwd;    /* Working directory of the entries */
+
+static bool file_cache_stat(const char *path, FILE *fp, os_struct_stat *st)
+{
+    os_filename osfname;
+    int err;
+
+    if (fp)
+        return !os_fstat(fileno(fp), st) && S_ISREG(st->st_mode);
+
+    osfname = os_mangle_filename(path);
+    err = os_stat(osfname, st);
+    os_free_filename(osfname);
+    return !err && S_ISREG(st->st_mode);
+}
+
+const struct cached_file *file_cache_get(const char *path, FILE *fp)
+{
+    struct file_cache_entry **cep, *ce;
+    struct hash_insert hi;
+    os_struct_stat st;
+    FILE *f = fp;
+    MD5_CTX ctx;
+
+    if (!file_cache_stat(path, fp, &st))
+        return NULL;
+
+    cep = (struct file_cache_entry **)hash_find(&file_cache, path, &hi);
+    ce = cep ? *cep : NULL;
+    if (ce && ce->size == st.st_size && ce->mtime == st.st_mtime)
+        return &ce->file;
+
+    if (!f) {
+        f = nasm_open_read(path, NF_BINARY);
+        if (!f)
+            return NULL;
+    } else {
+        nasm_set_binary_mode(f);
+    }
+
+    if (ce) {
+        /* An older copy may still be being read from */
+        stale_data = nasm_realloc(stale_data,
+                                  (nstale + 1) * sizeof *stale_data);
+        stale_data[nstale++] = ce->file.data;
+    } else {
+        nasm_new(ce);
+        hash_add(&hi, nasm_strdup(path), ce);
+    }
+
+    ce->file.data = nasm_load_file(f, &ce->file.len, FILE_CACHE_PAD);
+    ce->size  = st.st_size;
+    ce->mtime = st.st_mtime;
+
+    MD5Init(&ctx);
+    MD5Update(&ctx, (unsigned char *)ce->file.data, ce->file.len);
+    MD5Final(ce->file.md5, &ctx);
+
+    if (f != fp)
+        fclose(f);
+
+    return &ce->file;
+}
+
+static void free_stale_data(void)
+{
+    while (nstale)
+        nasm_free(stale_data[--nstale]);
+    nasm_free(stale_data);
+    stale_data = NULL;
+}
+
+void file_cache_free(void)
+{
+    struct hash_iterator it;
+    const struct hash_node *np;
+
+    hash_for_each(&file_cache, it, np) {
+        struct file_cache_entry *ce = np->data;
+
+        nasm_free((void *)np->key);
+        nasm_free(ce->file.data);
+        nasm_free(ce);
+    }
+    hash_free(&file_cache);
+
+    free_stale_data();
+    nasm_free(file_cache_cwd);
+    file_cache_cwd = NULL;
+}
+
+void file_cache_new_session(void)
+{
+    char *cwd = nasm_realpath(".");
+
+    if (file_cache_cwd && !strcmp(cwd, file_cache_cwd)) {
+        /* Nothing from the last session is in use any more */
+        free_stale_data();
+        nasm_free(cwd);
+        return;
+    }
+
+    file_cache_free();
+    file_cache_cwd = cwd;
+}
@@ -41,6 +41,7 @@
 
 #include "nasm.h"
 #include "hashtbl.h"
+#include "profile.h"
 
 #define HASH_MAX_LOAD   2	/* Higher = more memory-efficient, slower */
 #define HASH_INIT_SIZE  16      /* Initial size (power of 2, min 4) */
@@ -82,8 +83,10 @@ void **hash_findb(struct hash_table *head, const void *key,
     size_t pos = hash_pos(hash, mask);
     size_t inc = hash_inc(hash, mask);
 
+    profile_count(PROF_HASH_LOOKUPS);
     if (likely(tbl)) {
         while ((np = &tbl[pos])->key) {
+            profile_count(PROF_HASH_PROBES);
             if (hash == np->hash &&
                 keylen == np->keylen &&
                 !memcmp(key, np->key, keylen))
@@ -126,8 +129,10 @@ void **hash_findib(struct hash_table *head, const void *key, size_t keylen,
     size_t pos = hash_pos(hash, mask);
     size_t inc = hash_inc(hash, mask);
 
+    profile_count(PROF_HASH_LOOKUPS);
     if (likely(tbl)) {
         while ((np = &tbl[pos])->key) {
+            profile_count(PROF_HASH_PROBES);
             if (hash == np->hash &&
                 keylen == np->keylen &&
                 !nasm_memicmp(key, np->key, keylen))
@@ -157,6 +162,43 @@ void **hash_findi(struct hash_table *head, const char *key,
     return hash_findib(head, key, strlen(key)+1, insert);
 }
 
+/*
+ * Find an entry by a key which is unique for its value, such as an
+ * interned string, with a precomputed hash: the keys are compared by
+ * address only.  The table can still be searched by value with the
+ * other functions, provided that the hash and key length match.
+ */
+void **hash_findp(struct hash_table *head, uint64_t hash, const void *key,
+                  size_t keylen, struct hash_insert *insert)
+{
+    struct hash_node *np = NULL;
+    struct hash_node *tbl = head->table;
+    size_t mask = hash_mask(head->size);
+    size_t pos = hash_pos(hash, mask);
+    size_t inc = hash_inc(hash, mask);
+
+    profile_count(PROF_HASH_LOOKUPS);
+    if (likely(tbl)) {
+        while ((np = &tbl[pos])->key) {
+            profile_count(PROF_HASH_PROBES);
+            if (key == np->key)
+                return &np->data;
+            pos = hash_pos_next(pos, inc, mask);
+        }
+    }
+
+    /* Not found.  Store info for insert if requested. */
+    if (insert) {
+        insert->node.hash = hash;
+        insert->node.key = key;
+        insert->node.keylen = keylen;
+        insert->node.data = NULL;
+        insert->head  = head;
+        insert->where = np;
+    }
+    return NULL;
+}
+
 /*
  * Insert node.  Return a pointer to the "data" element of the newly
  * created hash node.
@@ -0,0 +1,213 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * profile.c - counters and timers for the --profile option
+ *
+ * The report is written as a JSON object, so it can be consumed by
+ * scripts collecting build statistics.
+ */
+
+#include "compiler.h"
+
+#include <time.h>
+
+#include "nasmlib.h"
+#include "error.h"
+#include "profile.h"
+
+bool profiling;
+uint64_t profile_counters[PROF_COUNTERS];
+uint64_t profile_times[PROF_PHASES];
+
+static const char * const counter_names[PROF_COUNTERS] = {
+    "lines", "tokens", "smacro_expansions", "mmacro_expansions",
+    "hash_lookups", "hash_probes", "label_lookups", "peak_token_memory",
+    "guarded_includes", "cond_skipped_lines",
+    "smacro_filter_skips", "encode_cache_hits", "encode_cache_misses"
+};
+
+static const char * const phase_names[PROF_PHASES] = {
+    "preprocess", "parse", "match", "output"
+};
+
+struct profile_pass {
+    int64_t passn;
+    const char *type;
+    uint64_t time;
+    uint64_t phases[PROF_PHASES];
+};
+
+static struct profile_pass *passes;
+static size_t npasses, maxpasses;
+static uint64_t pass_phases[PROF_PHASES]; /* Phase times at end of last pass */
+
+/*
+ * Return a timestamp in nanoseconds.  Without a monotonic clock this
+ * falls back to processor time, which is good enough for a single
+ * threaded program.
+ */
+uint64_t profile_clock(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+#endif
+    return (uint64_t)((double)clock() * (1.0e9 / CLOCKS_PER_SEC));
+}
+
+/*
+ * Forget everything measured so far
+ */
+void profile_reset(void)
+{
+    memset(profile_counters, 0, sizeof profile_counters);
+    memset(profile_times, 0, sizeof profile_times);
+    memset(pass_phases, 0, sizeof pass_phases);
+    npasses = 0;
+}
+
+/*
+ * Record the end of a pass which started at the given time
+ */
+void profile_pass(int64_t passn, const char *type, uint64_t start)
+{
+    struct profile_pass *pp;
+    int i;
+
+    if (!profiling)
+        return;
+
+    if (npasses >= maxpasses) {
+        maxpasses = maxpasses ? maxpasses << 1 : 8;
+        passes = nasm_realloc(passes, maxpasses * sizeof *passes);
+    }
+
+    pp = &passes[npasses++];
+    pp->passn = passn;
+    pp->type  = type;
+    pp->time  = profile_clock() - start;
+    for (i = 0; i < PROF_PHASES; i++) {
+        pp->phases[i] = profile_times[i] - pass_phases[i];
+        pass_phases[i] = profile_times[i];
+    }
+}
+
+static void write_seconds(FILE *f, uint64_t ns)
+{
+    fprintf(f, "%"PRIu64".%09"PRIu64, ns / 1000000000, ns % 1000000000);
+}
+
+static void write_string(FILE *f, const char *str)
+{
+    unsigned char c;
+
+    fputc('"', f);
+    while ((c = *str++)) {
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < ' ')
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void write_phases(FILE *f, const uint64_t *times, const char *indent)
+{
+    int i;
+
+    for (i = 0; i < PROF_PHASES; i++) {
+        fprintf(f, "%s\"%s\": ", indent, phase_names[i]);
+        write_seconds(f, times[i]);
+        fputs(i < PROF_PHASES-1 ? ",\n" : "\n", f);
+    }
+}
+
+/*
+ * Write the report; start is the time the assembly started
+ */
+void profile_write(const char *fname, const char *input, uint64_t start)
+{
+    uint64_t total = profile_clock() - start;
+    FILE *f;
+    size_t n;
+    int i;
+
+    f = nasm_open_write(fname, NF_TEXT);
+    if (!f) {
+        nasm_nonfatalf(ERR_NOFILE, "unable to open profile file `%s'", fname);
+        return;
+    }
+
+    fputs("{\n  \"input\": ", f);
+    write_string(f, input ? input : "");
+    fputs(",\n  \"time\": ", f);
+    write_seconds(f, total);
+
+    fputs(",\n  \"phases\": {\n", f);
+    write_phases(f, profile_times, "    ");
+
+    fputs("  },\n  \"passes\": [", f);
+    for (n = 0; n < npasses; n++) {
+        const struct profile_pass *pp = &passes[n];
+
+        fprintf(f, "%s\n    {\n      \"pass\": %"PRId64",\n      \"type\": ",
+                n ? "," : "", pp->passn);
+        write_string(f, pp->type);
+        fputs(",\n      \"time\": ", f);
+        write_seconds(f, pp->time);
+        fputs(",\n", f);
+        write_phases(f, pp->phases, "      ");
+        fputs("    }", f);
+    }
+
+    fputs("\n  ],\n  \"counters\": {\n", f);
+    for (i = 0; i < PROF_COUNTERS; i++) {
+        fprintf(f, "    \"%s\": %"PRIu64"%s\n", counter_names[i],
+                profile_counters[i], i < PROF_COUNTERS-1 ? "," : "");
+    }
+    fputs("  }\n}\n", f);
+
+    fflush(f);
+    if (ferror(f))
+        nasm_nonfatalf(ERR_NOFILE, "write error on profile file `%s'", fname);
+    fclose(f);
+
+    nasm_free(passes);
+    passes = NULL;
+    npasses = maxpasses = 0;
+}
@@ -0,0 +1,478 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * server.c - run assembly jobs in a resident process
+ *
+ * A job is sent over a local (AF_UNIX) stream socket, one job per
+ * connection.  The request is a struct job_header, with the client's
+ * standard output and standard error attached as SCM_RIGHTS ancillary
+ * data, followed by header.len bytes of NUL-terminated strings: the
+ * working directory, header.argc arguments and header.envc environment
+ * entries.  The reply is the exit status as an int32_t.
+ *
+ * Jobs are run one at a time, in a process forked off by the server
+ * at startup, so that whatever the job function keeps around is still
+ * there for the next job.  A job function which cannot clean up after
+ * itself can ask for that process to be started over; it then exits
+ * and the server forks a fresh one.  The same happens if it crashes.
+ */
+
+#include "compiler.h"
+
+#include <errno.h>
+
+#include "nasmlib.h"
+#include "error.h"
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_SOCKET_H
+# include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_UN_H
+# include <sys/un.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H) && \
+    defined(HAVE_UNISTD_H) && defined(HAVE_SYS_WAIT_H) && \
+    defined(HAVE_FORK) && defined(SCM_RIGHTS)
+
+#include <signal.h>
+
+extern char **environ;
+
+#define MAX_JOB_SIZE (64 << 20)  /* Sanity limit on the request size */
+
+struct job_header {
+    uint32_t len;               /* Bytes of strings following */
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t umask;
+};
+
+static void make_address(struct sockaddr_un *sa, const char *path)
+{
+    nasm_zero(*sa);
+    sa->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof sa->sun_path)
+        nasm_fatalf(ERR_USAGE, "socket name `%s' is too long", path);
+    strcpy(sa->sun_path, path);
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Receive the header of a request and the two descriptors sent with
+ * it.  Returns false on a malformed request.
+ */
+static bool recv_header(int fd, struct job_header *hdr, int fds[2])
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+
+    fds[0] = fds[1] = -1;
+
+    nasm_zero(msg);
+    iov.iov_base = hdr;
+    iov.iov_len = sizeof *hdr;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+
+    do {
+        n = recvmsg(fd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+
+    cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+        memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+
+    if (fds[0] < 0 || fds[1] < 0)
+        return false;
+
+    /* The rest of the header may arrive separately */
+    return (size_t)n == sizeof *hdr ||
+        read_all(fd, (char *)hdr + n, sizeof *hdr - n);
+}
+
+/*
+ * Split the string area of a request into its strings, returning
+ * false if there are fewer than expected.
+ */
+static bool split_strings(char *buf, size_t len, char **strs, size_t n)
+{
+    char *end = buf + len;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        char *nul = memchr(buf, '\0', end - buf);
+        if (!nul)
+            return false;
+        strs[i] = buf;
+        buf = nul + 1;
+    }
+    return true;
+}
+
+/*
+ * Run one job.  Returns the exit status, or -1 if the request itself
+ * could not be carried out.
+ */
+static int32_t serve_one(int fd, nasm_job_func func, int home,
+                         const int saved[2], bool *restart)
+{
+    struct job_header hdr;
+    int fds[2];
+    char *buf = NULL, **strs = NULL;
+    char **argv, **envp, **old_environ;
+    mode_t old_umask;
+    int32_t status = -1;
+
+    if (!recv_header(fd, &hdr, fds))
+        goto done;
+
+    if (hdr.len > MAX_JOB_SIZE || hdr.argc < 1 ||
+        hdr.argc > hdr.len || hdr.envc > hdr.len)
+        goto done;
+
+    buf = nasm_malloc(hdr.len);
+    nasm_newn(strs, hdr.argc + hdr.envc + 3);
+    if (!read_all(fd, buf, hdr.len) ||
+        !split_strings(buf, hdr.len, strs, hdr.argc + hdr.envc + 1))
+        goto done;
+
+    argv = strs + 1;
+    envp = argv + hdr.argc + 1;
+    memmove(envp, argv + hdr.argc, hdr.envc * sizeof *envp);
+    argv[hdr.argc] = NULL;
+    envp[hdr.envc] = NULL;
+
+    fflush(NULL);
+    if (chdir(strs[0])) {
+        char *err = nasm_asprintf("nasm: fatal: unable to change "
+                                  "directory to `%s': %s\n",
+                                  strs[0], strerror(errno));
+        write_all(fds[1], err, strlen(err));
+        nasm_free(err);
+        goto done;
+    }
+
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    old_environ = environ;
+    environ = envp;
+    old_umask = umask(hdr.umask);
+
+    status = func(hdr.argc, argv, restart);
+
+    fflush(NULL);
+    umask(old_umask);
+    environ = old_environ;
+    dup2(saved[0], STDOUT_FILENO);
+    dup2(saved[1], STDERR_FILENO);
+    if (fchdir(home))
+        nasm_fatal("cannot return to the server directory: %s",
+                   strerror(errno));
+
+done:
+    if (fds[0] >= 0)
+        close(fds[0]);
+    if (fds[1] >= 0)
+        close(fds[1]);
+    nasm_free(strs);
+    nasm_free(buf);
+    return status;
+}
+
+/*
+ * Accept and run jobs until one of them asks for a fresh process.
+ */
+static no_return serve_jobs(const char *path, int sock, nasm_job_func func)
+{
+    int home, saved[2];
+
+    home = open(".", O_RDONLY);
+    saved[0] = dup(STDOUT_FILENO);
+    saved[1] = dup(STDERR_FILENO);
+    if (home < 0 || saved[0] < 0 || saved[1] < 0)
+        nasm_fatal("unable to set up server: %s", strerror(errno));
+
+    for (;;) {
+        int32_t status;
+        bool restart = false;
+        int fd = accept(sock, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            nasm_fatal("unable to accept connection on `%s': %s",
+                       path, strerror(errno));
+        }
+
+        status = serve_one(fd, func, home, saved, &restart);
+        write_all(fd, &status, sizeof status);
+        close(fd);
+
+        if (restart) {
+            fflush(NULL);
+            _exit(0);
+        }
+    }
+}
+
+static pid_t job_process;
+
+/* Take the job process along when the server is told to stop */
+static void stop_server(int sig)
+{
+    if (job_process > 0)
+        kill(job_process, sig);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void server_signals(void (*handler)(int))
+{
+    signal(SIGHUP, handler);
+    signal(SIGINT, handler);
+    signal(SIGTERM, handler);
+}
+
+no_return nasm_serve(const char *path, nasm_job_func func)
+{
+    struct sockaddr_un sa;
+    struct stat st;
+    mode_t old_umask;
+    int sock, err;
+
+    make_address(&sa, path);
+
+    /* Replace a stale socket, but nothing else */
+    if (!lstat(path, &st)) {
+        if (!S_ISSOCK(st.st_mode))
+            nasm_fatalf(ERR_USAGE, "`%s' exists and is not a socket", path);
+        unlink(path);
+    }
+
+    /*
+     * Jobs run with the privileges of the server, so only the user
+     * running it may connect.  Create the socket that way, rather
+     * than tightening its permissions afterwards.
+     */
+    old_umask = umask(077);
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    err = sock < 0 || bind(sock, (struct sockaddr *)&sa, sizeof sa) ||
+        chmod(path, 0600) || listen(sock, 16);
+    umask(old_umask);
+    if (err)
+        nasm_fatal("unable to listen on `%s': %s", path, strerror(errno));
+
+    /* A client going away must not take the server with it */
+    signal(SIGPIPE, SIG_IGN);
+    server_signals(stop_server);
+
+    /*
+     * The jobs run in a child, which is replaced by a fresh fork of
+     * this (untouched) process whenever it exits successfully or is
+     * killed by a signal.
+     */
+    for (;;) {
+        int status;
+        pid_t pid;
+
+        fflush(NULL);
+        pid = fork();
+        if (pid < 0)
+            nasm_fatal("unable to fork server process: %s", strerror(errno));
+        if (!pid) {
+            server_signals(SIG_DFL);
+            serve_jobs(path, sock, func);
+        }
+        job_process = pid;
+
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR)
+                nasm_fatal("unable to wait for server process: %s",
+                           strerror(errno));
+        }
+
+        if (WIFEXITED(status) && WEXITSTATUS(status))
+            exit(WEXITSTATUS(status));
+    }
+}
+
+int nasm_client(const char *path, int argc, char **argv)
+{
+    struct sockaddr_un sa;
+    struct job_header hdr;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char *cwd = nasm_realpath(".");
+    char *buf, *p;
+    char **ep;
+    size_t len;
+    int32_t status;
+    mode_t mask;
+    int sock, i;
+
+    make_address(&sa, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&sa, sizeof sa))
+        nasm_fatalf(ERR_NOFILE, "unable to connect to server `%s': %s",
+                    path, strerror(errno));
+
+    mask = umask(0);
+    umask(mask);
+
+    nasm_zero(hdr);
+    len = strlen(cwd) + 1;
+    for (i = 0; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+    for (ep = environ; *ep; ep++) {
+        len += strlen(*ep) + 1;
+        hdr.envc++;
+    }
+    hdr.len = len;
+    hdr.argc = argc;
+    hdr.umask = mask;
+
+    p = buf = nasm_malloc(len);
+    p = mempcpy(p, cwd, strlen(cwd) + 1);
+    for (i = 0; i < argc; i++)
+        p = mempcpy(p, argv[i], strlen(argv[i]) + 1);
+    for (ep = environ; *ep; ep++)
+        p = mempcpy(p, *ep, strlen(*ep) + 1);
+
+    nasm_zero(msg);
+    iov.iov_base = &hdr;
+    iov.iov_len = sizeof hdr;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+
+    fflush(NULL);
+    if (sendmsg(sock, &msg, 0) != (ssize_t)sizeof hdr ||
+        !write_all(sock, buf, len) ||
+        !read_all(sock, &status, sizeof status) || status < 0)
+        nasm_fatalf(ERR_NOFILE, "server `%s' failed to run the job", path);
+
+    close(sock);
+    nasm_free(buf);
+    nasm_free(cwd);
+    return status;
+}
+
+#else
+
+no_return nasm_serve(const char *path, nasm_job_func func)
+{
+    (void)path;
+    (void)func;
+
+    nasm_fatalf(ERR_USAGE, "server mode is not supported on this platform");
+}
+
+int nasm_client(const char *path, int argc, char **argv)
+{
+    (void)path;
+    (void)argc;
+    (void)argv;
+
+    nasm_fatalf(ERR_USAGE, "server mode is not supported on this platform");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,164 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *   Copyright 2021 The NASM Authors - All Rights Reserved
+ *   See the file AUTHORS included with the NASM distribution for
+ *   the specific copyright holders.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following
+ *   conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *
+ *     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *     CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *     INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *     MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *     CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *     SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ *     NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *     LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ *     HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *     CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ *     OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ *     EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * workers.c - run jobs in parallel worker processes
+ *
+ * The workers are forked, so they inherit all the setup the parent
+ * has done, and none of the state they change afterwards is shared.
+ */
+
+#include "compiler.h"
+
+#include <errno.h>
+
+#include "nasmlib.h"
+#include "error.h"
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+
+#if defined(HAVE_FORK) && defined(HAVE_SYS_WAIT_H)
+
+struct worker {
+    pid_t pid;
+    FILE *out, *err;            /* Captured stdout and stderr */
+    bool done;
+};
+
+static void copy_output(FILE *src, FILE *dst)
+{
+    char buf[BUFSIZ];
+    size_t n;
+
+    rewind(src);
+    while ((n = fread(buf, 1, sizeof buf, src)))
+        fwrite(buf, 1, n, dst);
+    fclose(src);
+}
+
+static void start_worker(struct worker *w, size_t index,
+                         nasm_worker_func func)
+{
+    w->out = tmpfile();
+    w->err = tmpfile();
+    if (!w->out || !w->err)
+        nasm_fatal("unable to create temporary file: %s", strerror(errno));
+
+    fflush(NULL);
+    w->pid = fork();
+    if (w->pid < 0)
+        nasm_fatal("unable to start worker process: %s", strerror(errno));
+
+    if (w->pid)
+        return;                 /* Parent */
+
+    dup2(fileno(w->out), STDOUT_FILENO);
+    dup2(fileno(w->err), STDERR_FILENO);
+
+    exit(func(index, w->err) ? 1 : 0);
+}
+
+bool nasm_run_workers(size_t n, unsigned int njobs,
+                      nasm_worker_func func, FILE *errfile)
+{
+    struct worker *workers;
+    size_t next = 0, flushed = 0, i;
+    unsigned int running = 0;
+    bool ok = true;
+    int status;
+    pid_t pid;
+
+    nasm_newn(workers, n);
+
+    while (flushed < n) {
+        /*
+         * Each worker holds on to two temporary files until its
+         * output is copied out, so don't get too far ahead of a slow
+         * worker whose output has to come first.
+         */
+        while (running < njobs && next < n &&
+               next - flushed < 2 * (size_t)njobs) {
+            start_worker(&workers[next], next, func);
+            next++;
+            running++;
+        }
+
+        pid = wait(&status);
+        if (pid < 0)
+            nasm_fatal("unable to wait for worker process: %s",
+                       strerror(errno));
+
+        for (i = flushed; i < next; i++) {
+            if (workers[i].pid == pid && !workers[i].done) {
+                workers[i].done = true;
+                if (!WIFEXITED(status) || WEXITSTATUS(status))
+                    ok = false;
+                running--;
+                break;
+            }
+        }
+
+        /* Copy out the output of the workers done, in order */
+        while (flushed < next && workers[flushed].done) {
+            copy_output(workers[flushed].out, stdout);
+            copy_output(workers[flushed].err, errfile);
+            fflush(NULL);
+            flushed++;
+        }
+    }
+
+    nasm_free(workers);
+    return ok;
+}
+
+#else
+
+bool nasm_run_workers(size_t n, unsigned int njobs,
+                      nasm_worker_func func, FILE *errfile)
+{
+    (void)n;
+    (void)njobs;
+    (void)func;
+    (void)errfile;
+
+    nasm_fatalf(ERR_USAGE, "more than one input file is not supported "
+                "on this platform");
+    return false;
+}
+
+#endif
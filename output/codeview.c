@@ -48,6 +48,7 @@
 #include "outlib.h"
 #include "pecoff.h"
 #include "md5.h"
+#include "filecache.h"
 
 static void cv8_init(void);
 static void cv8_linenum(const char *filename, int32_t linenumber,
@@ -170,6 +171,8 @@ static void cv8_init(void)
                     IMAGE_SCN_CNT_INITIALIZED_DATA |
                     IMAGE_SCN_ALIGN_1BYTES;
 
+    nasm_zero(cv8_state);
+
     cv8_state.symbol_sect = coff_make_section(".debug$S", sect_flags);
     cv8_state.type_sect = coff_make_section(".debug$T", sect_flags);
 
@@ -340,39 +343,32 @@ static void cv8_cleanup(void)
 static void calc_md5(const char *const filename,
         unsigned char sum[MD5_HASHBYTES])
 {
-    int success = 0;
+    const struct cached_file *cf;
     unsigned char *file_buf;
+    size_t len;
     FILE *f;
     MD5_CTX ctx;
 
     f = pp_input_fopen(filename, NF_BINARY);
-    if (!f)
-        goto done;
-
-    file_buf = nasm_zalloc(BUFSIZ);
-
-    MD5Init(&ctx);
-    while (!feof(f)) {
-        size_t i = fread(file_buf, 1, BUFSIZ, f);
-        if (ferror(f))
-            goto done_0;
-        else if (i == 0)
-            break;
-        MD5Update(&ctx, file_buf, i);
-    }
-    MD5Final(sum, &ctx);
-
-    success = 1;
-done_0:
-    nasm_free(file_buf);
-    fclose(f);
-done:
-    if (!success) {
+    if (!f) {
         nasm_nonfatal("unable to hash file %s. "
                       "Debug information may be unavailable.",
                       filename);
+        return;
+    }
+
+    /* Normally the preprocessor has already read and hashed the file */
+    cf = file_cache_get(filename, f);
+    if (cf) {
+        memcpy(sum, cf->md5, MD5_HASHBYTES);
+    } else {
+        file_buf = nasm_load_file(f, &len, 0);
+        MD5Init(&ctx);
+        MD5Update(&ctx, file_buf, len);
+        MD5Final(sum, &ctx);
+        nasm_free(file_buf);
     }
-    return;
+    fclose(f);
 }
 
 static struct source_file *register_file(const char *filename)
@@ -408,7 +404,7 @@ static struct source_file *register_file(const char *filename)
         file->lines = saa_init(sizeof(struct linepair));
         *cv8_state.source_files_tail = file;
         cv8_state.source_files_tail = &file->next;
-        calc_md5(fullpath, file->md5sum);
+        calc_md5(filename, file->md5sum);
 
         hash_add(&hi, filename, file);
 
@@ -40,7 +40,8 @@
  * The "data" parameter for the output function points to a "int64_t",
  * containing the address of the target in question, unless the type is
  * OUT_RAWDATA, in which case it points to an "uint8_t"
- * array.
+ * array, or OUT_FILEDATA, in which case it points to a
+ * "struct out_filedata".
  *
  * Exceptions are OUT_RELxADR, which denote an x-byte relocation
  * which will be a relative jump. For this we need to know the
@@ -101,6 +102,7 @@ void nasm_do_legacy_output(const struct out_data *data)
 
     case OUT_RAWDATA:
     case OUT_RESERVE:
+    case OUT_FILEDATA:
         tsegment = twrt = NO_SEG;
         break;
 
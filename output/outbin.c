@@ -112,6 +112,7 @@ static struct bin_label {
 static struct Section {
     char *name;
     struct SAA *contents;
+    struct ol_filerefs files;   /* INCBIN data not in contents */
     int64_t length;                /* section length in bytes */
 
 /* Section attributes */
@@ -169,7 +170,7 @@ static void add_reloc(struct Section *s, int32_t bytes, int32_t secref,
     r = *reloctail = nasm_malloc(sizeof(struct Reloc));
     reloctail = &r->next;
     r->next = NULL;
-    r->posn = s->length;
+    r->posn = s->contents->datalen;
     r->bytes = bytes;
     r->secref = secref;
     r->secrel = secrel;
@@ -692,6 +693,7 @@ static void bin_cleanup(void)
         s = sections;
         sections = s->next;
         saa_free(s->contents);
+        ol_free_filerefs(&s->files);
         nasm_free(s->name);
         if (s->flags & FOLLOWS_DEFINED)
             nasm_free(s->follows);
@@ -784,6 +786,11 @@ static void bin_out(int32_t segto, const void *data,
             saa_wbytes(s->contents, data, size);
 	break;
 
+    case OUT_FILEDATA:
+        if (s->flags & TYPE_PROGBITS)
+            ol_add_fileref(&s->files, s->contents, data, size);
+	break;
+
     case OUT_RESERVE:
         if (s->flags & TYPE_PROGBITS) {
             nasm_warn(WARN_ZEROING, "uninitialized space declared in"
@@ -1376,6 +1383,8 @@ static void binfmt_init(void)
     relocs = NULL;
     reloctail = &relocs;
     origin_defined = 0;
+    map_control = 0;
+    rf = NULL;
     no_seg_labels = NULL;
     nsl_tail = &no_seg_labels;
 
@@ -1409,7 +1418,7 @@ static void do_output_bin(void)
 	fwritezero(s->start - addr, ofile);
 
         /* Write the section to the output file. */
-	saa_fpwrite(s->contents, ofile);
+	ol_write_saa(s->contents, &s->files, ofile);
         
 	/* Keep track of the current file position */
 	addr = s->start + s->length;
@@ -1601,7 +1610,7 @@ const struct ofmt of_bin = {
     "Flat raw binary (MS-DOS, embedded, ...)",
     "bin",
     "",
-    0,
+    OFMT_FILEDATA,
     64,
     null_debug_arr,
     &null_debug_form,
@@ -178,6 +178,8 @@ static struct RAA *bsym, *symval;
 struct SAA *coff_strs;
 static uint32_t strslen;
 
+static int sxseg = -1;          /* .sxdata section for safeseh */
+
 static void coff_gen_init(void);
 static void coff_sect_write(struct coff_Section *, const uint8_t *, uint32_t);
 static void coff_write(void);
@@ -221,6 +223,7 @@ static void coff_gen_init(void)
     symval = raa_init();
     coff_strs = saa_init(1);
     strslen = 0;
+    sxseg = -1;
     def_seg = seg_alloc();
 }
 
@@ -938,7 +941,6 @@ coff_directives(enum directive directive, char *value)
     }
     case D_SAFESEH:
     {
-        static int sxseg=-1;
         int i;
 
         if (!win32) /* Only applicable for -f win32 */
@@ -65,6 +65,9 @@ const struct ofmt of_dbg;
 static void dbg_init(void)
 {
     dbgsect = NULL;
+    dbg_max_data_dump = 128;
+    section_labels = true;
+    subsections_via_symbols = false;
     fprintf(ofile, "NASM Output format debug dump\n");
     fprintf(ofile, "input file  = %s\n", inname);
     fprintf(ofile, "output file = %s\n", outname);
@@ -94,6 +94,7 @@ static struct ELF_SECTDATA {
     void                *data;
     int64_t             len;
     bool                is_saa;
+    const struct ol_filerefs *files; /* For is_saa only */
 } *elf_sects;
 
 static int elf_nsect, nsections;
@@ -102,6 +103,8 @@ static int64_t elf_foffs;
 static void elf_write(void);
 static void elf_sect_write(struct elf_section *, const void *, size_t);
 static void elf_sect_writeaddr(struct elf_section *, int64_t, size_t);
+static void elf_sect_writefile(struct elf_section *,
+                               const struct out_filedata *, uint64_t);
 static void elf_section_header(int name, int type, uint64_t flags,
                                void *data, bool is_saa, uint64_t datalen,
                                int link, int info,
@@ -563,11 +566,30 @@ static void elf_init(void)
     strslen = 2 + strlen(elf_module);
     shstrtab = NULL;
     shstrtablen = shstrtabsize = 0;;
+    nsections = 0;
     add_sectname("", "");       /* SHN_UNDEF */
+    elf_osabi = elf_abiver = 0;
 
     fwds = NULL;
 
     section_by_index = raa_init();
+    lastsym = NULL;
+
+    /*
+     * The debug format state must start out clean too, in case this
+     * is not the first run in this process (see --server.)
+     */
+    currentline = 1;
+    debug_immcall = 0;
+    stabslines = NULL;
+    numlinestabs = 0;
+    stabs_filename = NULL;
+    stabbuf = stabstrbuf = stabrelbuf = NULL;
+    dwarf_flist = dwarf_clist = dwarf_elist = NULL;
+    dwarf_fsect = dwarf_csect = dwarf_esect = NULL;
+    dwarf_numfiles = dwarf_nsections = 0;
+    arangesbuf = arangesrelbuf = pubnamesbuf = infobuf = inforelbuf = NULL;
+    abbrevbuf = linebuf = linerelbuf = framebuf = locbuf = NULL;
 
     /*
      * Add reserved section names to the section hash, with NULL
@@ -610,6 +632,7 @@ static void elf_cleanup(void)
     for (i = 0; i < nsects; i++) {
         if (sects[i]->type != SHT_NOBITS)
             saa_free(sects[i]->data);
+        ol_free_filerefs(&sects[i]->files);
         if (sects[i]->rel)
             saa_free(sects[i]->rel);
         while (sects[i]->head) {
@@ -1159,6 +1182,10 @@ static void elf32_out(int32_t segto, const void *data,
         elf_sect_write(s, data, size);
         break;
 
+    case OUT_FILEDATA:
+        elf_sect_writefile(s, data, size);
+        break;
+
     case OUT_ADDRESS:
     {
         bool err = false;
@@ -1366,6 +1393,10 @@ static void elf64_out(int32_t segto, const void *data,
         elf_sect_write(s, data, size);
         break;
 
+    case OUT_FILEDATA:
+        elf_sect_writefile(s, data, size);
+        break;
+
     case OUT_ADDRESS:
     {
         int isize = (int)size;
@@ -1647,6 +1678,10 @@ static void elfx32_out(int32_t segto, const void *data,
         elf_sect_write(s, data, size);
         break;
 
+    case OUT_FILEDATA:
+        elf_sect_writefile(s, data, size);
+        break;
+
     case OUT_ADDRESS:
     {
         int isize = (int)size;
@@ -1963,6 +1998,7 @@ static void elf_write(void)
                            sects[i]->data, true,
                            sects[i]->len, 0, 0,
                            sects[i]->align, sects[i]->entsize);
+        elf_sects[elf_nsect-1].files = &sects[i]->files;
         p += strlen(p) + 1;
     }
 
@@ -2089,6 +2125,7 @@ static void elf_write(void)
     saa_free(symtab);
     if (symtab_shndx)
         saa_free(symtab_shndx);
+    nasm_free(shstrtab);
 }
 
 static size_t nsyms;
@@ -2154,6 +2191,7 @@ static size_t elf_build_symtab(void)
 
     symtab       = saa_init(1);
     symtab_shndx = NULL;
+    nsyms        = 0;
 
     /*
      * Zero symbol first as required by spec.
@@ -2338,6 +2376,7 @@ static void elf_section_header(int name, int type, uint64_t flags,
     elf_sects[elf_nsect].data = data;
     elf_sects[elf_nsect].len = datalen;
     elf_sects[elf_nsect].is_saa = is_saa;
+    elf_sects[elf_nsect].files = NULL;
     elf_nsect++;
 
     if (!efmt->elf64) {
@@ -2385,7 +2424,9 @@ static void elf_write_sections(void)
             int32_t len = elf_sects[i].len;
             int32_t reallen = ALIGN(len, SEC_FILEALIGN);
             int32_t align = reallen - len;
-            if (elf_sects[i].is_saa)
+            if (elf_sects[i].files)
+                ol_write_saa(elf_sects[i].data, elf_sects[i].files, ofile);
+            else if (elf_sects[i].is_saa)
                 saa_fpwrite(elf_sects[i].data, ofile);
             else
                 nasm_write(elf_sects[i].data, len, ofile);
@@ -2405,6 +2446,13 @@ static void elf_sect_writeaddr(struct elf_section *sect, int64_t data, size_t le
     sect->len += len;
 }
 
+static void elf_sect_writefile(struct elf_section *sect,
+                               const struct out_filedata *data, uint64_t len)
+{
+    ol_add_fileref(&sect->files, sect->data, data, len);
+    sect->len += len;
+}
+
 static void elf_sectalign(int32_t seg, unsigned int value)
 {
     struct elf_section *s;
@@ -2466,7 +2514,7 @@ const struct ofmt of_elf32 = {
     "ELF32 (i386) (Linux, most Unix variants)",
     "elf32",
     ".o",
-    0,
+    OFMT_FILEDATA,
     32,
     elf32_debugs_arr,
     &elf32_df_dwarf,
@@ -2524,7 +2572,7 @@ const struct ofmt of_elf64 = {
     "ELF64 (x86-64) (Linux, most Unix variants)",
     "elf64",
     ".o",
-    0,
+    OFMT_FILEDATA,
     64,
     elf64_debugs_arr,
     &elf64_df_dwarf,
@@ -2582,7 +2630,7 @@ const struct ofmt of_elfx32 = {
     "ELFx32 (ELF32 for x86-64) (Linux)",
     "elfx32",
     ".o",
-    0,
+    OFMT_FILEDATA,
     64,
     elfx32_debugs_arr,
     &elfx32_df_dwarf,
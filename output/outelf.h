@@ -40,6 +40,7 @@
 #include "elf.h"
 #include "rbtree.h"
 #include "saa.h"
+#include "outlib.h"
 
 #define GLOBAL_TEMP_BASE  0x40000000 /* bigger than any sane symbol index */
 
@@ -113,6 +114,7 @@ struct elf_symbol {
 
 struct elf_section {
     struct SAA          *data;
+    struct ol_filerefs  files;          /* INCBIN data not in data */
     uint64_t            len;
     uint64_t            size;
     uint64_t            nrelocs;
@@ -56,6 +56,69 @@ uint64_t realsize(enum out_type type, uint64_t size)
     }
 }
 
+/* Input file ranges in section contents */
+
+void ol_add_fileref(struct ol_filerefs *refs, const struct SAA *s,
+                    const struct out_filedata *fd, uint64_t len)
+{
+    struct ol_fileref *r;
+
+    if (!refs->tail)
+        refs->tail = &refs->head;
+
+    nasm_new(r);
+    r->pos    = s->datalen;
+    r->path   = nasm_strdup(fd->path);
+    r->offset = fd->offset;
+    r->len    = len;
+
+    *refs->tail = r;
+    refs->tail = &r->next;
+}
+
+static void ol_write_fileref(const struct ol_fileref *r, FILE *fp)
+{
+    FILE *f = nasm_open_read(r->path, NF_BINARY|NF_FORMAP);
+
+    if (!f || !nasm_copy_file_range(f, r->offset, r->len, fp))
+        nasm_nonfatal("unable to read `%s' while writing the output file",
+                      r->path);
+    if (f)
+        fclose(f);
+}
+
+/* Write out the contents of a section, like saa_fpwrite() */
+void ol_write_saa(struct SAA *s, const struct ol_filerefs *refs, FILE *fp)
+{
+    const struct ol_fileref *r;
+    const char *data;
+    size_t len;
+
+    saa_rewind(s);
+    list_for_each(r, refs->head) {
+        while (s->rptr < r->pos) {
+            len = r->pos - s->rptr;
+            data = saa_rbytes(s, &len);
+            nasm_write(data, len, fp);
+        }
+        ol_write_fileref(r, fp);
+    }
+    while (len = s->datalen, (data = saa_rbytes(s, &len)) != NULL)
+        nasm_write(data, len, fp);
+}
+
+void ol_free_filerefs(struct ol_filerefs *refs)
+{
+    struct ol_fileref *r, *next;
+
+    list_for_each_safe(r, next, refs->head) {
+        nasm_free(r->path);
+        nasm_free(r);
+    }
+    refs->head = NULL;
+    refs->tail = &refs->head;
+}
+
 /* Common section/symbol handling */
 
 struct ol_sect *_ol_sect_list;
@@ -65,6 +65,27 @@ extern const struct dfmt * const null_debug_arr[2];
 /* Wrapper for unported backends */
 void nasm_do_legacy_output(const struct out_data *data);
 
+/*
+ * Ranges of input files (OUT_FILEDATA) in the contents of a section.
+ * The rest of the contents is kept in an SAA; each range goes before
+ * the byte at position pos of it, and is copied from the file only
+ * when the section is written out.
+ */
+struct ol_fileref {
+    struct ol_fileref *next;
+    size_t pos;                 /* Position in the SAA */
+    char *path;
+    uint64_t offset, len;       /* Range of the file */
+};
+struct ol_filerefs {
+    struct ol_fileref *head, **tail;
+};
+
+void ol_add_fileref(struct ol_filerefs *refs, const struct SAA *s,
+                    const struct out_filedata *fd, uint64_t len);
+void ol_write_saa(struct SAA *s, const struct ol_filerefs *refs, FILE *fp);
+void ol_free_filerefs(struct ol_filerefs *refs);
+
 /*
  * Common routines for tasks that really should migrate into the core.
  * This provides a common interface for maintaining sections and symbols,
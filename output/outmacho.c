@@ -347,6 +347,7 @@ static void macho_init(void)
     sectstail = &sects;
 
     /* Fake section for absolute symbols */
+    nasm_zero(absolute_sect);
     absolute_sect.index = NO_SEG;
 
     syms = NULL;
@@ -355,6 +356,13 @@ static void macho_init(void)
     nlocalsym = 0;
     nextdefsym = 0;
     nundefsym = 0;
+    extdefsyms = undefsyms = NULL;
+    sectstab = NULL;
+
+    head_ncmds = head_sizeofcmds = head_flags = 0;
+    seg_filesize = seg_vmsize = 0;
+    seg_nsects = 0;
+    rel_padcnt = 0;
 
     extsyms = raa_init();
     strs = saa_init(1L);
@@ -2112,6 +2120,13 @@ static void new_file_list (const char *file_name, const char *dir_name)
 
 static void macho_dbg_init(void)
 {
+    dw_head_file = dw_cur_file = NULL;
+    dw_last_file_next = NULL;
+    dw_head_dir = NULL;
+    dw_last_dir_next = NULL;
+    dw_head_sect = dw_cur_sect = dw_last_sect = NULL;
+    cur_line = dw_num_files = dw_num_dirs = dw_num_sects = 0;
+    dbg_immcall = false;
 }
 
 static void macho_dbg_linenum(const char *file_name, int32_t line_num, int32_t segto)
@@ -666,6 +666,7 @@ static void obj_init(void)
     obj_entry_seg = NO_SEG;
     obj_uppercase = false;
     obj_use32 = false;
+    obj_nodepend = false;
     passtwo = 0;
     current_seg = NULL;
 }
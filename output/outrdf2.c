@@ -105,6 +105,7 @@ static int nsegments;
 
 static int32_t bsslength;
 static int32_t headerlength;
+static int farsym;              /* Sticky "far" import attribute */
 
 static void rdf2_init(void)
 {
@@ -145,6 +146,7 @@ static void rdf2_init(void)
                    segtext, segdata, segbss);
     bsslength = 0;
     headerlength = 0;
+    farsym = 0;
 }
 
 static int32_t rdf2_section_names(char *name, int *bits)
@@ -370,7 +372,6 @@ static void rdf2_deflabel(char *name, int32_t segment, int64_t offset,
     struct ExportRec r;
     struct ImportRec ri;
     struct CommonRec ci;
-    static int farsym = 0;
     static int i;
     char symflags = 0;
     int len;
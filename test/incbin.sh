@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Test INCBIN of files large enough to be copied into the output file
+# at write time: the output must match the same data included in small
+# pieces, which are copied at assembly time, for both bin and ELF, with
+# offsets, lengths, TIMES and relocations in another section.
+#
+# Usage: incbin.sh [nasm]
+#
+
+NASM=${1:-../nasm}
+case "$NASM" in
+    /*) ;;
+    *) NASM="$(pwd)/$NASM" ;;
+esac
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0 1 2 15
+cd "$dir" || exit 1
+
+fail() {
+    echo "incbin: $*" 1>&2
+    exit 1
+}
+
+# 3 MB of data which is not the same in every block
+i=0
+: > big.dat
+while [ $i -lt 3072 ]; do
+    printf '%1024d' $i >> big.dat
+    i=$((i + 1))
+done
+
+# Include COUNT times LEN bytes at OFF in one piece, or in pieces of 64K
+cat > t.asm <<'EOF2'
+%macro include 3
+%ifdef PIECES
+%rep %1
+%assign off %2
+%assign left %3
+%rep (%3 + 0xffff) / 0x10000
+%assign len left
+%if len > 0x10000
+%assign len 0x10000
+%endif
+    incbin "big.dat", off, len
+%assign off off + len
+%assign left left - len
+%endrep
+%endrep
+%else
+    times %1 incbin "big.dat", %2, %3
+%endif
+%endmacro
+
+    section .data
+start:
+    db 'head'
+    include 1, 0, 0x180000
+    include 1, 0x1001, 0x100003
+    dd start, after
+    include 2, 7, 0x100000
+after:
+    incbin "big.dat", 0x200000
+    db 'tail'
+
+    section .text
+    dd start, after
+EOF2
+
+for fmt in bin elf32 elf64; do
+    "$NASM" -f $fmt -o big.$fmt t.asm || fail "$fmt: run failed"
+    "$NASM" -f $fmt -DPIECES -o ref.$fmt t.asm || fail "$fmt: run failed"
+    cmp -s ref.$fmt big.$fmt || fail "$fmt: output differs"
+done
+
+exit 0
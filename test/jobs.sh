@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Test assembling several input files in parallel (-j): each output
+# must match a separate run of NASM, and the messages must come out in
+# the order the input files were given, even if a later file finishes
+# first.
+#
+# Usage: jobs.sh [nasm]
+#
+
+NASM=${1:-../nasm}
+case "$NASM" in
+    /*) ;;
+    *) NASM="$(pwd)/$NASM" ;;
+esac
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0 1 2 15
+cd "$dir" || exit 1
+
+fail() {
+    echo "jobs: $*" 1>&2
+    exit 1
+}
+
+# The first file takes by far the longest
+cat > f1.asm <<'EOF'
+%warning file one
+%rep 20000
+    mov eax, [ebx+ecx*4+%[__?LINE?__]]
+%endrep
+EOF
+
+args=
+for i in 1 2 3 4 5 6; do
+    if [ $i -gt 1 ]; then
+        printf '%%warning file %s\n    db %s\n    dd label%s\nlabel%s:\n' \
+            $i $i $i $i > f$i.asm
+    fi
+    "$NASM" -f bin -o ref$i.bin f$i.asm 2>> ref.err ||
+        fail "separate run for f$i.asm failed"
+    args="$args f$i.asm -o out$i.bin"
+done
+
+"$NASM" -f bin -j 4 $args 2> out.err || fail "parallel run failed"
+
+for i in 1 2 3 4 5 6; do
+    cmp -s ref$i.bin out$i.bin || fail "output for f$i.asm differs"
+done
+cmp -s ref.err out.err || fail "messages differ or are out of order"
+
+exit 0
@@ -0,0 +1,104 @@
+#!/bin/sh
+#
+# Test the object cache (--cache-dir): a second run with the same
+# options and unchanged files must copy the cached output file, and
+# the cache must not be used once a file read has changed or a file
+# earlier in the include path has appeared, nor if the output depends
+# on the environment or the time.
+#
+# Usage: objcache.sh [nasm]
+#
+
+NASM=${1:-../nasm}
+case "$NASM" in
+    /*) ;;
+    *) NASM="$(pwd)/$NASM" ;;
+esac
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0 1 2 15
+cd "$dir" || exit 1
+
+fail() {
+    echo "objcache: $*" 1>&2
+    exit 1
+}
+
+mkdir cache
+
+cat > inc.inc <<'EOF2'
+%define VAL 0x11
+EOF2
+
+cat > t.asm <<'EOF2'
+%include "inc.inc"
+    db VAL
+EOF2
+
+"$NASM" -f bin -o ref.bin t.asm || fail "plain run failed"
+
+# The output file name is part of the key
+"$NASM" -f bin --cache-dir cache -o out.bin t.asm ||
+    fail "run filling the cache failed"
+cmp -s ref.bin out.bin || fail "output differs when filling the cache"
+set -- cache/*.out
+test -f "$1" || fail "nothing cached"
+
+# Tamper with the cached output, so a cache hit can be told apart
+printf 'cached' > "$1"
+"$NASM" -f bin --cache-dir cache -o out.bin t.asm ||
+    fail "run using the cache failed"
+test "$(cat out.bin)" = cached || fail "cache not used"
+
+# Same size, different contents
+sed 's/0x11/0x22/' inc.inc > inc.new && mv inc.new inc.inc
+"$NASM" -f bin -o ref2.bin t.asm || fail "plain run failed"
+"$NASM" -f bin --cache-dir cache -o out.bin t.asm ||
+    fail "run after changing inc.inc failed"
+cmp -s ref2.bin out.bin || fail "stale cache entry used"
+
+# A source testing the environment must not be cached
+cat > env.asm <<'EOF2'
+%ifenv NASM_OBJCACHE_TEST
+    db 1
+%else
+    db 2
+%endif
+EOF2
+
+NASM_OBJCACHE_TEST=1 "$NASM" -f bin --cache-dir cache -o env.bin env.asm ||
+    fail "run with the variable set failed"
+(unset NASM_OBJCACHE_TEST; "$NASM" -f bin -o ref3.bin env.asm) ||
+    fail "plain run failed"
+(unset NASM_OBJCACHE_TEST; "$NASM" -f bin --cache-dir cache -o env.bin env.asm) ||
+    fail "run with the variable unset failed"
+cmp -s ref3.bin env.bin || fail "output depending on the environment cached"
+
+# Nor one using the time, even under a name made up by pasting
+mkdir cache2
+cat > time.asm <<'EOF2'
+%define T TIME
+    dq __?POSIX_%[T]?__
+EOF2
+
+"$NASM" -f bin --cache-dir cache2 -o time.bin time.asm ||
+    fail "run using the time failed"
+test -z "$(ls cache2)" || fail "output depending on the time cached"
+
+# A header appearing earlier in the include path
+mkdir inc1 inc2
+echo '%define SVAL 0x44' > inc2/sh.inc
+cat > sh.asm <<'EOF2'
+%include "sh.inc"
+    db SVAL
+EOF2
+
+"$NASM" -f bin -Iinc1 -Iinc2 --cache-dir cache -o sh.bin sh.asm ||
+    fail "run filling the cache failed"
+echo '%define SVAL 0x55' > inc1/sh.inc
+"$NASM" -f bin -Iinc1 -Iinc2 -o ref4.bin sh.asm || fail "plain run failed"
+"$NASM" -f bin -Iinc1 -Iinc2 --cache-dir cache -o sh.bin sh.asm ||
+    fail "run after adding inc1/sh.inc failed"
+cmp -s ref4.bin sh.bin || fail "shadowed header used from the cache"
+
+exit 0
@@ -0,0 +1,115 @@
+#!/bin/sh
+#
+# Test the preprocessor snapshot (--pp-snapshot): the output of a run
+# which writes the snapshot and of a run which installs it must match
+# a run without one, and a snapshot must not be used once a file it was
+# made from has changed, even if its size is the same, or is shadowed
+# by a file earlier in the include path.  Nor must a snapshot be made
+# of a state depending on the environment or the time.
+#
+# Usage: ppsnapshot.sh [nasm]
+#
+
+NASM=${1:-../nasm}
+case "$NASM" in
+    /*) ;;
+    *) NASM="$(pwd)/$NASM" ;;
+esac
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0 1 2 15
+cd "$dir" || exit 1
+
+fail() {
+    echo "ppsnapshot: $*" 1>&2
+    exit 1
+}
+
+tokens() {
+    sed -n 's/^ *"tokens": \([0-9]*\).*/\1/p' "$1"
+}
+
+cat > pre.inc <<'EOF'
+%use altreg
+%define SVAL 0x11
+%assign AVAL 3
+%macro emit 1
+    db %1, SVAL, AVAL
+%endmacro
+EOF
+
+cat > t.asm <<'EOF'
+    bits 64
+    emit 7
+    mov r0, r1
+%assign AVAL AVAL+1
+    dd AVAL, SVAL
+EOF
+
+"$NASM" -f bin -P pre.inc -o ref.bin t.asm || fail "plain run failed"
+
+"$NASM" -f bin -P pre.inc --pp-snapshot snap --profile=p1 -o o1.bin t.asm ||
+    fail "run writing the snapshot failed"
+test -f snap || fail "no snapshot written"
+cmp -s ref.bin o1.bin || fail "output differs when writing the snapshot"
+
+"$NASM" -f bin -P pre.inc --pp-snapshot snap --profile=p2 -o o2.bin t.asm ||
+    fail "run using the snapshot failed"
+cmp -s ref.bin o2.bin || fail "output differs when using the snapshot"
+test "$(tokens p2)" -lt "$(tokens p1)" || fail "snapshot not used"
+
+# Same size, different contents
+sed 's/0x11/0x22/' pre.inc > pre.new && mv pre.new pre.inc
+"$NASM" -f bin -P pre.inc -o ref2.bin t.asm || fail "plain run failed"
+cmp -s ref.bin ref2.bin && fail "changing pre.inc had no effect"
+
+"$NASM" -f bin -P pre.inc --pp-snapshot snap -o o3.bin t.asm ||
+    fail "run after changing pre.inc failed"
+cmp -s ref2.bin o3.bin || fail "stale snapshot used"
+
+# A pre-included file testing the environment must not be snapshotted
+cat > env.inc <<'EOF'
+%ifenv NASM_PPSNAP_TEST
+%define V 1
+%else
+%define V 2
+%endif
+EOF
+echo '    db V' > env.asm
+
+(unset NASM_PPSNAP_TEST; "$NASM" -f bin -P env.inc -o ref4.bin env.asm) ||
+    fail "plain run failed"
+NASM_PPSNAP_TEST=1 "$NASM" -f bin -P env.inc --pp-snapshot esnap \
+    -o o4.bin env.asm || fail "run with the variable set failed"
+(unset NASM_PPSNAP_TEST
+ "$NASM" -f bin -P env.inc --pp-snapshot esnap -o o5.bin env.asm) ||
+    fail "run with the variable unset failed"
+cmp -s ref4.bin o5.bin || fail "snapshot depending on the environment used"
+
+# Nor one using the time, even under a name made up by pasting
+cat > time.inc <<'EOF'
+%define T TIME
+%xdefine STAMP __?POSIX_%[T]?__
+EOF
+echo '    dq STAMP' > time.asm
+
+"$NASM" -f bin -P time.inc --pp-snapshot tsnap -o o6.bin time.asm ||
+    fail "run using the time failed"
+test -f tsnap && fail "snapshot depending on the time written"
+
+# A file earlier in the include path shadowing a pre-included one
+mkdir inc1 inc2
+echo '%define SV 0x66' > inc2/sh.inc
+echo '    db SV' > sh.asm
+
+"$NASM" -f bin -Iinc1 -Iinc2 -P sh.inc --pp-snapshot ssnap -o o7.bin sh.asm ||
+    fail "run writing the snapshot failed"
+test -f ssnap || fail "no snapshot written"
+echo '%define SV 0x77' > inc1/sh.inc
+"$NASM" -f bin -Iinc1 -Iinc2 -P sh.inc -o ref5.bin sh.asm ||
+    fail "plain run failed"
+"$NASM" -f bin -Iinc1 -Iinc2 -P sh.inc --pp-snapshot ssnap -o o8.bin sh.asm ||
+    fail "run after adding inc1/sh.inc failed"
+cmp -s ref5.bin o8.bin || fail "snapshot of a shadowed file used"
+
+exit 0
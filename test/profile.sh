@@ -0,0 +1,111 @@
+#!/bin/sh
+#
+# Test the profiling report (--profile): it must be valid JSON with
+# the documented keys, a final pass, and counters which add up.  The
+# counters also show that the optimizations they count take effect.
+#
+# Usage: profile.sh [nasm]
+#
+
+NASM=${1:-../nasm}
+case "$NASM" in
+    /*) ;;
+    *) NASM="$(pwd)/$NASM" ;;
+esac
+PYTHON3=${PYTHON3:-python3}
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0 1 2 15
+cd "$dir" || exit 1
+
+fail() {
+    echo "profile: $*" 1>&2
+    exit 1
+}
+
+counter() {
+    "$PYTHON3" -c 'import json, sys
+print(json.load(open(sys.argv[1]))["counters"][sys.argv[2]])' "$1" "$2"
+}
+
+cat > t.asm <<'EOF'
+%define ONE 1
+%macro twice 1
+    db %1, %1
+%endmacro
+    bits 32
+start:
+    twice ONE
+    jmp start
+    times 3 nop
+EOF
+
+"$NASM" -f bin --profile=p.json -o t.bin t.asm || fail "run failed"
+test -f p.json || fail "no report written"
+
+"$PYTHON3" - p.json <<'EOF' || fail "bad report"
+import json, sys
+
+with open(sys.argv[1]) as f:
+    r = json.load(f)
+
+phases = ['preprocess', 'parse', 'match', 'output']
+counters = ['lines', 'tokens', 'smacro_expansions', 'mmacro_expansions',
+            'hash_lookups', 'hash_probes', 'label_lookups']
+
+def check(cond, what):
+    if not cond:
+        sys.stderr.write('profile: %s\n' % what)
+        sys.exit(1)
+
+check(r['input'] == 't.asm', 'wrong input name')
+check(isinstance(r['time'], float) and r['time'] > 0, 'no total time')
+for p in phases:
+    check(isinstance(r['phases'][p], float), 'phase %s missing' % p)
+
+passes = r['passes']
+check(passes and passes[-1]['type'] == 'final', 'no final pass')
+for n, ps in enumerate(passes):
+    check(ps['pass'] == n + 1, 'passes out of order')
+    for p in phases:
+        check(isinstance(ps[p], float), 'phase %s missing in a pass' % p)
+
+for c in counters:
+    check(isinstance(r['counters'][c], int), 'counter %s missing' % c)
+check(r['counters']['lines'] > 0, 'no lines counted')
+check(r['counters']['smacro_expansions'] > 0, 'no smacros counted')
+check(r['counters']['mmacro_expansions'] > 0, 'no mmacros counted')
+EOF
+
+# A header with an include guard is not read again
+cat > guard.inc <<'EOF'
+%ifndef GUARD_INC
+%define GUARD_INC
+    db 1
+%endif
+EOF
+printf '%%include "guard.inc"\n%%include "guard.inc"\n' > guard.asm
+"$NASM" -f bin --profile=guard.json -o guard.bin guard.asm || fail "run failed"
+test "$(counter guard.json guarded_includes)" -gt 0 ||
+    fail "guarded header read again"
+
+# Lines in false conditional blocks are not tokenized
+cat > skip.asm <<'EOF'
+%if 0
+    db 1, 2, 3
+    mov eax, ebx
+%endif
+EOF
+"$NASM" -f bin --profile=skip.json -o skip.bin skip.asm || fail "run failed"
+test "$(counter skip.json cond_skipped_lines)" -gt 0 ||
+    fail "false conditional lines tokenized"
+
+# Identifiers which are not macro names skip the smacro lookup
+test "$(counter p.json smacro_filter_skips)" -gt 0 ||
+    fail "no smacro lookups skipped"
+
+# Instructions sized again in a later pass hit the encoding cache
+test "$(counter p.json encode_cache_hits)" -gt 0 ||
+    fail "no encodings reused"
+
+exit 0
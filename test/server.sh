@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Test the resident server (--server/--client): jobs sharing a header
+# must see it changed, shadowed by a new file earlier in the include
+# path, and listed in the dependencies, as a separate run of NASM
+# would.
+#
+# Usage: server.sh [nasm]
+#
+
+NASM=${1:-../nasm}
+case "$NASM" in
+    /*) ;;
+    *) NASM="$(pwd)/$NASM" ;;
+esac
+
+dir=$(mktemp -d) || exit 1
+server=
+trap 'test -n "$server" && kill $server; rm -rf "$dir"' 0 1 2 15
+cd "$dir" || exit 1
+
+fail() {
+    echo "server: $*" 1>&2
+    exit 1
+}
+
+mkdir inc1 inc2
+
+cat > inc2/common.inc <<'EOF'
+%define VAL 0x11
+EOF
+
+cat > a.asm <<'EOF'
+%include "common.inc"
+    dw VAL, 1
+EOF
+
+cat > b.asm <<'EOF'
+%include "common.inc"
+    dw VAL, 2
+EOF
+
+"$NASM" --server sock &
+server=$!
+i=0
+while test ! -S sock; do
+    i=$((i + 1))
+    test $i -lt 50 || fail "server did not start"
+    sleep 0.1
+done
+
+"$NASM" --client sock -f bin -Iinc1 -Iinc2 -o a.bin a.asm ||
+    fail "first job failed"
+"$NASM" -f bin -Iinc1 -Iinc2 -o ref.bin a.asm || fail "plain run failed"
+cmp -s ref.bin a.bin || fail "first job output differs"
+
+# A changed header
+sed 's/0x11/0x2222/' inc2/common.inc > common.new &&
+    mv common.new inc2/common.inc
+"$NASM" --client sock -f bin -Iinc1 -Iinc2 -MD b.d -o b.bin b.asm ||
+    fail "second job failed"
+"$NASM" -f bin -Iinc1 -Iinc2 -o ref.bin b.asm || fail "plain run failed"
+cmp -s ref.bin b.bin || fail "changed header not seen"
+grep -q 'inc2/common.inc' b.d || fail "header missing from dependencies"
+
+# A header now shadowing the one found before, and the dependencies
+echo '%define VAL 0x33' > inc1/common.inc
+"$NASM" --client sock -f bin -Iinc1 -Iinc2 -MD b.d -o b.bin b.asm ||
+    fail "third job failed"
+"$NASM" -f bin -Iinc1 -Iinc2 -o ref.bin b.asm || fail "plain run failed"
+cmp -s ref.bin b.bin || fail "shadowing header not seen"
+grep -q 'inc1/common.inc' b.d || fail "header missing from dependencies"
+
+exit 0
@@ -0,0 +1,61 @@
+;
+; Lines in false conditional blocks are passed over without being
+; tokenized, unless they may be preprocessor directives which matter
+; there.
+;
+%define YES 1
+%if 0
+    db 'not %endif', "%else", `%elif`
+    db 1 ; %endif
+%if YES
+    db 2
+%elif YES
+    db 3
+%else
+    db 4
+%endif
+%rep 3
+    db 5
+%endrep
+%macro m 0
+    db 6
+%endmacro
+%line 100+1 elsewhere.asm
+  %IFDEF YES
+    db 7
+  %ENDIF
+%1 %% %+ %[YES]
+#line 1 other.c
+%elifn YES
+    db 8
+%elifdef YES ; %endif
+    db 9
+%if 1
+    db 10
+%else
+    %error "not here"
+%endif
+%ifdef NO
+%else
+%ifnidn a, b
+    db 11 ; '
+%endif
+%endif
+%else
+    db 12
+%endif
+%rep 2
+%ifdef NO
+    db 13
+%else
+    db 14
+%endif
+%endrep
+%if 0
+%elif 0
+    db 15 \
+%endif
+%elif 1
+    db 16
+%endif
+    db __?LINE?__
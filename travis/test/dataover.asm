@@ -0,0 +1,28 @@
+;
+; Runs of constant data with values which overflow their element
+; size, mixed with values which are not constants, in lists long
+; enough to be written in several blocks.
+;
+	bits 32
+	db 1, 2, 0x100, -129, 3, 'ab', 4, -128, 255, 256
+	dw 1, 0x10000, -32769, 0xffff, -32768, 2
+	dd 0x100000000, -0x80000001, 0xffffffff, label, 7
+	dq 0x8000000000000000, -1, label, 0x123456789abcdef
+	db label - $$, 0x1ff, 5
+	times 3 dw 0x12345, 6
+label:
+	db 10, 11, 300
+[list -]
+%assign i 1
+%xdefine vals 0
+%rep 4500
+%if i == 2000 || i == 4200
+%xdefine vals vals, 0x100 + i
+%else
+%xdefine vals vals, i & 0xff
+%endif
+%assign i i + 1
+%endrep
+[list +]
+	db vals
+	dw 0x12345, 0
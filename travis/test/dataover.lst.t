@@ -0,0 +1,536 @@
+     1                                  ;
+     2                                  ; Runs of constant data with values which overflow their element
+     3                                  ; size, mixed with values which are not constants, in lists long
+     4                                  ; enough to be written in several blocks.
+     5                                  ;
+     6                                  	bits 32
+     7 00000000 0102007F0361620480-     	db 1, 2, 0x100, -129, 3, 'ab', 4, -128, 255, 256
+     7          ******************       warning: byte data exceeds bounds [-w+number-overflow]
+     7 00000009 FF00               
+     7          ******************       warning: byte data exceeds bounds [-w+number-overflow]
+     8 0000000B 01000000FF7FFFFF00-     	dw 1, 0x10000, -32769, 0xffff, -32768, 2
+     8          ******************       warning: word data exceeds bounds [-w+number-overflow]
+     8 00000014 800200             
+     9 00000017 00000000FFFFFF7FFF-     	dd 0x100000000, -0x80000001, 0xffffffff, label, 7
+     9          ******************       warning: dword data exceeds bounds [-w+number-overflow]
+     9 00000020 FFFFFF[5A000000]07-
+     9 00000028 000000             
+    10 0000002B 0000000000000080FF-     	dq 0x8000000000000000, -1, label, 0x123456789abcdef
+    10 00000034 FFFFFFFFFFFFFF-    
+    10 0000003B [5A00000000000000]-
+    10 00000043 EFCDAB8967452301   
+    11 0000004B 5AFF05                  	db label - $$, 0x1ff, 5
+    11          ******************       warning: byte data exceeds bounds [-w+number-overflow]
+    12 0000004E 45230600<rep 3h>        	times 3 dw 0x12345, 6
+    12          ******************       warning: word data exceeds bounds [-w+number-overflow]
+    12          ******************       warning: word data exceeds bounds [-w+number-overflow]
+    12          ******************       warning: word data exceeds bounds [-w+number-overflow]
+    13                                  label:
+    14 0000005A 0A0B2C                  	db 10, 11, 300
+    14          ******************       warning: byte data exceeds bounds [-w+number-overflow]
+    15                                  [list -]
+    27 0000005D 000102030405060708-     	db vals
+    27 00000066 090A0B0C0D0E0F1011-
+    27 0000006F 12131415161718191A-
+    27 00000078 1B1C1D1E1F20212223-
+    27 00000081 2425262728292A2B2C-
+    27 0000008A 2D2E2F303132333435-
+    27 00000093 363738393A3B3C3D3E-
+    27 0000009C 3F4041424344454647-
+    27 000000A5 48494A4B4C4D4E4F50-
+    27 000000AE 515253545556575859-
+    27 000000B7 5A5B5C5D5E5F606162-
+    27 000000C0 636465666768696A6B-
+    27 000000C9 6C6D6E6F7071727374-
+    27 000000D2 75767778797A7B7C7D-
+    27 000000DB 7E7F80818283848586-
+    27 000000E4 8788898A8B8C8D8E8F-
+    27 000000ED 909192939495969798-
+    27 000000F6 999A9B9C9D9E9FA0A1-
+    27 000000FF A2A3A4A5A6A7A8A9AA-
+    27 00000108 ABACADAEAFB0B1B2B3-
+    27 00000111 B4B5B6B7B8B9BABBBC-
+    27 0000011A BDBEBFC0C1C2C3C4C5-
+    27 00000123 C6C7C8C9CACBCCCDCE-
+    27 0000012C CFD0D1D2D3D4D5D6D7-
+    27 00000135 D8D9DADBDCDDDEDFE0-
+    27 0000013E E1E2E3E4E5E6E7E8E9-
+    27 00000147 EAEBECEDEEEFF0F1F2-
+    27 00000150 F3F4F5F6F7F8F9FAFB-
+    27 00000159 FCFDFEFF0001020304-
+    27 00000162 05060708090A0B0C0D-
+    27 0000016B 0E0F10111213141516-
+    27 00000174 1718191A1B1C1D1E1F-
+    27 0000017D 202122232425262728-
+    27 00000186 292A2B2C2D2E2F3031-
+    27 0000018F 32333435363738393A-
+    27 00000198 3B3C3D3E3F40414243-
+    27 000001A1 4445464748494A4B4C-
+    27 000001AA 4D4E4F505152535455-
+    27 000001B3 565758595A5B5C5D5E-
+    27 000001BC 5F6061626364656667-
+    27 000001C5 68696A6B6C6D6E6F70-
+    27 000001CE 717273747576777879-
+    27 000001D7 7A7B7C7D7E7F808182-
+    27 000001E0 838485868788898A8B-
+    27 000001E9 8C8D8E8F9091929394-
+    27 000001F2 95969798999A9B9C9D-
+    27 000001FB 9E9FA0A1A2A3A4A5A6-
+    27 00000204 A7A8A9AAABACADAEAF-
+    27 0000020D B0B1B2B3B4B5B6B7B8-
+    27 00000216 B9BABBBCBDBEBFC0C1-
+    27 0000021F C2C3C4C5C6C7C8C9CA-
+    27 00000228 CBCCCDCECFD0D1D2D3-
+    27 00000231 D4D5D6D7D8D9DADBDC-
+    27 0000023A DDDEDFE0E1E2E3E4E5-
+    27 00000243 E6E7E8E9EAEBECEDEE-
+    27 0000024C EFF0F1F2F3F4F5F6F7-
+    27 00000255 F8F9FAFBFCFDFEFF00-
+    27 0000025E 010203040506070809-
+    27 00000267 0A0B0C0D0E0F101112-
+    27 00000270 131415161718191A1B-
+    27 00000279 1C1D1E1F2021222324-
+    27 00000282 25262728292A2B2C2D-
+    27 0000028B 2E2F30313233343536-
+    27 00000294 3738393A3B3C3D3E3F-
+    27 0000029D 404142434445464748-
+    27 000002A6 494A4B4C4D4E4F5051-
+    27 000002AF 52535455565758595A-
+    27 000002B8 5B5C5D5E5F60616263-
+    27 000002C1 6465666768696A6B6C-
+    27 000002CA 6D6E6F707172737475-
+    27 000002D3 767778797A7B7C7D7E-
+    27 000002DC 7F8081828384858687-
+    27 000002E5 88898A8B8C8D8E8F90-
+    27 000002EE 919293949596979899-
+    27 000002F7 9A9B9C9D9E9FA0A1A2-
+    27 00000300 A3A4A5A6A7A8A9AAAB-
+    27 00000309 ACADAEAFB0B1B2B3B4-
+    27 00000312 B5B6B7B8B9BABBBCBD-
+    27 0000031B BEBFC0C1C2C3C4C5C6-
+    27 00000324 C7C8C9CACBCCCDCECF-
+    27 0000032D D0D1D2D3D4D5D6D7D8-
+    27 00000336 D9DADBDCDDDEDFE0E1-
+    27 0000033F E2E3E4E5E6E7E8E9EA-
+    27 00000348 EBECEDEEEFF0F1F2F3-
+    27 00000351 F4F5F6F7F8F9FAFBFC-
+    27 0000035A FDFEFF000102030405-
+    27 00000363 060708090A0B0C0D0E-
+    27 0000036C 0F1011121314151617-
+    27 00000375 18191A1B1C1D1E1F20-
+    27 0000037E 212223242526272829-
+    27 00000387 2A2B2C2D2E2F303132-
+    27 00000390 333435363738393A3B-
+    27 00000399 3C3D3E3F4041424344-
+    27 000003A2 45464748494A4B4C4D-
+    27 000003AB 4E4F50515253545556-
+    27 000003B4 5758595A5B5C5D5E5F-
+    27 000003BD 606162636465666768-
+    27 000003C6 696A6B6C6D6E6F7071-
+    27 000003CF 72737475767778797A-
+    27 000003D8 7B7C7D7E7F80818283-
+    27 000003E1 8485868788898A8B8C-
+    27 000003EA 8D8E8F909192939495-
+    27 000003F3 969798999A9B9C9D9E-
+    27 000003FC 9FA0A1A2A3A4A5A6A7-
+    27 00000405 A8A9AAABACADAEAFB0-
+    27 0000040E B1B2B3B4B5B6B7B8B9-
+    27 00000417 BABBBCBDBEBFC0C1C2-
+    27 00000420 C3C4C5C6C7C8C9CACB-
+    27 00000429 CCCDCECFD0D1D2D3D4-
+    27 00000432 D5D6D7D8D9DADBDCDD-
+    27 0000043B DEDFE0E1E2E3E4E5E6-
+    27 00000444 E7E8E9EAEBECEDEEEF-
+    27 0000044D F0F1F2F3F4F5F6F7F8-
+    27 00000456 F9FAFBFCFDFEFF0001-
+    27 0000045F 02030405060708090A-
+    27 00000468 0B0C0D0E0F10111213-
+    27 00000471 1415161718191A1B1C-
+    27 0000047A 1D1E1F202122232425-
+    27 00000483 262728292A2B2C2D2E-
+    27 0000048C 2F3031323334353637-
+    27 00000495 38393A3B3C3D3E3F40-
+    27 0000049E 414243444546474849-
+    27 000004A7 4A4B4C4D4E4F505152-
+    27 000004B0 535455565758595A5B-
+    27 000004B9 5C5D5E5F6061626364-
+    27 000004C2 65666768696A6B6C6D-
+    27 000004CB 6E6F70717273747576-
+    27 000004D4 7778797A7B7C7D7E7F-
+    27 000004DD 808182838485868788-
+    27 000004E6 898A8B8C8D8E8F9091-
+    27 000004EF 92939495969798999A-
+    27 000004F8 9B9C9D9E9FA0A1A2A3-
+    27 00000501 A4A5A6A7A8A9AAABAC-
+    27 0000050A ADAEAFB0B1B2B3B4B5-
+    27 00000513 B6B7B8B9BABBBCBDBE-
+    27 0000051C BFC0C1C2C3C4C5C6C7-
+    27 00000525 C8C9CACBCCCDCECFD0-
+    27 0000052E D1D2D3D4D5D6D7D8D9-
+    27 00000537 DADBDCDDDEDFE0E1E2-
+    27 00000540 E3E4E5E6E7E8E9EAEB-
+    27 00000549 ECEDEEEFF0F1F2F3F4-
+    27 00000552 F5F6F7F8F9FAFBFCFD-
+    27 0000055B FEFF00010203040506-
+    27 00000564 0708090A0B0C0D0E0F-
+    27 0000056D 101112131415161718-
+    27 00000576 191A1B1C1D1E1F2021-
+    27 0000057F 22232425262728292A-
+    27 00000588 2B2C2D2E2F30313233-
+    27 00000591 3435363738393A3B3C-
+    27 0000059A 3D3E3F404142434445-
+    27 000005A3 464748494A4B4C4D4E-
+    27 000005AC 4F5051525354555657-
+    27 000005B5 58595A5B5C5D5E5F60-
+    27 000005BE 616263646566676869-
+    27 000005C7 6A6B6C6D6E6F707172-
+    27 000005D0 737475767778797A7B-
+    27 000005D9 7C7D7E7F8081828384-
+    27 000005E2 85868788898A8B8C8D-
+    27 000005EB 8E8F90919293949596-
+    27 000005F4 9798999A9B9C9D9E9F-
+    27 000005FD A0A1A2A3A4A5A6A7A8-
+    27 00000606 A9AAABACADAEAFB0B1-
+    27 0000060F B2B3B4B5B6B7B8B9BA-
+    27 00000618 BBBCBDBEBFC0C1C2C3-
+    27 00000621 C4C5C6C7C8C9CACBCC-
+    27 0000062A CDCECFD0D1D2D3D4D5-
+    27 00000633 D6D7D8D9DADBDCDDDE-
+    27 0000063C DFE0E1E2E3E4E5E6E7-
+    27 00000645 E8E9EAEBECEDEEEFF0-
+    27 0000064E F1F2F3F4F5F6F7F8F9-
+    27 00000657 FAFBFCFDFEFF000102-
+    27 00000660 030405060708090A0B-
+    27 00000669 0C0D0E0F1011121314-
+    27 00000672 15161718191A1B1C1D-
+    27 0000067B 1E1F20212223242526-
+    27 00000684 2728292A2B2C2D2E2F-
+    27 0000068D 303132333435363738-
+    27 00000696 393A3B3C3D3E3F4041-
+    27 0000069F 42434445464748494A-
+    27 000006A8 4B4C4D4E4F50515253-
+    27 000006B1 5455565758595A5B5C-
+    27 000006BA 5D5E5F606162636465-
+    27 000006C3 666768696A6B6C6D6E-
+    27 000006CC 6F7071727374757677-
+    27 000006D5 78797A7B7C7D7E7F80-
+    27 000006DE 818283848586878889-
+    27 000006E7 8A8B8C8D8E8F909192-
+    27 000006F0 939495969798999A9B-
+    27 000006F9 9C9D9E9FA0A1A2A3A4-
+    27 00000702 A5A6A7A8A9AAABACAD-
+    27 0000070B AEAFB0B1B2B3B4B5B6-
+    27 00000714 B7B8B9BABBBCBDBEBF-
+    27 0000071D C0C1C2C3C4C5C6C7C8-
+    27 00000726 C9CACBCCCDCECFD0D1-
+    27 0000072F D2D3D4D5D6D7D8D9DA-
+    27 00000738 DBDCDDDEDFE0E1E2E3-
+    27 00000741 E4E5E6E7E8E9EAEBEC-
+    27 0000074A EDEEEFF0F1F2F3F4F5-
+    27 00000753 F6F7F8F9FAFBFCFDFE-
+    27 0000075C FF0001020304050607-
+    27 00000765 08090A0B0C0D0E0F10-
+    27 0000076E 111213141516171819-
+    27 00000777 1A1B1C1D1E1F202122-
+    27 00000780 232425262728292A2B-
+    27 00000789 2C2D2E2F3031323334-
+    27 00000792 35363738393A3B3C3D-
+    27 0000079B 3E3F40414243444546-
+    27 000007A4 4748494A4B4C4D4E4F-
+    27 000007AD 505152535455565758-
+    27 000007B6 595A5B5C5D5E5F6061-
+    27 000007BF 62636465666768696A-
+    27 000007C8 6B6C6D6E6F70717273-
+    27 000007D1 7475767778797A7B7C-
+    27 000007DA 7D7E7F808182838485-
+    27 000007E3 868788898A8B8C8D8E-
+    27 000007EC 8F9091929394959697-
+    27 000007F5 98999A9B9C9D9E9FA0-
+    27 000007FE A1A2A3A4A5A6A7A8A9-
+    27 00000807 AAABACADAEAFB0B1B2-
+    27 00000810 B3B4B5B6B7B8B9BABB-
+    27 00000819 BCBDBEBFC0C1C2C3C4-
+    27 00000822 C5C6C7C8C9CACBCCCD-
+    27 0000082B CECFD0D1D2D3D4D5D6-
+    27          ******************       warning: byte data exceeds bounds [-w+number-overflow]
+    27 00000834 D7D8D9DADBDCDDDEDF-
+    27 0000083D E0E1E2E3E4E5E6E7E8-
+    27 00000846 E9EAEBECEDEEEFF0F1-
+    27 0000084F F2F3F4F5F6F7F8F9FA-
+    27 00000858 FBFCFDFEFF00010203-
+    27 00000861 0405060708090A0B0C-
+    27 0000086A 0D0E0F101112131415-
+    27 00000873 161718191A1B1C1D1E-
+    27 0000087C 1F2021222324252627-
+    27 00000885 28292A2B2C2D2E2F30-
+    27 0000088E 313233343536373839-
+    27 00000897 3A3B3C3D3E3F404142-
+    27 000008A0 434445464748494A4B-
+    27 000008A9 4C4D4E4F5051525354-
+    27 000008B2 55565758595A5B5C5D-
+    27 000008BB 5E5F60616263646566-
+    27 000008C4 6768696A6B6C6D6E6F-
+    27 000008CD 707172737475767778-
+    27 000008D6 797A7B7C7D7E7F8081-
+    27 000008DF 82838485868788898A-
+    27 000008E8 8B8C8D8E8F90919293-
+    27 000008F1 9495969798999A9B9C-
+    27 000008FA 9D9E9FA0A1A2A3A4A5-
+    27 00000903 A6A7A8A9AAABACADAE-
+    27 0000090C AFB0B1B2B3B4B5B6B7-
+    27 00000915 B8B9BABBBCBDBEBFC0-
+    27 0000091E C1C2C3C4C5C6C7C8C9-
+    27 00000927 CACBCCCDCECFD0D1D2-
+    27 00000930 D3D4D5D6D7D8D9DADB-
+    27 00000939 DCDDDEDFE0E1E2E3E4-
+    27 00000942 E5E6E7E8E9EAEBECED-
+    27 0000094B EEEFF0F1F2F3F4F5F6-
+    27 00000954 F7F8F9FAFBFCFDFEFF-
+    27 0000095D 000102030405060708-
+    27 00000966 090A0B0C0D0E0F1011-
+    27 0000096F 12131415161718191A-
+    27 00000978 1B1C1D1E1F20212223-
+    27 00000981 2425262728292A2B2C-
+    27 0000098A 2D2E2F303132333435-
+    27 00000993 363738393A3B3C3D3E-
+    27 0000099C 3F4041424344454647-
+    27 000009A5 48494A4B4C4D4E4F50-
+    27 000009AE 515253545556575859-
+    27 000009B7 5A5B5C5D5E5F606162-
+    27 000009C0 636465666768696A6B-
+    27 000009C9 6C6D6E6F7071727374-
+    27 000009D2 75767778797A7B7C7D-
+    27 000009DB 7E7F80818283848586-
+    27 000009E4 8788898A8B8C8D8E8F-
+    27 000009ED 909192939495969798-
+    27 000009F6 999A9B9C9D9E9FA0A1-
+    27 000009FF A2A3A4A5A6A7A8A9AA-
+    27 00000A08 ABACADAEAFB0B1B2B3-
+    27 00000A11 B4B5B6B7B8B9BABBBC-
+    27 00000A1A BDBEBFC0C1C2C3C4C5-
+    27 00000A23 C6C7C8C9CACBCCCDCE-
+    27 00000A2C CFD0D1D2D3D4D5D6D7-
+    27 00000A35 D8D9DADBDCDDDEDFE0-
+    27 00000A3E E1E2E3E4E5E6E7E8E9-
+    27 00000A47 EAEBECEDEEEFF0F1F2-
+    27 00000A50 F3F4F5F6F7F8F9FAFB-
+    27 00000A59 FCFDFEFF0001020304-
+    27 00000A62 05060708090A0B0C0D-
+    27 00000A6B 0E0F10111213141516-
+    27 00000A74 1718191A1B1C1D1E1F-
+    27 00000A7D 202122232425262728-
+    27 00000A86 292A2B2C2D2E2F3031-
+    27 00000A8F 32333435363738393A-
+    27 00000A98 3B3C3D3E3F40414243-
+    27 00000AA1 4445464748494A4B4C-
+    27 00000AAA 4D4E4F505152535455-
+    27 00000AB3 565758595A5B5C5D5E-
+    27 00000ABC 5F6061626364656667-
+    27 00000AC5 68696A6B6C6D6E6F70-
+    27 00000ACE 717273747576777879-
+    27 00000AD7 7A7B7C7D7E7F808182-
+    27 00000AE0 838485868788898A8B-
+    27 00000AE9 8C8D8E8F9091929394-
+    27 00000AF2 95969798999A9B9C9D-
+    27 00000AFB 9E9FA0A1A2A3A4A5A6-
+    27 00000B04 A7A8A9AAABACADAEAF-
+    27 00000B0D B0B1B2B3B4B5B6B7B8-
+    27 00000B16 B9BABBBCBDBEBFC0C1-
+    27 00000B1F C2C3C4C5C6C7C8C9CA-
+    27 00000B28 CBCCCDCECFD0D1D2D3-
+    27 00000B31 D4D5D6D7D8D9DADBDC-
+    27 00000B3A DDDEDFE0E1E2E3E4E5-
+    27 00000B43 E6E7E8E9EAEBECEDEE-
+    27 00000B4C EFF0F1F2F3F4F5F6F7-
+    27 00000B55 F8F9FAFBFCFDFEFF00-
+    27 00000B5E 010203040506070809-
+    27 00000B67 0A0B0C0D0E0F101112-
+    27 00000B70 131415161718191A1B-
+    27 00000B79 1C1D1E1F2021222324-
+    27 00000B82 25262728292A2B2C2D-
+    27 00000B8B 2E2F30313233343536-
+    27 00000B94 3738393A3B3C3D3E3F-
+    27 00000B9D 404142434445464748-
+    27 00000BA6 494A4B4C4D4E4F5051-
+    27 00000BAF 52535455565758595A-
+    27 00000BB8 5B5C5D5E5F60616263-
+    27 00000BC1 6465666768696A6B6C-
+    27 00000BCA 6D6E6F707172737475-
+    27 00000BD3 767778797A7B7C7D7E-
+    27 00000BDC 7F8081828384858687-
+    27 00000BE5 88898A8B8C8D8E8F90-
+    27 00000BEE 919293949596979899-
+    27 00000BF7 9A9B9C9D9E9FA0A1A2-
+    27 00000C00 A3A4A5A6A7A8A9AAAB-
+    27 00000C09 ACADAEAFB0B1B2B3B4-
+    27 00000C12 B5B6B7B8B9BABBBCBD-
+    27 00000C1B BEBFC0C1C2C3C4C5C6-
+    27 00000C24 C7C8C9CACBCCCDCECF-
+    27 00000C2D D0D1D2D3D4D5D6D7D8-
+    27 00000C36 D9DADBDCDDDEDFE0E1-
+    27 00000C3F E2E3E4E5E6E7E8E9EA-
+    27 00000C48 EBECEDEEEFF0F1F2F3-
+    27 00000C51 F4F5F6F7F8F9FAFBFC-
+    27 00000C5A FDFEFF000102030405-
+    27 00000C63 060708090A0B0C0D0E-
+    27 00000C6C 0F1011121314151617-
+    27 00000C75 18191A1B1C1D1E1F20-
+    27 00000C7E 212223242526272829-
+    27 00000C87 2A2B2C2D2E2F303132-
+    27 00000C90 333435363738393A3B-
+    27 00000C99 3C3D3E3F4041424344-
+    27 00000CA2 45464748494A4B4C4D-
+    27 00000CAB 4E4F50515253545556-
+    27 00000CB4 5758595A5B5C5D5E5F-
+    27 00000CBD 606162636465666768-
+    27 00000CC6 696A6B6C6D6E6F7071-
+    27 00000CCF 72737475767778797A-
+    27 00000CD8 7B7C7D7E7F80818283-
+    27 00000CE1 8485868788898A8B8C-
+    27 00000CEA 8D8E8F909192939495-
+    27 00000CF3 969798999A9B9C9D9E-
+    27 00000CFC 9FA0A1A2A3A4A5A6A7-
+    27 00000D05 A8A9AAABACADAEAFB0-
+    27 00000D0E B1B2B3B4B5B6B7B8B9-
+    27 00000D17 BABBBCBDBEBFC0C1C2-
+    27 00000D20 C3C4C5C6C7C8C9CACB-
+    27 00000D29 CCCDCECFD0D1D2D3D4-
+    27 00000D32 D5D6D7D8D9DADBDCDD-
+    27 00000D3B DEDFE0E1E2E3E4E5E6-
+    27 00000D44 E7E8E9EAEBECEDEEEF-
+    27 00000D4D F0F1F2F3F4F5F6F7F8-
+    27 00000D56 F9FAFBFCFDFEFF0001-
+    27 00000D5F 02030405060708090A-
+    27 00000D68 0B0C0D0E0F10111213-
+    27 00000D71 1415161718191A1B1C-
+    27 00000D7A 1D1E1F202122232425-
+    27 00000D83 262728292A2B2C2D2E-
+    27 00000D8C 2F3031323334353637-
+    27 00000D95 38393A3B3C3D3E3F40-
+    27 00000D9E 414243444546474849-
+    27 00000DA7 4A4B4C4D4E4F505152-
+    27 00000DB0 535455565758595A5B-
+    27 00000DB9 5C5D5E5F6061626364-
+    27 00000DC2 65666768696A6B6C6D-
+    27 00000DCB 6E6F70717273747576-
+    27 00000DD4 7778797A7B7C7D7E7F-
+    27 00000DDD 808182838485868788-
+    27 00000DE6 898A8B8C8D8E8F9091-
+    27 00000DEF 92939495969798999A-
+    27 00000DF8 9B9C9D9E9FA0A1A2A3-
+    27 00000E01 A4A5A6A7A8A9AAABAC-
+    27 00000E0A ADAEAFB0B1B2B3B4B5-
+    27 00000E13 B6B7B8B9BABBBCBDBE-
+    27 00000E1C BFC0C1C2C3C4C5C6C7-
+    27 00000E25 C8C9CACBCCCDCECFD0-
+    27 00000E2E D1D2D3D4D5D6D7D8D9-
+    27 00000E37 DADBDCDDDEDFE0E1E2-
+    27 00000E40 E3E4E5E6E7E8E9EAEB-
+    27 00000E49 ECEDEEEFF0F1F2F3F4-
+    27 00000E52 F5F6F7F8F9FAFBFCFD-
+    27 00000E5B FEFF00010203040506-
+    27 00000E64 0708090A0B0C0D0E0F-
+    27 00000E6D 101112131415161718-
+    27 00000E76 191A1B1C1D1E1F2021-
+    27 00000E7F 22232425262728292A-
+    27 00000E88 2B2C2D2E2F30313233-
+    27 00000E91 3435363738393A3B3C-
+    27 00000E9A 3D3E3F404142434445-
+    27 00000EA3 464748494A4B4C4D4E-
+    27 00000EAC 4F5051525354555657-
+    27 00000EB5 58595A5B5C5D5E5F60-
+    27 00000EBE 616263646566676869-
+    27 00000EC7 6A6B6C6D6E6F707172-
+    27 00000ED0 737475767778797A7B-
+    27 00000ED9 7C7D7E7F8081828384-
+    27 00000EE2 85868788898A8B8C8D-
+    27 00000EEB 8E8F90919293949596-
+    27 00000EF4 9798999A9B9C9D9E9F-
+    27 00000EFD A0A1A2A3A4A5A6A7A8-
+    27 00000F06 A9AAABACADAEAFB0B1-
+    27 00000F0F B2B3B4B5B6B7B8B9BA-
+    27 00000F18 BBBCBDBEBFC0C1C2C3-
+    27 00000F21 C4C5C6C7C8C9CACBCC-
+    27 00000F2A CDCECFD0D1D2D3D4D5-
+    27 00000F33 D6D7D8D9DADBDCDDDE-
+    27 00000F3C DFE0E1E2E3E4E5E6E7-
+    27 00000F45 E8E9EAEBECEDEEEFF0-
+    27 00000F4E F1F2F3F4F5F6F7F8F9-
+    27 00000F57 FAFBFCFDFEFF000102-
+    27 00000F60 030405060708090A0B-
+    27 00000F69 0C0D0E0F1011121314-
+    27 00000F72 15161718191A1B1C1D-
+    27 00000F7B 1E1F20212223242526-
+    27 00000F84 2728292A2B2C2D2E2F-
+    27 00000F8D 303132333435363738-
+    27 00000F96 393A3B3C3D3E3F4041-
+    27 00000F9F 42434445464748494A-
+    27 00000FA8 4B4C4D4E4F50515253-
+    27 00000FB1 5455565758595A5B5C-
+    27 00000FBA 5D5E5F606162636465-
+    27 00000FC3 666768696A6B6C6D6E-
+    27 00000FCC 6F7071727374757677-
+    27 00000FD5 78797A7B7C7D7E7F80-
+    27 00000FDE 818283848586878889-
+    27 00000FE7 8A8B8C8D8E8F909192-
+    27 00000FF0 939495969798999A9B-
+    27 00000FF9 9C9D9E9FA0A1A2A3A4-
+    27 00001002 A5A6A7A8A9AAABACAD-
+    27 0000100B AEAFB0B1B2B3B4B5B6-
+    27 00001014 B7B8B9BABBBCBDBEBF-
+    27 0000101D C0C1C2C3C4C5C6C7C8-
+    27 00001026 C9CACBCCCDCECFD0D1-
+    27 0000102F D2D3D4D5D6D7D8D9DA-
+    27 00001038 DBDCDDDEDFE0E1E2E3-
+    27 00001041 E4E5E6E7E8E9EAEBEC-
+    27 0000104A EDEEEFF0F1F2F3F4F5-
+    27 00001053 F6F7F8F9FAFBFCFDFE-
+    27 0000105C FF0001020304050607-
+    27 00001065 08090A0B0C0D0E0F10-
+    27 0000106E 111213141516171819-
+    27 00001077 1A1B1C1D1E1F202122-
+    27 00001080 232425262728292A2B-
+    27 00001089 2C2D2E2F3031323334-
+    27 00001092 35363738393A3B3C3D-
+    27 0000109B 3E3F40414243444546-
+    27 000010A4 4748494A4B4C4D4E4F-
+    27 000010AD 505152535455565758-
+    27 000010B6 595A5B5C5D5E5F6061-
+    27 000010BF 62636465666768696A-
+    27          ******************       warning: byte data exceeds bounds [-w+number-overflow]
+    27 000010C8 6B6C6D6E6F70717273-
+    27 000010D1 7475767778797A7B7C-
+    27 000010DA 7D7E7F808182838485-
+    27 000010E3 868788898A8B8C8D8E-
+    27 000010EC 8F9091929394959697-
+    27 000010F5 98999A9B9C9D9E9FA0-
+    27 000010FE A1A2A3A4A5A6A7A8A9-
+    27 00001107 AAABACADAEAFB0B1B2-
+    27 00001110 B3B4B5B6B7B8B9BABB-
+    27 00001119 BCBDBEBFC0C1C2C3C4-
+    27 00001122 C5C6C7C8C9CACBCCCD-
+    27 0000112B CECFD0D1D2D3D4D5D6-
+    27 00001134 D7D8D9DADBDCDDDEDF-
+    27 0000113D E0E1E2E3E4E5E6E7E8-
+    27 00001146 E9EAEBECEDEEEFF0F1-
+    27 0000114F F2F3F4F5F6F7F8F9FA-
+    27 00001158 FBFCFDFEFF00010203-
+    27 00001161 0405060708090A0B0C-
+    27 0000116A 0D0E0F101112131415-
+    27 00001173 161718191A1B1C1D1E-
+    27 0000117C 1F2021222324252627-
+    27 00001185 28292A2B2C2D2E2F30-
+    27 0000118E 313233343536373839-
+    27 00001197 3A3B3C3D3E3F404142-
+    27 000011A0 434445464748494A4B-
+    27 000011A9 4C4D4E4F5051525354-
+    27 000011B2 55565758595A5B5C5D-
+    27 000011BB 5E5F60616263646566-
+    27 000011C4 6768696A6B6C6D6E6F-
+    27 000011CD 707172737475767778-
+    27 000011D6 797A7B7C7D7E7F8081-
+    27 000011DF 82838485868788898A-
+    27 000011E8 8B8C8D8E8F90919293-
+    27 000011F1 94                 
+    28 000011F2 45230000                	dw 0x12345, 0
+    28          ******************       warning: word data exceeds bounds [-w+number-overflow]
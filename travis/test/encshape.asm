@@ -0,0 +1,67 @@
+;
+; The same instructions assembled in different modes, with different
+; address sizes and defaults, and with displacements which are zero,
+; fit in a byte or are only known in a later pass, must each be
+; encoded for their own conditions.
+;
+%macro legacy 0
+	mov eax, [bx+si]
+	mov eax, [bx+si+8]
+	mov eax, [bx+si+fwd-$$]
+	add word [bp], 1
+	add word [bp+0x80], 1
+	push word fwd
+	mov al, [es:0x10]
+	common
+%endmacro
+
+%macro common 0
+	mov eax, [fwd]
+	inc dword [near8]
+	jmp fwd
+	a32 mov ax, [eax+4]
+	a32 mov ax, [eax+fwd-$$]
+	lea ecx, [ebx+0]
+	lea ecx, [ebx+1]
+	lea ecx, [ebx+0x100]
+	lea ecx, [ebx*2]
+	lea ecx, [nosplit ebx*2]
+	mov eax, [dword 8]
+	mov eax, [byte ebx+8]
+%endmacro
+
+%macro wide 0
+	mov rax, [fwd]
+	mov rax, [rel fwd]
+	mov rax, [abs fwd]
+	mov eax, [rbx+8]
+	mov eax, [rbx+fwd-$$]
+	a32 mov eax, [ebx+8]
+	lea rcx, [rel near8]
+	mov eax, [fs:rbx+8]
+	vmovaps zmm1, [rax+64]
+	vmovaps zmm1, [rax+65]
+	vmovaps ymm1, [rax+64]
+	vaddps zmm1, zmm2, [rax+fwd-$$]
+	vaddps zmm1, zmm2, [rax+0x40]{1to16}
+	jmp fwd
+%endmacro
+
+near8:
+	bits 16
+	legacy
+	bits 32
+	legacy
+	bits 64
+	common
+	wide
+	default rel
+	wide
+	default abs
+	wide
+	bits 16
+	legacy
+	times 0x90 nop
+fwd:
+	bits 32
+	legacy
@@ -0,0 +1,18 @@
+;
+; Include guards: a guarded header included again is skipped, but
+; only while the guard macro is still defined, and only if nothing
+; follows the %endif.
+;
+%include "incguard1.inc"
+%include "incguard1.inc"
+%include "incguard2.inc"
+%include "incguard2.inc"
+%include "incguard3.inc"
+%include "incguard3.inc"
+%undef INCGUARD3_INC
+%include "incguard3.inc"
+%include "incguard3.inc"
+%define INCGUARD3_INC
+%include "incguard1.inc"
+%include "incguard3.inc"
+    db 0xff
@@ -0,0 +1,25 @@
+;; The same operands matched under different modes and settings
+%macro insns 0
+	mov ax, bx
+	push 1
+	add [ebx], byte 1
+	inc word [ebx]
+	movd mm0, [ebx]
+	imul ax, bx, 3
+	jmp short $
+%endmacro
+
+	bits 16
+	insns
+	bits 32
+	insns
+	cpu p3
+	insns
+	cpu all
+	bits 64
+	insns
+	vaddps zmm0{k1}, zmm1, [rax]{1to16}
+	vaddps xmm0, xmm1, [rax]
+	vaddps xmm0, xmm1, [rax]
+	vaddps ymm0{k2}{z}, ymm1, ymm2
+	vaddps xmm0, xmm1, [rax]
@@ -0,0 +1,71 @@
+;
+; Multi-line macros: parameter substitution, %rotate, greedy and
+; default parameters, recursion and macros defining macros.
+;
+%macro pushall 1-*
+%rep %0
+    db %1
+%rotate 1
+%endrep
+%endmacro
+
+%macro popall 1-*
+%rep %0
+%rotate -1
+    db %1
+%endrep
+%endmacro
+
+%macro greedy 2+
+    db %1
+    db %2
+%endmacro
+
+%macro defaults 1-3 0x20, 0x30
+    db %1, %2, %3, %0
+%endmacro
+
+%rmacro countdown 1
+    db %1
+%if %1 > 1
+    countdown %1 - 1
+%endif
+%endmacro
+
+%macro outer 2
+%macro %1 1
+%%1: db %1, %%1 - $$
+%endmacro
+%%lbl: db %1_tag, %2
+%endmacro
+
+%macro lastarg 1-*
+    db %{1:-1}, %{-1:1}, %{2:2}
+%endmacro
+
+%macro label 0-1
+%ifnempty %1
+    db %1
+%endif
+%%here:
+    dw %%here
+%endmacro
+
+    pushall 1, 2, 3, 4
+    popall 1, 2, 3, 4
+    greedy 5, 6, 7, 8
+    defaults 9
+    defaults 9, 10
+    defaults 9, 10, 11
+%define inner_tag 0x40
+    outer inner, 0x41
+    inner 0x42
+    lastarg 12, 13, 14
+    label
+    label 15
+    %unmacro label 0-1
+%macro label 0-1
+    db 0xee
+%endmacro
+    label
+    countdown 3
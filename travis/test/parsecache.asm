@@ -0,0 +1,17 @@
+;
+; A parsed line can only be reused if the BITS and DEFAULT settings
+; it was parsed with are still the same.
+;
+	bits 64
+start:
+	jmp fwd
+here:
+%if here - start == 2
+	default abs
+%else
+	default rel
+%endif
+	mov eax, [16]
+	times 200 nop
+fwd:
+	ret
@@ -0,0 +1,15 @@
+;
+; The preprocessor output must not be replayed across passes if it
+; depends on the value of a symbol, which may change between passes.
+;
+	bits 32
+start:
+	jmp fwd
+here:
+%if here - start == 2
+	times 200 db 0
+%else
+	times 150 db 1
+%endif
+fwd:
+	ret
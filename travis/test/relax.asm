@@ -0,0 +1,22 @@
+;
+; Cascading span-dependent jumps: each jump that has to be lengthened
+; pushes the next one out of range, so the sizes converge slowly.
+;
+	bits 32
+%assign i 0
+%rep 40
+l %+ i:
+	jz l %+ %eval(i+2)
+	times 60 nop
+	jmp l %+ %eval(i > 3 ? i-3 : 0)
+%assign i i+1
+%endrep
+l %+ i:
+	ret
+%assign i i+1
+l %+ i:
+	ret
+
+	section .data follows=.text
+back:
+	dd l0, l20, l40
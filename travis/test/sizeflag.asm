@@ -0,0 +1,9 @@
+;; Size flags that apply to a single operand (ARx) other than the first
+	bits 64
+	pinsrw mm0, eax, 3
+	pinsrw mm0, eax, byte 3
+	pinsrw xmm0, [rax], 1
+	pinsrw xmm0, [rax], byte 1
+	pextrw eax, xmm1, 2
+	pextrw eax, xmm1, byte 2
+	pextrw eax, mm1, byte 2
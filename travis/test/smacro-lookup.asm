@@ -0,0 +1,76 @@
+;
+; Single-line macro lookups: definition, removal and redefinition,
+; case-insensitive names, overloading by parameter count, aliases,
+; context-local names, names made up by pasting and lookups after
+; the macro table has been cleared, both by %clear and between
+; passes.
+;
+    dw end
+%define val 1
+%idefine Ival 2
+    db val, ival, IVAL, iVaL
+%define VAL 3
+    db val, VAL
+%undef val
+%ifdef val
+    db 0xff
+%endif
+    db VAL
+%define val 4
+%define val 5
+    db val
+%undef Ival
+%ifidn ival, ival
+    db 6
+%endif
+%ifdef ival
+    db 0xff
+%endif
+
+%define f(x) x + 1
+%define f(x, y) x + y
+    db f(7), f(7, 1)
+%undef f
+%define f(x) x + 2
+    db f(2)
+
+%defalias al_name target
+%define target 9
+    db al_name
+%undefalias al_name
+%define al_name 10
+    db al_name
+
+%push ctx
+%define %$local 11
+%idefine %$ILOCAL 12
+    db %$local, %$ilocal
+%push inner
+%define %$local 13
+    db %$local, %$$local
+%pop
+    db %$local
+%pop
+
+%define part_a 14
+%xdefine both %[part_ %+ a]
+%define part_a 15
+    db both, part_%[a]
+%assign n 16
+%assign n n + 1
+    db n
+%undef n
+%define n 18
+    db n
+
+%clear
+%ifdef val
+    db 0xff
+%endif
+%ifdef VAL
+    db 0xff
+%endif
+%define val 19
+%idefine Ival 20
+    db val, IVAL, iVaL
+end:
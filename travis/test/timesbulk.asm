@@ -0,0 +1,14 @@
+;; TIMES repetitions emitted in bulk, mixed with position-dependent ones
+	bits 32
+start:
+	times 5 nop
+	times 3 db 1, 2, "abc"
+	times 4 mov eax, [ebx+8]
+	times 3 dd $ - start
+	times 3 dw 0x1234
+here:	times 4 jmp here
+	times 2 call start
+	times 0 nop
+	times 1000 db 0x90
+	times 257 dq 0x0102030405060708
+	db 0xff
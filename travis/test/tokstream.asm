@@ -0,0 +1,23 @@
+;
+; Lines which refer to a forward symbol are parsed again on every
+; pass from their token stream; the result must not change, and
+; diagnostics from the scanner must still be issued.
+;
+	bits 64
+start:
+	jmp fwd
+	db 'abc', fwd-start, -1.5, "x`y", `a\nb`, fwd
+	dd fwd, "ab", -2.0e3, +fwd
+	mov eax, [rel fwd + 4]
+	vaddps zmm1{k1}{z}, zmm2, [rbx+fwd]{1to16}
+	vaddps zmm1, zmm2, zmm3, {rn-sae}
+	mov eax, __?utf16?__('xy') + fwd
+	dw __?utf16le?__("ab"), fwd
+	mov rbx, 123456789012345678901234 + fwd
+	dq 0x10, 1_000, 0b1010, fwd, $, $$
+	cmp ax, fwd
+	mov ecx, dword ptr + fwd
+	times 200 nop
+fwd:
+	ret
+ptr:
@@ -249,18 +249,45 @@ if ( $output eq 'a' ) {
     print A "#include \"nasm.h\"\n";
     print A "#include \"insns.h\"\n\n";
 
+    print A "static const struct itemplate * const instrux_none[] = {\n";
+    print A "    NULL\n};\n\n";
+
     foreach $i (@opcodes, @opcodes_cc) {
+        my @byops = ();
+
         print A "static const struct itemplate instrux_${i}[] = {\n";
         $aname = "aa_$i";
+        $n = 0;
         foreach $j (@$aname) {
             print A "    ", codesubst($j), "\n";
+            die "$0: bad template for $i\n" unless ($j =~ /^\{I_\w+, (\d+),/);
+            push(@{$byops[$1]}, $n++);
         }
         print A "    ITEMPLATE_END\n};\n\n";
+
+        # Templates for this opcode grouped by operand count
+        for ($n = 0; $n <= $MAX_OPERANDS; $n++) {
+            next unless (defined($byops[$n]));
+            print A "static const struct itemplate * const instrux_${i}_${n}[] = {\n";
+            foreach $j (@{$byops[$n]}) {
+                print A "    instrux_${i} + $j,\n";
+            }
+            print A "    NULL\n};\n\n";
+        }
+        $opsindex{$i} = [map { defined($byops[$_]) ? "instrux_${i}_$_" :
+                                   'instrux_none' } (0..$MAX_OPERANDS)];
     }
     print A "const struct itemplate * const nasm_instructions[] = {\n";
     foreach $i (@opcodes, @opcodes_cc) {
         print A "    instrux_${i},\n";
     }
+    print A "};\n\n";
+
+    print A "const struct itemplate * const * const " .
+        "nasm_insn_index[][MAX_OPERANDS+1] = {\n";
+    foreach $i (@opcodes, @opcodes_cc) {
+        print A "    { ", join(', ', @{$opsindex{$i}}), " },\n";
+    }
     print A "};\n";
 
     close A;
@@ -524,6 +551,7 @@ sub format_insn($$$$$) {
 	}
 
 	if ($flag =~ /^AR([0-9]+)$/) {
+	    die "$fname:$line: more than one ARx flag\n" if (defined($arx));
 	    $arx = $1+0;
 	}
     }
@@ -575,7 +603,23 @@ sub format_insn($$$$$) {
     $codes = hexstr(@bytecode);
     count_bytecodes(@bytecode);
 
-    ("{I_$opcode, $num, {$operands}, $decorators, \@\@CODES-$codes\@\@, $flagsindex},", $nd);
+    # Resolve the flags tested by matches() at build time
+    my @mflags = ();
+    foreach my $sf ('SB', 'SW', 'SD', 'SQ', 'SO', 'SY', 'SZ',
+		    'ANYSIZE', 'SIZE') {
+	push(@mflags, "ITM_$sf") if ($flags{$sf});
+    }
+    die "$fname:$line: more than one operand size flag\n"
+	if (scalar(@mflags) > 1);
+    push(@mflags, "ITM_AR($arx)") if (defined($arx));
+    foreach my $mf ('SM', 'SM2', 'SX', 'OPT', 'VEX', 'EVEX',
+		    'LONG', 'NOLONG', 'NOHLE', 'BND') {
+	push(@mflags, "ITM_$mf") if ($flags{$mf});
+    }
+    push(@mflags, 'ITM_JUMP') if (($bytecode[0] & ~1) == 0370);
+    my $mflags = @mflags ? join('|', @mflags) : '0';
+
+    ("{I_$opcode, $num, {$operands}, $decorators, \@\@CODES-$codes\@\@, $flagsindex, $mflags},", $nd);
 }
 
 #